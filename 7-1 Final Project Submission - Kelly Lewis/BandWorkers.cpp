@@ -0,0 +1,88 @@
+
+//Band Workers - parked threads woken once per frame, one band each
+
+#include <algorithm>
+
+#include "BandWorkers.h"
+
+using namespace std; // standard namespace
+
+BandWorkers::BandWorkers() : job(nullptr), frame(0), remaining(0), running(false)
+{
+}
+
+BandWorkers::~BandWorkers()
+{
+    stop();
+}
+
+void BandWorkers::start(unsigned workerCount, unsigned maxWorkers)
+{
+    if (running)
+        return;
+
+    if (workerCount == 0) {
+        unsigned cores = thread::hardware_concurrency();
+        workerCount = cores > 1 ? min(cores - 1, 3u) : 0;
+    }
+
+    workerCount = min(workerCount, maxWorkers);
+    if (workerCount == 0)
+        return;
+
+    running = true;
+    for (unsigned i = 0; i < workerCount; ++i)
+        workers.push_back(thread(&BandWorkers::workerMain, this, i + 1, frame));
+}
+
+void BandWorkers::stop()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        running = false;
+    }
+    wake.notify_all();
+
+    for (thread& worker : workers)
+        worker.join();
+    workers.clear();
+}
+
+void BandWorkers::run(const function<void(unsigned)>& bandJob)
+{
+    {
+        lock_guard<mutex> guard(lock);
+        job = &bandJob;
+        ++frame;
+        remaining = (unsigned)workers.size();
+    }
+    wake.notify_all();
+
+    bandJob(0);
+
+    unique_lock<mutex> guard(lock);
+    done.wait(guard, [this]() { return remaining == 0; });
+    job = nullptr;
+}
+
+void BandWorkers::workerMain(unsigned band, uint64_t lastFrame)
+{
+    unique_lock<mutex> guard(lock);
+
+    while (true) {
+        wake.wait(guard, [&]() { return !running || frame != lastFrame; });
+        if (!running)
+            return;
+        lastFrame = frame;
+
+        const function<void(unsigned)>& bandJob = *job;
+        guard.unlock();
+        bandJob(band);
+        guard.lock();
+
+        if (--remaining == 0)
+            done.notify_one();
+    }
+}
+
+// END
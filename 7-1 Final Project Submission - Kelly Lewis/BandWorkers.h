@@ -0,0 +1,46 @@
+#pragma once
+
+//Band Workers Header - fork-join threads for per-frame work split into numbered bands
+
+#ifndef BAND_WORKERS_H
+#define BAND_WORKERS_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Each run() hands band 0 to the calling thread and bands 1 to N to N parked workers, then waits for all of them.
+// The job decides what a band covers from its number and bandCount().
+class BandWorkers {
+public:
+    BandWorkers();
+    ~BandWorkers();
+
+    // Start workers (0 picks one per spare core, at most 3, and never more than maxWorkers). Without workers
+    // run() only calls the job on the caller.
+    void start(unsigned workerCount, unsigned maxWorkers);
+    void stop();
+
+    // Call job(band) once for every band, returning when the last one is done
+    void run(const std::function<void(unsigned)>& job);
+
+    unsigned bandCount() const { return (unsigned)workers.size() + 1; }
+
+private:
+    void workerMain(unsigned band, uint64_t lastFrame);
+
+    const std::function<void(unsigned)>* job;  // the running frame's, set by run()
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t frame;
+    unsigned remaining;
+    bool running;
+};
+
+#endif
+//END
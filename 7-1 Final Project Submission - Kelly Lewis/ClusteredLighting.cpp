@@ -0,0 +1,300 @@
+
+//Clustered Lighting - cluster boxes, threaded light assignment and the light storage buffers
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+
+#include "ClusteredLighting.h"
+#include "GLStateCache.h"
+
+using namespace std; // standard namespace
+
+namespace {
+
+    const int TILES_PER_SLICE = CLUSTER_X * CLUSTER_Y;
+
+    // Smallest allocation for a light buffer, a zero sized buffer cannot be bound
+    const size_t MIN_LIGHT_BUFFER_BYTES = 256;
+
+    // Squared distance from the sphere center to the nearest point of the box, against the squared radius
+    bool USphereTouchesBox(const glm::vec3& center, float radius, const glm::vec3& boxMin, const glm::vec3& boxMax) {
+        float distance = 0.0f;
+        for (int axis = 0; axis < 3; ++axis) {
+            float outside = max(max(boxMin[axis] - center[axis], center[axis] - boxMax[axis]), 0.0f);
+            distance += outside * outside;
+        }
+        return distance <= radius * radius;
+    }
+}
+
+LightClusterer::LightClusterer()
+    : boundsProjection(0.0f), boundsNear(0.0f), boundsFar(0.0f), sliceScale(0.0f), sliceBias(0.0f),
+    grid(nullptr)
+{
+    sliceIndices.resize(CLUSTER_Z);
+    candidates.resize(1);
+}
+
+LightClusterer::~LightClusterer()
+{
+    stop();
+}
+
+void LightClusterer::start(unsigned workerCount)
+{
+    // The calling thread always takes band 0, and every band needs at least one slice
+    bandWorkers.start(workerCount, CLUSTER_Z - 1);
+    candidates.resize(bandWorkers.bandCount());
+}
+
+void LightClusterer::stop()
+{
+    bandWorkers.stop();
+}
+
+// View-space box of every cluster: the rays through a tile's corners, cut at the slice's near and far depth
+void LightClusterer::buildClusterBounds(const glm::mat4& projection, float nearPlane, float farPlane)
+{
+    boundsProjection = projection;
+    boundsNear = nearPlane;
+    boundsFar = farPlane;
+
+    float logRatio = log(farPlane / nearPlane);
+    sliceScale = CLUSTER_Z / logRatio;
+    sliceBias = -CLUSTER_Z * log(nearPlane) / logRatio;
+
+    // Each tile corner's ray from the near plane to the far plane. Orthographic rays come out parallel.
+    glm::mat4 inverseProjection = glm::inverse(projection);
+    vector<glm::vec3> rayNear((CLUSTER_X + 1) * (CLUSTER_Y + 1));
+    vector<glm::vec3> rayFar(rayNear.size());
+    for (int y = 0; y <= CLUSTER_Y; ++y) {
+        for (int x = 0; x <= CLUSTER_X; ++x) {
+            glm::vec2 ndc(-1.0f + 2.0f * x / CLUSTER_X, -1.0f + 2.0f * y / CLUSTER_Y);
+            glm::vec4 nearPoint = inverseProjection * glm::vec4(ndc, -1.0f, 1.0f);
+            glm::vec4 farPoint = inverseProjection * glm::vec4(ndc, 1.0f, 1.0f);
+            rayNear[y * (CLUSTER_X + 1) + x] = glm::vec3(nearPoint) / nearPoint.w;
+            rayFar[y * (CLUSTER_X + 1) + x] = glm::vec3(farPoint) / farPoint.w;
+        }
+    }
+
+    clusterMin.resize(CLUSTER_COUNT);
+    clusterMax.resize(CLUSTER_COUNT);
+    columnBounds.assign(CLUSTER_Z * CLUSTER_X, glm::vec2(FLT_MAX, -FLT_MAX));
+    rowBounds.assign(CLUSTER_Z * CLUSTER_Y, glm::vec2(FLT_MAX, -FLT_MAX));
+    for (int z = 0; z < CLUSTER_Z; ++z) {
+        float depths[2] = {
+            nearPlane * pow(farPlane / nearPlane, (float)z / CLUSTER_Z),
+            nearPlane * pow(farPlane / nearPlane, (float)(z + 1) / CLUSTER_Z)
+        };
+
+        for (int y = 0; y < CLUSTER_Y; ++y) {
+            for (int x = 0; x < CLUSTER_X; ++x) {
+                glm::vec3 boxMin(FLT_MAX);
+                glm::vec3 boxMax(-FLT_MAX);
+                for (int corner = 0; corner < 4; ++corner) {
+                    int ray = (y + corner / 2) * (CLUSTER_X + 1) + x + corner % 2;
+                    const glm::vec3& a = rayNear[ray];
+                    const glm::vec3& b = rayFar[ray];
+                    for (float depth : depths) {
+                        float t = (-depth - a.z) / (b.z - a.z);
+                        glm::vec3 point = a + (b - a) * t;
+                        boxMin = glm::min(boxMin, point);
+                        boxMax = glm::max(boxMax, point);
+                    }
+                }
+
+                int cluster = z * TILES_PER_SLICE + y * CLUSTER_X + x;
+                clusterMin[cluster] = boxMin;
+                clusterMax[cluster] = boxMax;
+
+                glm::vec2& column = columnBounds[z * CLUSTER_X + x];
+                column = glm::vec2(min(column.x, boxMin.x), max(column.y, boxMax.x));
+                glm::vec2& row = rowBounds[z * CLUSTER_Y + y];
+                row = glm::vec2(min(row.x, boxMin.y), max(row.y, boxMax.y));
+            }
+        }
+    }
+}
+
+int LightClusterer::sliceOf(float viewDepth) const
+{
+    int slice = (int)floor(log(viewDepth) * sliceScale + sliceBias);
+    return min(max(slice, 0), CLUSTER_Z - 1);
+}
+
+void LightClusterer::assign(const vector<LightData>& lights, const glm::mat4& view, const glm::mat4& projection,
+    float nearPlane, float farPlane, vector<LightCluster>& clusters, vector<GLuint>& indices)
+{
+    auto start = chrono::high_resolution_clock::now();
+
+    LightClusterStats stats;
+    stats.lights = (uint32_t)lights.size();
+
+    if (projection != boundsProjection || nearPlane != boundsNear || farPlane != boundsFar)
+        buildClusterBounds(projection, nearPlane, farPlane);
+
+    // Into view space once, with the depth slices each sphere can reach
+    viewLights.resize(lights.size());
+    for (size_t i = 0; i < lights.size(); ++i) {
+        ViewLight& light = viewLights[i];
+        light.center = glm::vec3(view * glm::vec4(glm::vec3(lights[i].positionRange), 1.0f));
+        light.range = lights[i].positionRange.w;
+
+        float nearest = -light.center.z - light.range;
+        float farthest = -light.center.z + light.range;
+        if (light.range <= 0.0f) {
+            light.firstSlice = 0;
+            light.lastSlice = CLUSTER_Z - 1;
+        }
+        else if (farthest < nearPlane || nearest > farPlane) {
+            light.firstSlice = 1;
+            light.lastSlice = 0;
+        }
+        else {
+            light.firstSlice = sliceOf(max(nearest, nearPlane));
+            light.lastSlice = sliceOf(min(farthest, farPlane));
+        }
+        stats.visibleLights += light.firstSlice <= light.lastSlice ? 1 : 0;
+    }
+
+    // Band 0 here, the rest on the workers
+    clusters.resize(CLUSTER_COUNT);
+    grid = &clusters;
+    bandWorkers.run([this](unsigned band) { assignSlices(band); });
+    grid = nullptr;
+
+    // Join the slices' index runs in slice order, rebasing each slice's offsets
+    indices.clear();
+    for (int z = 0; z < CLUSTER_Z; ++z) {
+        GLuint base = (GLuint)indices.size();
+        for (int tile = 0; tile < TILES_PER_SLICE; ++tile) {
+            LightCluster& cluster = clusters[z * TILES_PER_SLICE + tile];
+            cluster.offset += base;
+            stats.maxPerCluster = max(stats.maxPerCluster, cluster.count);
+            stats.emptyClusters += cluster.count == 0 ? 1 : 0;
+        }
+        indices.insert(indices.end(), sliceIndices[z].begin(), sliceIndices[z].end());
+    }
+    stats.assignments = (uint32_t)indices.size();
+
+    chrono::duration<double, micro> elapsed = chrono::high_resolution_clock::now() - start;
+    stats.assignMicroseconds = elapsed.count();
+    lastStats = stats;
+}
+
+// Every band-th slice starting at band. Each slice first narrows the lights to those reaching its depth range,
+// and each of those to the columns and rows its sphere's extent overlaps, before any box is tested.
+void LightClusterer::assignSlices(unsigned band)
+{
+    unsigned bandCount = bandWorkers.bandCount();
+    vector<SliceLight>& nearby = candidates[band];
+
+    for (int z = (int)band; z < CLUSTER_Z; z += (int)bandCount) {
+        const glm::vec2* columns = &columnBounds[z * CLUSTER_X];
+        const glm::vec2* rows = &rowBounds[z * CLUSTER_Y];
+
+        nearby.clear();
+        for (uint32_t i = 0; i < (uint32_t)viewLights.size(); ++i) {
+            const ViewLight& light = viewLights[i];
+            if (z < light.firstSlice || z > light.lastSlice)
+                continue;
+
+            SliceLight entry = { i, 0, CLUSTER_X - 1, 0, CLUSTER_Y - 1 };
+            if (light.range > 0.0f) {
+                while (entry.firstX <= entry.lastX && columns[entry.firstX].y < light.center.x - light.range)
+                    ++entry.firstX;
+                while (entry.lastX >= entry.firstX && columns[entry.lastX].x > light.center.x + light.range)
+                    --entry.lastX;
+                while (entry.firstY <= entry.lastY && rows[entry.firstY].y < light.center.y - light.range)
+                    ++entry.firstY;
+                while (entry.lastY >= entry.firstY && rows[entry.lastY].x > light.center.y + light.range)
+                    --entry.lastY;
+                if (entry.firstX > entry.lastX || entry.firstY > entry.lastY)
+                    continue;
+            }
+            nearby.push_back(entry);
+        }
+
+        vector<GLuint>& out = sliceIndices[z];
+        out.clear();
+        for (int y = 0; y < CLUSTER_Y; ++y) {
+            for (int x = 0; x < CLUSTER_X; ++x) {
+                int cluster = z * TILES_PER_SLICE + y * CLUSTER_X + x;
+                LightCluster& entry = (*grid)[cluster];
+                entry.offset = (GLuint)out.size();
+
+                for (const SliceLight& candidate : nearby) {
+                    if (x < candidate.firstX || x > candidate.lastX || y < candidate.firstY || y > candidate.lastY)
+                        continue;
+                    const ViewLight& light = viewLights[candidate.light];
+                    if (light.range <= 0.0f || USphereTouchesBox(light.center, light.range, clusterMin[cluster], clusterMax[cluster]))
+                        out.push_back(candidate.light);
+                }
+                entry.count = (GLuint)out.size() - entry.offset;
+            }
+        }
+    }
+}
+
+glm::vec4 LightClusterer::clusterScale(int framebufferWidth, int framebufferHeight) const
+{
+    return glm::vec4((float)CLUSTER_X / max(framebufferWidth, 1), (float)CLUSTER_Y / max(framebufferHeight, 1), sliceScale, sliceBias);
+}
+
+glm::uvec4 LightClusterer::clusterGrid(size_t lightCount) const
+{
+    return glm::uvec4(CLUSTER_X, CLUSTER_Y, CLUSTER_Z, (GLuint)lightCount);
+}
+
+void LightClusterer::printStats(ostream& out) const
+{
+    out << "===== Clustered Lighting =====\n"
+        << "Lights: " << lastStats.lights << ", in view depth: " << lastStats.visibleLights << ", clusters: " << CLUSTER_X << "x"
+        << CLUSTER_Y << "x" << CLUSTER_Z << " (" << lastStats.emptyClusters << " empty)\n"
+        << "Assignments: " << lastStats.assignments << ", most in one cluster: " << lastStats.maxPerCluster
+        << ", assign: " << fixed << setprecision(1) << lastStats.assignMicroseconds << " us on " << bandWorkers.bandCount() << " threads" << endl;
+}
+
+void LightBuffers::create()
+{
+    lightBuffer.create("Light list SSBO");
+    gridBuffer.create("Light grid SSBO");
+    indexBuffer.create("Light index SSBO");
+    lightCapacity = gridCapacity = indexCapacity = 0;
+}
+
+void LightBuffers::reset()
+{
+    lightBuffer.reset();
+    gridBuffer.reset();
+    indexBuffer.reset();
+    lightCapacity = gridCapacity = indexCapacity = 0;
+}
+
+void LightBuffers::update(const vector<LightData>& lights, const vector<LightCluster>& grid, const vector<GLuint>& indices)
+{
+    upload(lightBuffer, lightCapacity, LIGHT_DATA_BINDING, lights.data(), lights.size() * sizeof(LightData));
+    upload(gridBuffer, gridCapacity, LIGHT_GRID_BINDING, grid.data(), grid.size() * sizeof(LightCluster));
+    upload(indexBuffer, indexCapacity, LIGHT_INDEX_BINDING, indices.data(), indices.size() * sizeof(GLuint));
+}
+
+// Reallocate only when the data outgrew the buffer, doubling so a growing light count settles quickly
+void LightBuffers::upload(GpuBuffer& buffer, size_t& capacity, GLuint binding, const void* data, size_t bytes)
+{
+    GLStateCache& state = UGLState();
+    state.bindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+
+    if (capacity == 0 || bytes > capacity) {
+        capacity = max(max(bytes, capacity * 2), MIN_LIGHT_BUFFER_BYTES);
+        UBufferData(buffer, GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)capacity, NULL, GL_DYNAMIC_DRAW);
+    }
+    if (bytes > 0)
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)bytes, data);
+
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+}
+
+// END
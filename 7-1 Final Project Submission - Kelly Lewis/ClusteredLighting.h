@@ -0,0 +1,181 @@
+#pragma once
+
+//Clustered Lighting Header - point lights binned into view-space clusters, read by the fragment shader from SSBOs
+
+#ifndef CLUSTERED_LIGHTING_H
+#define CLUSTERED_LIGHTING_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include <GL/glew.h>        // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "BandWorkers.h"
+#include "GpuResources.h"
+
+// Shader storage binding points for the light list, the cluster grid and the index list (0 is the object array)
+const GLuint LIGHT_DATA_BINDING = 1;
+const GLuint LIGHT_GRID_BINDING = 2;
+const GLuint LIGHT_INDEX_BINDING = 3;
+
+// Cluster grid: screen tiles across and down, exponential depth slices between the near and far planes
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+
+// CPU mirror of one std430 LightRecord
+struct LightData {
+    glm::vec4 positionRange;    // xyz: world position, w: range. 0 never fades and reaches every cluster.
+    glm::vec4 color;            // rgb, a unused
+    glm::vec4 phong;            // x: ambient strength, y: specular strength, z: highlight size, w unused
+};
+
+// One cluster's run of the index list
+struct LightCluster {
+    GLuint offset;
+    GLuint count;
+};
+
+static_assert(sizeof(LightData) == 3 * 16, "LightData must match the std430 layout of the GLSL struct");
+static_assert(sizeof(LightCluster) == 8, "LightCluster must match a GLSL uvec2");
+
+// GLSL declaration of the light storage blocks and the per-light Phong term. Pasted after FRAME_DATA_BLOCK,
+// whose view, clusterScale and clusterGrid locate the fragment's cluster. lit scales the diffuse and specular
+// terms, 0 where the light is shadowed; ambient always reaches.
+#define LIGHT_DATA_BLOCK \
+    "struct LightRecord {\n" \
+    "    vec4 positionRange;\n" \
+    "    vec4 color;\n" \
+    "    vec4 phong;\n" \
+    "};\n" \
+    "layout(std430) readonly buffer LightData {\n" \
+    "    LightRecord lights[];\n" \
+    "};\n" \
+    "layout(std430) readonly buffer LightGrid {\n" \
+    "    uvec2 clusters[];\n" \
+    "};\n" \
+    "layout(std430) readonly buffer LightIndices {\n" \
+    "    uint lightIndices[];\n" \
+    "};\n" \
+    "uvec2 clusterLights(vec3 worldPos) {\n" \
+    "    float viewDepth = max(-(view * vec4(worldPos, 1.0)).z, 1e-4);\n" \
+    "    vec2 tile = clamp(gl_FragCoord.xy * clusterScale.xy, vec2(0.0), vec2(clusterGrid.xy - 1u));\n" \
+    "    float slice = clamp(log(viewDepth) * clusterScale.z + clusterScale.w, 0.0, float(clusterGrid.z - 1u));\n" \
+    "    uvec3 cell = uvec3(vec3(tile, slice));\n" \
+    "    return clusters[cell.x + clusterGrid.x * (cell.y + clusterGrid.y * cell.z)];\n" \
+    "}\n" \
+    "vec3 phongLight(LightRecord light, vec3 fragPos, vec3 norm, vec3 viewDir, float lit) {\n" \
+    "    vec3 toLight = light.positionRange.xyz - fragPos;\n" \
+    "    float range = light.positionRange.w;\n" \
+    "    float fade = 1.0;\n" \
+    "    if (range > 0.0) {\n" \
+    "        fade = clamp(1.0 - dot(toLight, toLight) / (range * range), 0.0, 1.0);\n" \
+    "        fade *= fade;\n" \
+    "    }\n" \
+    "    vec3 lightDirection = normalize(toLight);\n" \
+    "    vec3 ambient = light.phong.x * light.color.rgb;\n" \
+    "    vec3 diffuse = max(dot(norm, lightDirection), 0.0) * light.color.rgb;\n" \
+    "    vec3 reflectDir = reflect(-lightDirection, norm);\n" \
+    "    vec3 specular = light.phong.y * pow(max(dot(viewDir, reflectDir), 0.0), light.phong.z) * light.color.rgb;\n" \
+    "    return (ambient + (diffuse + specular) * lit) * fade;\n" \
+    "}\n"
+
+// Last frame's assignment
+struct LightClusterStats {
+    uint32_t lights = 0;
+    uint32_t visibleLights = 0;     // reached at least one depth slice
+    uint32_t assignments = 0;       // entries in the index list
+    uint32_t maxPerCluster = 0;
+    uint32_t emptyClusters = 0;
+    double assignMicroseconds = 0.0;
+};
+
+// Bins lights into the cluster grid on the CPU. Each cluster's box is built once per projection; every frame the
+// lights are moved into view space and tested sphere against box. Depth slices are shared out round robin
+// between the calling thread and the workers, each filling its own slices' index runs.
+class LightClusterer {
+public:
+    LightClusterer();
+    ~LightClusterer();
+
+    // Start worker threads (0 picks one per spare core, at most 3). Without workers assign() runs on the caller.
+    void start(unsigned workerCount = 0);
+    void stop();
+
+    // Fill grid (CLUSTER_COUNT entries) and indices for the lights as seen by this camera
+    void assign(const std::vector<LightData>& lights, const glm::mat4& view, const glm::mat4& projection,
+        float nearPlane, float farPlane, std::vector<LightCluster>& grid, std::vector<GLuint>& indices);
+
+    // FrameData values for the last assign(): tiles per pixel at this framebuffer size, log depth to slice
+    // scale and bias, then the grid size and light count
+    glm::vec4 clusterScale(int framebufferWidth, int framebufferHeight) const;
+    glm::uvec4 clusterGrid(size_t lightCount) const;
+
+    const LightClusterStats& stats() const { return lastStats; }
+    void printStats(std::ostream& out) const;
+
+private:
+    // Light in view space with the depth slices its sphere overlaps (first > last when none)
+    struct ViewLight {
+        glm::vec3 center;
+        float range;
+        int firstSlice;
+        int lastSlice;
+    };
+
+    // Light reaching the slice being filled, with the tiles its sphere overlaps there
+    struct SliceLight {
+        uint32_t light;
+        int firstX, lastX;
+        int firstY, lastY;
+    };
+
+    void buildClusterBounds(const glm::mat4& projection, float nearPlane, float farPlane);
+    int sliceOf(float viewDepth) const;
+    void assignSlices(unsigned band);
+
+    glm::mat4 boundsProjection;     // projection the cluster boxes were built for
+    float boundsNear, boundsFar;
+    float sliceScale, sliceBias;    // slice = log(view depth) * sliceScale + sliceBias
+    std::vector<glm::vec3> clusterMin, clusterMax;
+    std::vector<glm::vec2> columnBounds;    // per slice and tile column, x extent over every row
+    std::vector<glm::vec2> rowBounds;       // per slice and tile row, y extent over every column
+
+    std::vector<ViewLight> viewLights;
+    std::vector<LightCluster>* grid;
+    std::vector<std::vector<GLuint>> sliceIndices;  // per slice, offsets in grid are relative to the slice
+    std::vector<std::vector<SliceLight>> candidates; // per band, lights overlapping the slice being filled
+
+    LightClusterStats lastStats;
+
+    BandWorkers bandWorkers;
+};
+
+// The light list and cluster lists on the GPU. Buffers grow to the largest frame seen and stay bound to
+// their storage binding points.
+class LightBuffers {
+public:
+    void create();
+    void reset();
+
+    // Upload one frame's lists
+    void update(const std::vector<LightData>& lights, const std::vector<LightCluster>& grid, const std::vector<GLuint>& indices);
+
+private:
+    void upload(GpuBuffer& buffer, size_t& capacity, GLuint binding, const void* data, size_t bytes);
+
+    GpuBuffer lightBuffer;
+    GpuBuffer gridBuffer;
+    GpuBuffer indexBuffer;
+    size_t lightCapacity = 0;
+    size_t gridCapacity = 0;
+    size_t indexCapacity = 0;
+};
+
+#endif
+//END
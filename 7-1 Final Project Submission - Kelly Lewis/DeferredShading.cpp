@@ -0,0 +1,111 @@
+
+//Deferred Shading - G-buffer allocation and the passes that write and read it
+
+#include <iostream>
+
+#include "DeferredShading.h"
+#include "GLStateCache.h"
+
+using namespace std; // standard namespace
+
+namespace {
+
+    // Immutable single level texture, sampled with texelFetch so it needs no filtering or mipmaps
+    void UCreateTarget(GpuTexture& texture, const char* label, GLenum format, int width, int height, size_t bytesPerPixel) {
+        texture.create(label);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        texture.setSize((size_t)width * height * bytesPerPixel);
+    }
+}
+
+const char* UShadingPathName(ShadingPath path)
+{
+    switch (path) {
+    case ShadingPath::Forward:  return "forward";
+    case ShadingPath::Deferred: return "deferred";
+    }
+    return "unknown";
+}
+
+bool GBuffer::resize(int width, int height)
+{
+    width = width > 0 ? width : 1;
+    height = height > 0 ? height : 1;
+    if (framebuffer != 0 && width == bufferWidth && height == bufferHeight)
+        return false;
+
+    reset();
+
+    UCreateTarget(albedo, "G-buffer albedo", GL_RGBA8, width, height, 4);
+    UCreateTarget(normal, "G-buffer normal", GL_RG16, width, height, 4);
+    UCreateTarget(depth, "G-buffer depth", GL_DEPTH_COMPONENT32F, width, height, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+    const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        cout << "ERROR::GBUFFER::INCOMPLETE at " << width << "x" << height << endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    fullScreen.create("Full-screen triangle VAO");
+    bufferWidth = width;
+    bufferHeight = height;
+    return true;
+}
+
+void GBuffer::reset()
+{
+    if (framebuffer != 0) {
+        glDeleteFramebuffers(1, &framebuffer);
+        framebuffer = 0;
+    }
+    albedo.reset();
+    normal.reset();
+    depth.reset();
+    fullScreen.reset();
+    bufferWidth = bufferHeight = 0;
+}
+
+void GBuffer::beginGeometry()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    GLStateCache& state = UGLState();
+    state.depthMask(GL_TRUE);
+    state.colorMask(GL_TRUE);
+    state.clearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void GBuffer::beginLighting(GLuint target)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+
+    GLStateCache& state = UGLState();
+    state.activeTexture(GL_TEXTURE0 + GBUFFER_ALBEDO_UNIT);
+    state.bindTexture(GL_TEXTURE_2D, albedo);
+    state.activeTexture(GL_TEXTURE0 + GBUFFER_NORMAL_UNIT);
+    state.bindTexture(GL_TEXTURE_2D, normal);
+    state.activeTexture(GL_TEXTURE0 + GBUFFER_DEPTH_UNIT);
+    state.bindTexture(GL_TEXTURE_2D, depth);
+    state.activeTexture(GL_TEXTURE0);
+}
+
+void GBuffer::drawFullScreen()
+{
+    UGLState().bindVertexArray(fullScreen);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+// END
@@ -0,0 +1,87 @@
+#pragma once
+
+//Deferred Shading Header - compact G-buffer and the full-screen lighting pass that reads it
+
+#ifndef DEFERRED_SHADING_H
+#define DEFERRED_SHADING_H
+
+#include <cstddef>
+
+#include <GL/glew.h>        // GLEW library
+
+#include "GpuResources.h"
+
+// How opaque surfaces are lit
+enum class ShadingPath {
+    Forward,    // every light evaluated while the geometry is drawn, once per shaded fragment
+    Deferred    // geometry writes the G-buffer, lights are evaluated once per pixel afterwards
+};
+
+const char* UShadingPathName(ShadingPath path);
+
+// Texture units the lighting pass samples the G-buffer from. Unit 0 stays with the material textures.
+const GLuint GBUFFER_ALBEDO_UNIT = 1;
+const GLuint GBUFFER_NORMAL_UNIT = 2;
+const GLuint GBUFFER_DEPTH_UNIT = 3;
+
+// GLSL helpers shared by the geometry and lighting shaders. Unit normals are folded onto an octahedron and
+// stored as two 16 bit unorm values, world position is rebuilt from depth.
+#define GBUFFER_BLOCK \
+    "vec2 octEncode(vec3 n) {\n" \
+    "    n /= abs(n.x) + abs(n.y) + abs(n.z);\n" \
+    "    vec2 folded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);\n" \
+    "    return folded * 0.5 + 0.5;\n" \
+    "}\n" \
+    "vec3 octDecode(vec2 encoded) {\n" \
+    "    vec2 folded = encoded * 2.0 - 1.0;\n" \
+    "    vec3 n = vec3(folded, 1.0 - abs(folded.x) - abs(folded.y));\n" \
+    "    float t = max(-n.z, 0.0);\n" \
+    "    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);\n" \
+    "    return normalize(n);\n" \
+    "}\n" \
+    "vec3 worldFromDepth(vec2 fragCoord, vec2 size, float depth, mat4 inverseViewProjection) {\n" \
+    "    vec4 world = inverseViewProjection * vec4(fragCoord / size * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);\n" \
+    "    return world.xyz / world.w;\n" \
+    "}\n"
+
+// Render targets of the geometry pass, sized to the window. A scaled frame only covers their lower left corner.
+//   0: RGBA8 albedo (alpha unused)
+//   1: RG16 octahedral world-space normal
+//   depth: 32 bit float, also the source of each pixel's position
+// 12 bytes per pixel in total.
+class GBuffer {
+public:
+    static const size_t BYTES_PER_PIXEL = 4 + 4 + 4;
+
+    ~GBuffer() { reset(); }
+
+    // Allocate for this size, if it is not already. Returns true when it did; textures were bound behind the
+    // GL state cache then.
+    bool resize(int width, int height);
+    void reset();
+
+    // Bind the G-buffer as the draw target and clear it
+    void beginGeometry();
+
+    // Bind the lit frame's target (0 for the default framebuffer), with the G-buffer textures bound on the
+    // GBUFFER_*_UNIT units
+    void beginLighting(GLuint target);
+
+    // One triangle covering the viewport, positions come from gl_VertexID
+    void drawFullScreen();
+
+    int width() const { return bufferWidth; }
+    int height() const { return bufferHeight; }
+
+private:
+    GpuTexture albedo;
+    GpuTexture normal;
+    GpuTexture depth;
+    GpuVertexArray fullScreen;  // no attributes, core profile still needs one bound to draw
+    GLuint framebuffer = 0;
+    int bufferWidth = 0;
+    int bufferHeight = 0;
+};
+
+#endif
+//END
@@ -0,0 +1,297 @@
+
+//Dynamic Resolution - GPU frame timer, render scale controller and the scaled offscreen target
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#include "DynamicResolution.h"
+#include "GLStateCache.h"
+
+using namespace std; // standard namespace
+
+namespace {
+
+    const double SMOOTHING = 0.2;           // weight of each new frame in the smoothed GPU time
+    const double DOWN_TARGET = 0.95;        // a scale down aims for this share of the budget
+    const double UP_THRESHOLD = 0.75;       // frames under this share of the budget count towards a scale up
+    const int UP_FRAMES = 30;               // consecutive such frames before stepping up
+    const int COOLDOWN_FRAMES = 8;          // frames ignored after a change, covers the queries still in flight
+
+    // Nearest whole step, so repeated steps do not drift off the grid
+    float USnapScale(float scale) {
+        return roundf(scale / RENDER_SCALE_STEP) * RENDER_SCALE_STEP;
+    }
+}
+
+const char* UUpscaleFilterName(UpscaleFilter filter)
+{
+    switch (filter) {
+    case UpscaleFilter::Bilinear: return "bilinear";
+    case UpscaleFilter::Sharpen:  return "sharpen";
+    }
+    return "unknown";
+}
+
+bool UParseUpscaleFilter(const char* name, UpscaleFilter& filter)
+{
+    if (strcmp(name, "bilinear") == 0)
+        filter = UpscaleFilter::Bilinear;
+    else if (strcmp(name, "sharpen") == 0)
+        filter = UpscaleFilter::Sharpen;
+    else
+        return false;
+    return true;
+}
+
+int UScaledSize(int size, float scale)
+{
+    return max((int)lround(size * scale), 1);
+}
+
+void GpuFrameTimer::begin(uint64_t frame)
+{
+    GLuint& query = queries[next];
+    if (issued[next]) {
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            collect(next);
+        } else {
+            // The GPU is a whole ring behind. A fresh query keeps the driver from waiting on the old result.
+            glDeleteQueries(1, &query);
+            query = 0;
+            issued[next] = false;
+            ++droppedFrames;
+        }
+    }
+    if (query == 0)
+        glGenQueries(1, &query);
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    frames[next] = frame;
+    timing = true;
+}
+
+void GpuFrameTimer::end()
+{
+    if (!timing)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    issued[next] = true;
+    next = (next + 1) % QUERY_COUNT;
+    timing = false;
+}
+
+bool GpuFrameTimer::read(double& milliseconds, uint64_t& frame)
+{
+    for (unsigned i = 0; i < QUERY_COUNT; ++i) {
+        unsigned slot = (next + i) % QUERY_COUNT; // next is the oldest
+        if (!issued[slot])
+            continue;
+
+        GLint available = 0;
+        glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break; // Later frames can not have finished either
+        collect(slot);
+    }
+
+    if (finished.empty())
+        return false;
+    milliseconds = finished.front().milliseconds;
+    frame = finished.front().frame;
+    finished.pop_front();
+    return true;
+}
+
+void GpuFrameTimer::finish()
+{
+    for (unsigned i = 0; i < QUERY_COUNT; ++i) {
+        unsigned slot = (next + i) % QUERY_COUNT;
+        if (issued[slot])
+            collect(slot);
+    }
+}
+
+void GpuFrameTimer::collect(unsigned slot)
+{
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed); // Waits if the frame is still running
+    issued[slot] = false;
+    Result result = { elapsed / 1e6, frames[slot] };
+    finished.push_back(result);
+}
+
+void GpuFrameTimer::reset()
+{
+    for (unsigned i = 0; i < QUERY_COUNT; ++i) {
+        if (queries[i] != 0)
+            glDeleteQueries(1, &queries[i]);
+        queries[i] = 0;
+        issued[i] = false;
+    }
+    finished.clear();
+    next = 0;
+    timing = false;
+}
+
+void ResolutionController::setBudget(double milliseconds)
+{
+    budgetMs = milliseconds > 0.0 ? milliseconds : 0.0;
+    if (budgetMs == 0.0)
+        reset();
+}
+
+void ResolutionController::reset()
+{
+    if (currentScale != MAX_RENDER_SCALE)
+        ++scaleChanges;
+    currentScale = MAX_RENDER_SCALE;
+    smoothedMs = 0.0;
+    hasSample = false;
+    framesUnder = 0;
+    cooldown = 0;
+}
+
+bool ResolutionController::update(double gpuMilliseconds)
+{
+    if (budgetMs == 0.0)
+        return false;
+
+    // Frames still timed at the previous scale
+    if (cooldown > 0) {
+        --cooldown;
+        return false;
+    }
+
+    smoothedMs = hasSample ? smoothedMs + (gpuMilliseconds - smoothedMs) * SMOOTHING : gpuMilliseconds;
+    hasSample = true;
+
+    // Over budget: GPU time follows the pixel count, the square of the scale, so go straight to the scale that fits
+    if (smoothedMs > budgetMs) {
+        float fitted = currentScale * (float)sqrt(budgetMs * DOWN_TARGET / smoothedMs);
+        fitted = min(floorf(fitted / RENDER_SCALE_STEP + 1e-3f) * RENDER_SCALE_STEP, currentScale - RENDER_SCALE_STEP);
+        return setScale(fitted);
+    }
+
+    if (smoothedMs >= budgetMs * UP_THRESHOLD || currentScale >= MAX_RENDER_SCALE) {
+        framesUnder = 0;
+        return false;
+    }
+
+    // Well under budget for long enough: one step up, if the larger frame is predicted to still fit
+    if (++framesUnder < UP_FRAMES)
+        return false;
+    framesUnder = 0;
+    float larger = currentScale + RENDER_SCALE_STEP;
+    double predicted = smoothedMs * (larger / currentScale) * (larger / currentScale);
+    if (predicted > budgetMs * DOWN_TARGET)
+        return false;
+    return setScale(larger);
+}
+
+bool ResolutionController::setScale(float scale)
+{
+    scale = min(max(USnapScale(scale), MIN_RENDER_SCALE), MAX_RENDER_SCALE);
+    if (fabs(scale - currentScale) < RENDER_SCALE_STEP * 0.5f)
+        return false;
+
+    currentScale = scale;
+    ++scaleChanges;
+    hasSample = false;
+    framesUnder = 0;
+    cooldown = COOLDOWN_FRAMES;
+    return true;
+}
+
+void ResolutionController::printStats(ostream& out, int fullWidth, int fullHeight) const
+{
+    out << "===== Dynamic Resolution =====\n"
+        << "Scale: " << fixed << setprecision(2) << currentScale << " (" << UScaledSize(fullWidth, currentScale) << "x"
+        << UScaledSize(fullHeight, currentScale) << " of " << fullWidth << "x" << fullHeight << ")\n"
+        << "GPU frame: " << setprecision(3) << smoothedMs << " ms of a " << budgetMs << " ms budget, "
+        << scaleChanges << " scale changes" << endl;
+    out << defaultfloat;
+}
+
+bool ScaledRenderTarget::resize(int width, int height)
+{
+    width = width > 0 ? width : 1;
+    height = height > 0 ? height : 1;
+    if (framebuffer != 0 && width == fullWidth && height == fullHeight)
+        return false;
+
+    reset();
+
+    // Colour is filtered by the upscale, depth only serves the scene's own depth test
+    color.create("Scaled scene colour");
+    glBindTexture(GL_TEXTURE_2D, color);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    color.setSize((size_t)width * height * 4);
+
+    depth.create("Scaled scene depth");
+    glBindTexture(GL_TEXTURE_2D, depth);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    depth.setSize((size_t)width * height * 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        cout << "ERROR::SCALED_TARGET::INCOMPLETE at " << width << "x" << height << endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    fullScreen.create("Upscale triangle VAO");
+    fullWidth = scaledWidth = width;
+    fullHeight = scaledHeight = height;
+    return true;
+}
+
+void ScaledRenderTarget::reset()
+{
+    if (framebuffer != 0) {
+        glDeleteFramebuffers(1, &framebuffer);
+        framebuffer = 0;
+    }
+    color.reset();
+    depth.reset();
+    fullScreen.reset();
+    fullWidth = fullHeight = 0;
+    scaledWidth = scaledHeight = 0;
+}
+
+void ScaledRenderTarget::setScale(float scale)
+{
+    scaledWidth = min(UScaledSize(fullWidth, scale), fullWidth);
+    scaledHeight = min(UScaledSize(fullHeight, scale), fullHeight);
+}
+
+void ScaledRenderTarget::beginUpscale(GLuint output)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, output);
+
+    GLStateCache& state = UGLState();
+    state.viewport(0, 0, fullWidth, fullHeight);
+    state.disable(GL_DEPTH_TEST);
+    state.activeTexture(GL_TEXTURE0);
+    state.bindTexture(GL_TEXTURE_2D, color);
+}
+
+void ScaledRenderTarget::drawFullScreen()
+{
+    UGLState().bindVertexArray(fullScreen);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+// END
@@ -0,0 +1,148 @@
+#pragma once
+
+//Dynamic Resolution Header - GPU frame timing, the render scale controller and the offscreen target it scales
+
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <cstdint>
+#include <deque>
+#include <ostream>
+
+#include <GL/glew.h>        // GLEW library
+
+#include "GpuResources.h"
+
+// How the scaled frame is stretched back over the window
+enum class UpscaleFilter {
+    Bilinear,   // one filtered tap per pixel
+    Sharpen     // bilinear plus an unsharp mask, clamped to the neighbourhood so edges do not ring
+};
+
+const char* UUpscaleFilterName(UpscaleFilter filter);
+bool UParseUpscaleFilter(const char* name, UpscaleFilter& filter);     // "bilinear" or "sharpen"
+
+// Weight of the unsharp mask in the sharpened filter
+const float UPSCALE_SHARPNESS = 0.5f;
+
+// Range of the render scale, applied to width and height alike
+const float MIN_RENDER_SCALE = 0.5f;
+const float MAX_RENDER_SCALE = 1.0f;
+const float RENDER_SCALE_STEP = 0.05f;
+
+// Pixels covered by one side of the frame at this scale, never less than one
+int UScaledSize(int size, float scale);
+
+// GPU time of whole frames, each tagged with its frame number. Results are read a few frames late and never
+// waited for while frames are running: when a slot comes round again before its frame finished, begin() drops
+// that frame's timing rather than stall the render thread on it.
+class GpuFrameTimer {
+public:
+    ~GpuFrameTimer() { reset(); }
+
+    void begin(uint64_t frame);
+    void end();
+
+    // The oldest finished frame not read yet. Returns false when no more have finished.
+    bool read(double& milliseconds, uint64_t& frame);
+
+    // Wait for every frame still in flight, so read() returns the rest (end of a benchmark run)
+    void finish();
+
+    void reset();
+
+    // Frames whose timing was dropped because the GPU was a whole ring behind
+    uint64_t dropped() const { return droppedFrames; }
+
+private:
+    static const unsigned QUERY_COUNT = 3;
+
+    struct Result {
+        double milliseconds;
+        uint64_t frame;
+    };
+
+    void collect(unsigned slot);
+
+    GLuint queries[QUERY_COUNT] = {};
+    uint64_t frames[QUERY_COUNT] = {};
+    bool issued[QUERY_COUNT] = {};
+    unsigned next = 0;
+    bool timing = false;
+    uint64_t droppedFrames = 0;
+    std::deque<Result> finished;
+};
+
+// Picks the render scale from measured GPU time. Over budget it drops straight to the scale the smoothed time
+// predicts will fit; it only steps back up after a long run of frames well under budget, one step at a time,
+// and waits a few frames after every change for the new scale's timings to arrive. The gap between the two
+// thresholds is wider than one step, so a scale up can not push the next frames over budget again.
+class ResolutionController {
+public:
+    // Milliseconds the GPU may spend on a frame, 0 renders at full resolution
+    void setBudget(double milliseconds);
+    double budget() const { return budgetMs; }
+
+    // Feed one frame's GPU time. Returns true when the scale changed.
+    bool update(double gpuMilliseconds);
+
+    // Back to full resolution, forgetting the timings so far
+    void reset();
+
+    float scale() const { return currentScale; }
+    double smoothedMilliseconds() const { return smoothedMs; }
+    uint64_t changes() const { return scaleChanges; }
+
+    void printStats(std::ostream& out, int fullWidth, int fullHeight) const;
+
+private:
+    bool setScale(float scale);
+
+    double budgetMs = 0.0;
+    double smoothedMs = 0.0;
+    bool hasSample = false;
+    float currentScale = MAX_RENDER_SCALE;
+    int framesUnder = 0;    // consecutive frames under the scale up threshold
+    int cooldown = 0;       // frames still ignored after a change
+    uint64_t scaleChanges = 0;
+};
+
+// Offscreen colour and depth target allocated at the window size. Scaled frames render into its lower left
+// corner, so a new scale is only a new viewport; the textures are reallocated when the window is resized.
+class ScaledRenderTarget {
+public:
+    ~ScaledRenderTarget() { reset(); }
+
+    // Allocate for this window size, if it is not already. Returns true when it did; textures were bound behind
+    // the GL state cache then.
+    bool resize(int width, int height);
+    void reset();
+
+    // Render size for this scale, clamped to the allocated size
+    void setScale(float scale);
+
+    // Output framebuffer at the full size, depth test off, the scene colour bound on texture unit 0
+    void beginUpscale(GLuint output);
+
+    // One triangle covering the viewport, positions come from gl_VertexID
+    void drawFullScreen();
+
+    GLuint target() const { return framebuffer; }
+    int width() const { return fullWidth; }
+    int height() const { return fullHeight; }
+    int renderWidth() const { return scaledWidth; }
+    int renderHeight() const { return scaledHeight; }
+
+private:
+    GpuTexture color;
+    GpuTexture depth;
+    GpuVertexArray fullScreen;  // no attributes, core profile still needs one bound to draw
+    GLuint framebuffer = 0;
+    int fullWidth = 0;
+    int fullHeight = 0;
+    int scaledWidth = 0;
+    int scaledHeight = 0;
+};
+
+#endif
+//END
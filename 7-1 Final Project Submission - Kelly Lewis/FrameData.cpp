@@ -0,0 +1,28 @@
+
+//Frame Data - per-frame uniform buffer shared by the object and lamp shaders
+
+#include "FrameData.h"
+#include "GLStateCache.h"
+
+void FrameUniformBuffer::create()
+{
+    buffer.create("FrameData UBO");
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    UBufferData(buffer, GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, buffer);
+}
+
+void FrameUniformBuffer::reset()
+{
+    buffer.reset();
+}
+
+void FrameUniformBuffer::update(const FrameData& frame)
+{
+    UGLState().bindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &frame);
+}
+
+// END
@@ -0,0 +1,57 @@
+#pragma once
+
+//Frame Data Header - per-frame camera, light cluster and shadow uniforms shared by every shader through one UBO
+
+#ifndef FRAME_DATA_H
+#define FRAME_DATA_H
+
+#include <GL/glew.h>        // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "GpuResources.h"
+
+// Uniform buffer binding point reserved for FrameData. Programs are pointed at it after linking.
+const GLuint FRAME_DATA_BINDING = 0;
+
+// CPU mirror of the std140 "FrameData" uniform block. vec3 values are padded to vec4, matching std140 alignment.
+struct FrameData {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 viewPosition;
+    glm::vec4 clusterScale;   // xy: light clusters per pixel, z, w: log view depth to depth slice scale and bias
+    glm::uvec4 clusterGrid;   // xyz: light clusters along each axis, w: lights in the light list
+    glm::mat4 shadowMatrix;   // world to shadow map texture coordinates and depth
+    glm::vec4 shadowParams;   // x: 1 when the map is in use, y: receiver normal offset, z: light list index of the shadowed light
+};
+
+static_assert(sizeof(FrameData) == 3 * 64 + 4 * 16, "FrameData must match the std140 layout of the GLSL block");
+
+// GLSL declaration of the block, pasted into each shader that reads per-frame data
+#define FRAME_DATA_BLOCK \
+    "layout(std140) uniform FrameData {\n" \
+    "    mat4 view;\n" \
+    "    mat4 projection;\n" \
+    "    vec4 viewPosition;\n" \
+    "    vec4 clusterScale;\n" \
+    "    uvec4 clusterGrid;\n" \
+    "    mat4 shadowMatrix;\n" \
+    "    vec4 shadowParams;\n" \
+    "};\n"
+
+// Owns the UBO, which stays bound to FRAME_DATA_BINDING for its whole lifetime
+class FrameUniformBuffer {
+public:
+    void create();
+    void reset();
+
+    // Uploads the whole block, once per frame
+    void update(const FrameData& frame);
+
+private:
+    GpuBuffer buffer;
+};
+
+#endif
+//END
@@ -0,0 +1,288 @@
+
+//Frame Pacing - swap intervals, the frame limiter and jitter statistics
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <timeapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "winmm.lib")
+#endif
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include <GLFW/glfw3.h>     // GLFW library
+
+#include "FramePacing.h"
+
+using namespace std; // standard namespace
+
+namespace {
+
+    // Bounds on the spin before a deadline. The lower one covers scheduler wake-up, the upper one keeps a
+    // single bad oversleep from spinning away most of a frame.
+    const chrono::microseconds MIN_SPIN_MARGIN(200);
+    const chrono::microseconds MAX_SPIN_MARGIN(4000);
+    const chrono::microseconds SPIN_MARGIN_DECAY(10);   // per frame, so the margin relaxes after a spike
+
+    // Nearest-rank percentile of sorted samples
+    double UPercentile(const vector<double>& sorted, double percent) {
+        size_t rank = (size_t)ceil(percent / 100.0 * sorted.size());
+        return sorted[min(max(rank, (size_t)1), sorted.size()) - 1];
+    }
+
+    void UWriteCell(ostream& out, double milliseconds) {
+        out << ',';
+        if (milliseconds >= 0.0)
+            out << milliseconds;
+    }
+
+}
+
+const char* UPresentModeName(PresentMode mode)
+{
+    switch (mode) {
+    case PresentMode::Immediate: return "vsync off";
+    case PresentMode::Vsync:     return "vsync on";
+    case PresentMode::Adaptive:  return "adaptive vsync";
+    }
+    return "unknown";
+}
+
+bool UParsePresentMode(const char* name, PresentMode& mode)
+{
+    if (strcmp(name, "off") == 0)
+        mode = PresentMode::Immediate;
+    else if (strcmp(name, "on") == 0)
+        mode = PresentMode::Vsync;
+    else if (strcmp(name, "adaptive") == 0)
+        mode = PresentMode::Adaptive;
+    else
+        return false;
+    return true;
+}
+
+int USwapInterval(PresentMode mode)
+{
+    switch (mode) {
+    case PresentMode::Immediate:
+        return 0;
+    case PresentMode::Adaptive:
+        if (glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+            return -1;
+        return 1;
+    default:
+        return 1;
+    }
+}
+
+FrameLimiter::FrameLimiter()
+    : fps(0.0), period(0), deadline(Clock::now()), spinMargin(MIN_SPIN_MARGIN * 5)
+{
+#ifdef _WIN32
+    timeBeginPeriod(1); // 1 ms sleep granularity instead of the default 15.6 ms
+#endif
+}
+
+FrameLimiter::~FrameLimiter()
+{
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
+
+void FrameLimiter::setTargetFps(double target)
+{
+    fps = target > 0.0 ? target : 0.0;
+    period = fps > 0.0 ? chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / fps)) : Clock::duration(0);
+    deadline = Clock::now() + period;
+}
+
+void FrameLimiter::wait()
+{
+    if (fps <= 0.0)
+        return;
+
+    Clock::time_point now = Clock::now();
+    if (now > deadline + period) {
+        deadline = now + period; // Too far behind to catch up, start over
+        return;
+    }
+
+    // Coarse part: sleep, then remember how late the OS woke us
+    Clock::time_point sleepUntil = deadline - spinMargin;
+    if (now < sleepUntil) {
+        this_thread::sleep_until(sleepUntil);
+        Clock::duration oversleep = Clock::now() - sleepUntil;
+        spinMargin = max(spinMargin - SPIN_MARGIN_DECAY, oversleep + oversleep / 4);
+        spinMargin = min(max(spinMargin, Clock::duration(MIN_SPIN_MARGIN)), Clock::duration(MAX_SPIN_MARGIN));
+    }
+
+    // Fine part: spin out the remainder
+    while (Clock::now() < deadline)
+        this_thread::yield();
+
+    deadline += period;
+}
+
+FrameTimeStats::FrameTimeStats(size_t window)
+    : samples(window > 0 ? window : 1, 0.0), next(0), filled(0), marked(false)
+{
+}
+
+double FrameTimeStats::mark()
+{
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    double interval = -1.0;
+    if (marked) {
+        interval = chrono::duration<double, milli>(now - lastMark).count();
+        samples[next] = interval;
+        next = (next + 1) % samples.size();
+        filled = min(filled + 1, samples.size());
+    }
+    lastMark = now;
+    marked = true;
+    return interval;
+}
+
+void FrameTimeStats::reset()
+{
+    next = 0;
+    filled = 0;
+    marked = false;
+}
+
+void FrameTimeStats::printStats(ostream& out) const
+{
+    out << "===== Frame Pacing =====\n";
+    if (filled == 0) {
+        out << "No frames measured" << endl;
+        return;
+    }
+
+    vector<double> sorted(samples.begin(), samples.begin() + filled);
+    sort(sorted.begin(), sorted.end());
+
+    double sum = 0.0;
+    for (double sample : sorted)
+        sum += sample;
+    double mean = sum / filled;
+
+    double variance = 0.0;
+    for (double sample : sorted)
+        variance += (sample - mean) * (sample - mean);
+    double jitter = sqrt(variance / filled);
+
+    size_t hitches = 0; // frames that took half again as long as usual
+    for (double sample : sorted)
+        hitches += sample > mean * 1.5 ? 1 : 0;
+
+    out << fixed << setprecision(2)
+        << "Frames: " << filled << ", mean " << mean << " ms (" << 1000.0 / mean << " fps)\n"
+        << "Jitter (std dev): " << jitter << " ms, min " << sorted.front() << " ms, max " << sorted.back() << " ms\n"
+        << "99th percentile: " << UPercentile(sorted, 99.0) << " ms, hitches: " << hitches << endl;
+}
+
+void FrameTimingLog::start(size_t count, size_t warmup)
+{
+    frames.assign(count, FrameTiming());
+    warmupFrames = warmup;
+}
+
+void FrameTimingLog::setCpu(uint64_t frame, double milliseconds)
+{
+    if (frame < frames.size())
+        frames[frame].cpuMs = milliseconds;
+}
+
+void FrameTimingLog::setRender(uint64_t frame, double milliseconds)
+{
+    if (frame < frames.size())
+        frames[frame].renderMs = milliseconds;
+}
+
+void FrameTimingLog::setGpu(uint64_t frame, double milliseconds)
+{
+    if (frame < frames.size())
+        frames[frame].gpuMs = milliseconds;
+}
+
+void FrameTimingLog::setFrame(uint64_t frame, double milliseconds)
+{
+    if (frame < frames.size())
+        frames[frame].frameMs = milliseconds;
+}
+
+bool FrameTimingLog::writeCsv(const string& path) const
+{
+    ofstream file(path);
+    if (!file) {
+        cout << "ERROR::TIMING_LOG::OPEN_FAILED " << path << endl;
+        return false;
+    }
+
+    file << "frame,cpu_ms,render_ms,gpu_ms,frame_ms\n" << fixed << setprecision(4);
+    for (size_t i = 0; i < frames.size(); ++i) {
+        file << i;
+        UWriteCell(file, frames[i].cpuMs);
+        UWriteCell(file, frames[i].renderMs);
+        UWriteCell(file, frames[i].gpuMs);
+        UWriteCell(file, frames[i].frameMs);
+        file << '\n';
+    }
+
+    if (!file) {
+        cout << "ERROR::TIMING_LOG::WRITE_FAILED " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+void FrameTimingLog::printSummary(ostream& out) const
+{
+    struct Column {
+        const char* name;
+        double FrameTiming::* field;
+    };
+    const Column columns[] = {
+        { "Frame", &FrameTiming::frameMs },
+        { "CPU", &FrameTiming::cpuMs },
+        { "Render", &FrameTiming::renderMs },
+        { "GPU", &FrameTiming::gpuMs },
+    };
+
+    out << "===== Frame Timings =====\n";
+    if (warmupFrames > 0)
+        out << "Warm-up frames left out: " << warmupFrames << "\n";
+    out << setw(10) << "ms" << setw(10) << "Frames" << setw(12) << "p50" << setw(12) << "p95"
+        << setw(12) << "p99" << setw(12) << "max" << "\n" << fixed << setprecision(3);
+
+    vector<double> sorted;
+    for (const Column& column : columns) {
+        sorted.clear();
+        for (size_t i = warmupFrames; i < frames.size(); ++i) {
+            if (frames[i].*column.field >= 0.0)
+                sorted.push_back(frames[i].*column.field);
+        }
+        out << setw(10) << column.name << setw(10) << sorted.size();
+        if (sorted.empty()) {
+            out << "\n";
+            continue;
+        }
+
+        sort(sorted.begin(), sorted.end());
+        out << setw(12) << UPercentile(sorted, 50.0) << setw(12) << UPercentile(sorted, 95.0)
+            << setw(12) << UPercentile(sorted, 99.0) << setw(12) << sorted.back() << "\n";
+    }
+    out << defaultfloat << flush;
+}
+
+// END
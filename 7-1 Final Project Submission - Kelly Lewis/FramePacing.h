@@ -0,0 +1,109 @@
+#pragma once
+
+//Frame Pacing Header - presentation modes, a sleep-then-spin frame limiter and frame time statistics
+
+#ifndef FRAME_PACING_H
+#define FRAME_PACING_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// How buffer swaps wait for the display
+enum class PresentMode {
+    Immediate,  // never wait, may tear
+    Vsync,      // wait for the next refresh
+    Adaptive    // wait, unless the frame already missed its refresh (tears instead of dropping to half rate)
+};
+
+const char* UPresentModeName(PresentMode mode);
+bool UParsePresentMode(const char* name, PresentMode& mode);   // "off", "on" or "adaptive"
+
+// glfwSwapInterval argument for a mode. Adaptive needs the swap_control_tear extension and falls back to
+// plain vsync without it. Needs a current context.
+int USwapInterval(PresentMode mode);
+
+// Holds the frame rate at a target by sleeping until shortly before each deadline and spinning the rest.
+// The spin margin follows the worst oversleep seen, so coarse OS timers cost a little CPU, not missed frames.
+class FrameLimiter {
+public:
+    FrameLimiter();
+    ~FrameLimiter();
+
+    // 0 disables the limiter
+    void setTargetFps(double fps);
+    double targetFps() const { return fps; }
+
+    // Block until this frame's deadline. Deadlines advance by whole periods, so one late frame does not push
+    // back the rest; after a stall of more than a period the schedule restarts from now.
+    void wait();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    double fps;
+    Clock::duration period;
+    Clock::time_point deadline;
+    Clock::duration spinMargin;
+};
+
+// Rolling window of frame intervals, measured between consecutive mark() calls
+class FrameTimeStats {
+public:
+    explicit FrameTimeStats(size_t window = 600);
+
+    // Returns the interval just recorded, -1 for the first mark
+    double mark();
+    // Forget the last mark, so the next mark() starts a new interval instead of recording one. Samples are kept.
+    void restart() { marked = false; }
+    void reset();
+
+    size_t count() const { return filled; }
+    void printStats(std::ostream& out) const;
+
+private:
+    std::vector<double> samples;    // milliseconds, oldest overwritten first
+    size_t next;
+    size_t filled;
+    std::chrono::steady_clock::time_point lastMark;
+    bool marked;
+};
+
+// One frame's timings in milliseconds, -1 where nothing was measured
+struct FrameTiming {
+    double cpuMs = -1.0;        // main thread: simulation, culling and the frame packet
+    double renderMs = -1.0;     // render thread: GL submission, up to the present
+    double gpuMs = -1.0;        // GPU time between the frame's first and last command
+    double frameMs = -1.0;      // present to present
+};
+
+// Timings of a run of numbered frames, for benchmarks that know their frame count up front. Entries are
+// allocated by start(), so the main and render threads can each fill in their own columns while it runs.
+class FrameTimingLog {
+public:
+    // Forget earlier frames and make room for this many. The first warmup frames are logged but left out of the
+    // summary; they pay for shader compiles and first use allocations.
+    void start(size_t frames, size_t warmup = 0);
+    bool active() const { return !frames.empty(); }
+
+    // Frames outside the started range are ignored
+    void setCpu(uint64_t frame, double milliseconds);
+    void setRender(uint64_t frame, double milliseconds);
+    void setGpu(uint64_t frame, double milliseconds);
+    void setFrame(uint64_t frame, double milliseconds);
+
+    // One row per frame: frame,cpu_ms,render_ms,gpu_ms,frame_ms; unmeasured cells are left empty
+    bool writeCsv(const std::string& path) const;
+
+    // p50, p95, p99 and max of each column
+    void printSummary(std::ostream& out) const;
+
+private:
+    std::vector<FrameTiming> frames;
+    size_t warmupFrames = 0;
+};
+
+#endif
+//END
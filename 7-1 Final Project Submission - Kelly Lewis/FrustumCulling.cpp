@@ -0,0 +1,281 @@
+
+//Frustum Culling - plane extraction, box transformation and the scalar / AVX2 cull kernels
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <random>
+
+#include <glm/gtx/transform.hpp>
+
+#include "FrustumCulling.h"
+
+using namespace std; // standard namespace
+
+// GCC and Clang only emit AVX2 for functions that ask for it; MSVC emits intrinsics as written
+#if defined(__GNUC__) || defined(__clang__)
+#define CULL_AVX2_TARGET __attribute__((target("avx2,fma")))
+#else
+#define CULL_AVX2_TARGET
+#endif
+
+namespace {
+
+    inline int UCountTrailingZeros(uint32_t value) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return (int)index;
+#else
+        return __builtin_ctz(value);
+#endif
+    }
+
+    // Positive or touching every plane: distance to the center plus the box's projected radius
+    inline bool UBoxInFrustum(const Frustum& frustum, float cx, float cy, float cz, float ex, float ey, float ez) {
+        for (const glm::vec4& plane : frustum.planes) {
+            float distance = plane.x * cx + plane.y * cy + plane.z * cz + plane.w;
+            float radius = fabs(plane.x) * ex + fabs(plane.y) * ey + fabs(plane.z) * ez;
+            if (distance + radius < 0.0f)
+                return false;
+        }
+        return true;
+    }
+}
+
+Bounds UTransformBounds(const Bounds& local, const glm::mat4& model)
+{
+    // Arvo: each world extent is the local extents weighted by the absolute rotation-scale column entries
+    Bounds world;
+    world.center = glm::vec3(model * glm::vec4(local.center, 1.0f));
+    for (int row = 0; row < 3; ++row) {
+        world.extents[row] = fabs(model[0][row]) * local.extents.x +
+            fabs(model[1][row]) * local.extents.y +
+            fabs(model[2][row]) * local.extents.z;
+    }
+    return world;
+}
+
+Frustum UExtractFrustum(const glm::mat4& m)
+{
+    // Rows of the matrix (glm is column major)
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum frustum;
+    frustum.planes[0] = row3 + row0;    // Left
+    frustum.planes[1] = row3 - row0;    // Right
+    frustum.planes[2] = row3 + row1;    // Bottom
+    frustum.planes[3] = row3 - row1;    // Top
+    frustum.planes[4] = row3 + row2;    // Near
+    frustum.planes[5] = row3 - row2;    // Far
+
+    for (glm::vec4& plane : frustum.planes) {
+        float length = glm::length(glm::vec3(plane));
+        if (length > 0.0f)
+            plane = plane * (1.0f / length);
+    }
+    return frustum;
+}
+
+uint32_t BoundsTable::add(const Bounds& bounds)
+{
+    centerX.push_back(bounds.center.x);
+    centerY.push_back(bounds.center.y);
+    centerZ.push_back(bounds.center.z);
+    extentX.push_back(bounds.extents.x);
+    extentY.push_back(bounds.extents.y);
+    extentZ.push_back(bounds.extents.z);
+    return (uint32_t)size() - 1;
+}
+
+void BoundsTable::set(uint32_t index, const Bounds& bounds)
+{
+    centerX[index] = bounds.center.x;
+    centerY[index] = bounds.center.y;
+    centerZ[index] = bounds.center.z;
+    extentX[index] = bounds.extents.x;
+    extentY[index] = bounds.extents.y;
+    extentZ[index] = bounds.extents.z;
+}
+
+void BoundsTable::clear()
+{
+    centerX.clear(); centerY.clear(); centerZ.clear();
+    extentX.clear(); extentY.clear(); extentZ.clear();
+}
+
+void BoundsTable::reserve(size_t count)
+{
+    centerX.reserve(count); centerY.reserve(count); centerZ.reserve(count);
+    extentX.reserve(count); extentY.reserve(count); extentZ.reserve(count);
+}
+
+bool UCpuHasAVX2()
+{
+    static const bool hasAVX2 = []() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+
+        __cpuid(info, 1);
+        const bool fma = (info[2] & (1 << 12)) != 0;
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (!fma || !osxsave || (_xgetbv(0) & 0x6) != 0x6) // OS saves YMM registers
+            return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) || defined(__clang__)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+        return false;
+#endif
+    }();
+    return hasAVX2;
+}
+
+size_t UFrustumCullScalar(const BoundsTable& bounds, const Frustum& frustum, vector<uint32_t>& visible)
+{
+    const size_t n = bounds.size();
+    visible.resize(n);
+
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (UBoxInFrustum(frustum, bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i],
+            bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]))
+            visible[count++] = (uint32_t)i;
+    }
+
+    visible.resize(count);
+    return count;
+}
+
+CULL_AVX2_TARGET
+size_t UFrustumCullAVX2(const BoundsTable& bounds, const Frustum& frustum, vector<uint32_t>& visible)
+{
+    const size_t n = bounds.size();
+    visible.resize(n);
+
+    // Broadcast every plane and its absolute normal once
+    __m256 nx[6], ny[6], nz[6], nd[6], ax[6], ay[6], az[6];
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    for (int p = 0; p < 6; ++p) {
+        nx[p] = _mm256_set1_ps(frustum.planes[p].x);
+        ny[p] = _mm256_set1_ps(frustum.planes[p].y);
+        nz[p] = _mm256_set1_ps(frustum.planes[p].z);
+        nd[p] = _mm256_set1_ps(frustum.planes[p].w);
+        ax[p] = _mm256_andnot_ps(signMask, nx[p]);
+        ay[p] = _mm256_andnot_ps(signMask, ny[p]);
+        az[p] = _mm256_andnot_ps(signMask, nz[p]);
+    }
+    const __m256 zero = _mm256_setzero_ps();
+
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 cx = _mm256_loadu_ps(&bounds.centerX[i]);
+        const __m256 cy = _mm256_loadu_ps(&bounds.centerY[i]);
+        const __m256 cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+        const __m256 ex = _mm256_loadu_ps(&bounds.extentX[i]);
+        const __m256 ey = _mm256_loadu_ps(&bounds.extentY[i]);
+        const __m256 ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; ++p) {
+            __m256 distance = _mm256_fmadd_ps(nx[p], cx, _mm256_fmadd_ps(ny[p], cy, _mm256_fmadd_ps(nz[p], cz, nd[p])));
+            __m256 radius = _mm256_fmadd_ps(ax[p], ex, _mm256_fmadd_ps(ay[p], ey, _mm256_mul_ps(az[p], ez)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_GE_OQ));
+        }
+
+        // One bit per lane, emit the set ones in order
+        uint32_t mask = (uint32_t)_mm256_movemask_ps(inside);
+        while (mask != 0) {
+            visible[count++] = (uint32_t)(i + UCountTrailingZeros(mask));
+            mask &= mask - 1;
+        }
+    }
+
+    // Remainder that does not fill a register
+    for (; i < n; ++i) {
+        if (UBoxInFrustum(frustum, bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i],
+            bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]))
+            visible[count++] = (uint32_t)i;
+    }
+
+    visible.resize(count);
+    return count;
+}
+
+size_t UFrustumCull(const BoundsTable& bounds, const Frustum& frustum, vector<uint32_t>& visible)
+{
+    if (UCpuHasAVX2())
+        return UFrustumCullAVX2(bounds, frustum, visible);
+    return UFrustumCullScalar(bounds, frustum, visible);
+}
+
+void UBenchmarkFrustumCulling(ostream& out)
+{
+    // Camera at the origin looking down -Z, boxes scattered through a cube around it
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    const Frustum frustum = UExtractFrustum(projection * view);
+
+    const bool hasAVX2 = UCpuHasAVX2();
+    out << "===== Frustum Culling Benchmark =====\n"
+        << "AVX2: " << (hasAVX2 ? "yes" : "no") << "\n"
+        << setw(10) << "Objects" << setw(10) << "Visible" << setw(16) << "Scalar ns/obj" << setw(16) << "AVX2 ns/obj" << setw(10) << "Speedup" << "\n";
+
+    mt19937 random(330);
+    uniform_real_distribution<float> position(-120.0f, 120.0f);
+    uniform_real_distribution<float> extent(0.1f, 2.0f);
+
+    const size_t counts[] = { 1000, 10000, 100000, 1000000 };
+    for (size_t objects : counts) {
+        BoundsTable table;
+        table.reserve(objects);
+        for (size_t i = 0; i < objects; ++i) {
+            Bounds box = { glm::vec3(position(random), position(random), position(random)),
+                glm::vec3(extent(random), extent(random), extent(random)) };
+            table.add(box);
+        }
+
+        // Enough repetitions that every size does about the same total work
+        const size_t repeats = max<size_t>(1, 20000000 / objects);
+        vector<uint32_t> scalarVisible;
+        vector<uint32_t> simdVisible;
+
+        auto time = [&](size_t (*kernel)(const BoundsTable&, const Frustum&, vector<uint32_t>&), vector<uint32_t>& visible) {
+            auto start = chrono::high_resolution_clock::now();
+            for (size_t r = 0; r < repeats; ++r)
+                kernel(table, frustum, visible);
+            chrono::duration<double, nano> elapsed = chrono::high_resolution_clock::now() - start;
+            return elapsed.count() / ((double)repeats * objects);
+        };
+
+        double scalarTime = time(UFrustumCullScalar, scalarVisible);
+        double simdTime = hasAVX2 ? time(UFrustumCullAVX2, simdVisible) : 0.0;
+
+        out << setw(10) << objects << setw(10) << scalarVisible.size()
+            << setw(16) << fixed << setprecision(3) << scalarTime;
+        if (hasAVX2) {
+            out << setw(16) << simdTime << setw(9) << setprecision(2) << scalarTime / simdTime << "x";
+            if (simdVisible != scalarVisible)
+                out << "  MISMATCH";
+        }
+        out << "\n";
+    }
+    out << flush;
+}
+
+// END
@@ -0,0 +1,58 @@
+#pragma once
+
+//Frustum Culling Header - world-space bounds in structure-of-arrays form, tested 8 at a time with AVX2
+
+#ifndef FRUSTUM_CULLING_H
+#define FRUSTUM_CULLING_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+// Axis aligned box as center and half extents
+struct Bounds {
+    glm::vec3 center;
+    glm::vec3 extents;
+};
+
+// Box enclosing local bounds after transformation by model (rotation and scale included)
+Bounds UTransformBounds(const Bounds& local, const glm::mat4& model);
+
+// Six planes (a, b, c, d) with normals pointing into the frustum, normalized so d is a distance
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+// Gribb-Hartmann extraction from a combined projection * view matrix
+Frustum UExtractFrustum(const glm::mat4& viewProjection);
+
+// World-space boxes, one array per component so the kernel loads 8 objects with one instruction each
+class BoundsTable {
+public:
+    uint32_t add(const Bounds& bounds);
+    void set(uint32_t index, const Bounds& bounds);
+    void clear();
+    void reserve(size_t count);
+    size_t size() const { return centerX.size(); }
+
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+};
+
+// True when the CPU and OS support AVX2 and FMA
+bool UCpuHasAVX2();
+
+// Write the index of every box that touches the frustum into visible, in ascending order.
+// Returns the visible count. UFrustumCull picks the AVX2 kernel when the CPU has it.
+size_t UFrustumCullScalar(const BoundsTable& bounds, const Frustum& frustum, std::vector<uint32_t>& visible);
+size_t UFrustumCullAVX2(const BoundsTable& bounds, const Frustum& frustum, std::vector<uint32_t>& visible);
+size_t UFrustumCull(const BoundsTable& bounds, const Frustum& frustum, std::vector<uint32_t>& visible);
+
+// Times both kernels over 1k to 1M random boxes and checks they agree
+void UBenchmarkFrustumCulling(std::ostream& out);
+
+#endif
+//END
@@ -0,0 +1,256 @@
+
+//GL State Cache - compare against the shadow state, issue only what differs
+
+#include "GLStateCache.h"
+
+using namespace std; // standard namespace
+
+GLStateCache& UGLState()
+{
+    static GLStateCache cache;
+    return cache;
+}
+
+int GLStateCache::textureTargetIndex(GLenum target)
+{
+    switch (target) {
+    case GL_TEXTURE_2D:         return 0;
+    case GL_TEXTURE_2D_ARRAY:   return 1;
+    case GL_TEXTURE_CUBE_MAP:   return 2;
+    default:                    return -1;
+    }
+}
+
+int GLStateCache::bufferTargetIndex(GLenum target)
+{
+    switch (target) {
+    case GL_ARRAY_BUFFER:           return 0;
+    case GL_UNIFORM_BUFFER:         return 1;
+    case GL_SHADER_STORAGE_BUFFER:  return 2;
+    case GL_DRAW_INDIRECT_BUFFER:   return 3;
+    case GL_COPY_READ_BUFFER:       return 4;
+    case GL_COPY_WRITE_BUFFER:      return 5;
+    case GL_PIXEL_PACK_BUFFER:      return 6;
+    default:                        return -1;
+    }
+}
+
+int GLStateCache::capabilityIndex(GLenum capability)
+{
+    switch (capability) {
+    case GL_DEPTH_TEST:     return 0;
+    case GL_BLEND:          return 1;
+    case GL_CULL_FACE:      return 2;
+    case GL_SCISSOR_TEST:   return 3;
+    default:                return -1;
+    }
+}
+
+bool GLStateCache::useProgram(GLuint value)
+{
+    if (!count(program != value))
+        return false;
+    glUseProgram(value);
+    program = value;
+    return true;
+}
+
+bool GLStateCache::bindVertexArray(GLuint value)
+{
+    if (!count(vertexArray != value))
+        return false;
+    glBindVertexArray(value);
+    vertexArray = value;
+    return true;
+}
+
+bool GLStateCache::activeTexture(GLenum unit)
+{
+    if (!count(activeUnit != unit))
+        return false;
+    glActiveTexture(unit);
+    activeUnit = unit;
+    return true;
+}
+
+bool GLStateCache::bindTexture(GLenum target, GLuint texture)
+{
+    int unit = activeUnit != UNKNOWN ? (int)(activeUnit - GL_TEXTURE0) : -1;
+    int index = textureTargetIndex(target);
+    if (unit < 0 || unit >= TEXTURE_UNITS || index < 0) {
+        glBindTexture(target, texture);
+        return count(true);
+    }
+
+    if (!count(textures[unit][index] != texture))
+        return false;
+    glBindTexture(target, texture);
+    textures[unit][index] = texture;
+    return true;
+}
+
+bool GLStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+    int index = bufferTargetIndex(target);
+    if (index < 0) {
+        glBindBuffer(target, buffer);
+        return count(true);
+    }
+
+    if (!count(buffers[index] != buffer))
+        return false;
+    glBindBuffer(target, buffer);
+    buffers[index] = buffer;
+    return true;
+}
+
+bool GLStateCache::bindBufferBase(GLenum target, GLuint bindingIndex, GLuint buffer)
+{
+    GLuint* bases = target == GL_UNIFORM_BUFFER ? uniformBases : target == GL_SHADER_STORAGE_BUFFER ? storageBases : nullptr;
+    if (bases == nullptr || bindingIndex >= (GLuint)BUFFER_BASES) {
+        glBindBufferBase(target, bindingIndex, buffer);
+        int generic = bufferTargetIndex(target);
+        if (generic >= 0)
+            buffers[generic] = buffer; // Indexed binds also replace the generic binding
+        return count(true);
+    }
+
+    if (!count(bases[bindingIndex] != buffer))
+        return false;
+    glBindBufferBase(target, bindingIndex, buffer);
+    bases[bindingIndex] = buffer;
+    buffers[bufferTargetIndex(target)] = buffer;
+    return true;
+}
+
+bool GLStateCache::setCapability(GLenum capability, bool on)
+{
+    int index = capabilityIndex(capability);
+    if (index >= 0 && !count(capabilities[index] != (on ? 1 : 0)))
+        return false;
+    if (index < 0)
+        count(true);
+
+    if (on)
+        glEnable(capability);
+    else
+        glDisable(capability);
+    if (index >= 0)
+        capabilities[index] = on ? 1 : 0;
+    return true;
+}
+
+bool GLStateCache::enable(GLenum capability)
+{
+    return setCapability(capability, true);
+}
+
+bool GLStateCache::disable(GLenum capability)
+{
+    return setCapability(capability, false);
+}
+
+bool GLStateCache::depthFunc(GLenum func)
+{
+    if (!count(depthFunction != func))
+        return false;
+    glDepthFunc(func);
+    depthFunction = func;
+    return true;
+}
+
+bool GLStateCache::depthMask(GLboolean write)
+{
+    if (!count(depthWrite != (write ? 1 : 0)))
+        return false;
+    glDepthMask(write);
+    depthWrite = write ? 1 : 0;
+    return true;
+}
+
+bool GLStateCache::colorMask(GLboolean write)
+{
+    if (!count(colorWrite != (write ? 1 : 0)))
+        return false;
+    glColorMask(write, write, write, write);
+    colorWrite = write ? 1 : 0;
+    return true;
+}
+
+bool GLStateCache::blendFunc(GLenum source, GLenum destination)
+{
+    if (!count(blendSource != source || blendDestination != destination))
+        return false;
+    glBlendFunc(source, destination);
+    blendSource = source;
+    blendDestination = destination;
+    return true;
+}
+
+bool GLStateCache::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    bool same = viewportKnown && viewportRect[0] == x && viewportRect[1] == y && viewportRect[2] == width && viewportRect[3] == height;
+    if (!count(!same))
+        return false;
+    glViewport(x, y, width, height);
+    viewportRect[0] = x;
+    viewportRect[1] = y;
+    viewportRect[2] = width;
+    viewportRect[3] = height;
+    viewportKnown = true;
+    return true;
+}
+
+bool GLStateCache::clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+    bool same = clearColorKnown && clearRGBA[0] == r && clearRGBA[1] == g && clearRGBA[2] == b && clearRGBA[3] == a;
+    if (!count(!same))
+        return false;
+    glClearColor(r, g, b, a);
+    clearRGBA[0] = r;
+    clearRGBA[1] = g;
+    clearRGBA[2] = b;
+    clearRGBA[3] = a;
+    clearColorKnown = true;
+    return true;
+}
+
+void GLStateCache::invalidate()
+{
+    program = UNKNOWN;
+    vertexArray = UNKNOWN;
+    activeUnit = UNKNOWN;
+    for (auto& unit : textures)
+        for (GLuint& texture : unit)
+            texture = UNKNOWN;
+    for (GLuint& buffer : buffers)
+        buffer = UNKNOWN;
+    for (int i = 0; i < BUFFER_BASES; ++i)
+        uniformBases[i] = storageBases[i] = UNKNOWN;
+    for (int& capability : capabilities)
+        capability = -1;
+    depthFunction = UNKNOWN;
+    depthWrite = -1;
+    colorWrite = -1;
+    blendSource = blendDestination = UNKNOWN;
+    viewportKnown = false;
+    clearColorKnown = false;
+}
+
+void GLStateCache::beginFrame()
+{
+    lastStats = frameStats;
+    frameStats = GLStateStats();
+}
+
+void GLStateCache::printStats(ostream& out) const
+{
+    GLuint total = lastStats.issued + lastStats.elided;
+    out << "===== GL State Cache =====\n"
+        << "Calls: " << total << ", issued: " << lastStats.issued << ", elided: " << lastStats.elided;
+    if (total > 0)
+        out << " (" << lastStats.elided * 100 / total << "%)";
+    out << endl;
+}
+
+// END
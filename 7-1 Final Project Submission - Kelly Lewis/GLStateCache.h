@@ -0,0 +1,99 @@
+#pragma once
+
+//GL State Cache Header - shadow copy of the render context's bindings, redundant calls are never issued
+
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <ostream>
+
+#include <GL/glew.h>        // GLEW library
+
+// Calls made through the cache in one frame
+struct GLStateStats {
+    GLuint issued = 0;      // reached the driver
+    GLuint elided = 0;      // matched the cached state and were skipped
+};
+
+// Tracks program, vertex array, texture units, buffer bindings, capabilities, depth/color/blend state, viewport
+// and clear color. Each setter returns true if it issued a GL call. Nothing is known after construction or
+// invalidate(), so the first call of each kind always goes through.
+// Code that binds, creates or deletes objects behind the cache's back (load time uploads, rebuilds) must be
+// followed by invalidate(): a deleted name that was bound can be reused by the next object created.
+class GLStateCache {
+public:
+    static const int TEXTURE_UNITS = 8;
+    static const int BUFFER_BASES = 8;
+
+    GLStateCache() { invalidate(); }
+
+    bool useProgram(GLuint program);
+    bool bindVertexArray(GLuint vertexArray);
+
+    // Texture binds apply to the active unit. Targets other than 2D, 2D array and cube map, and units past
+    // TEXTURE_UNITS, are passed straight through.
+    bool activeTexture(GLenum unit);
+    bool bindTexture(GLenum target, GLuint texture);
+
+    // Generic and indexed buffer bindings. GL_ELEMENT_ARRAY_BUFFER belongs to the vertex array and is not cached.
+    bool bindBuffer(GLenum target, GLuint buffer);
+    bool bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+
+    // GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE and GL_SCISSOR_TEST are cached, other capabilities pass through
+    bool enable(GLenum capability);
+    bool disable(GLenum capability);
+
+    bool depthFunc(GLenum func);
+    bool depthMask(GLboolean write);
+    bool colorMask(GLboolean write);    // all four channels together
+    bool blendFunc(GLenum source, GLenum destination);
+    bool viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    bool clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+
+    // Forget everything; the next call of each kind is issued
+    void invalidate();
+
+    // Start counting a new frame; stats() then reports the one just finished
+    void beginFrame();
+    const GLStateStats& stats() const { return lastStats; }
+    void printStats(std::ostream& out) const;
+
+private:
+    static const int TEXTURE_TARGETS = 3;
+    static const int BUFFER_TARGETS = 7;
+    static const int CAPABILITIES = 4;
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;  // never a GL name
+
+    static int textureTargetIndex(GLenum target);
+    static int bufferTargetIndex(GLenum target);
+    static int capabilityIndex(GLenum capability);
+
+    bool setCapability(GLenum capability, bool on);
+    bool count(bool issue) { issue ? ++frameStats.issued : ++frameStats.elided; return issue; }
+
+    GLuint program;
+    GLuint vertexArray;
+    GLenum activeUnit;
+    GLuint textures[TEXTURE_UNITS][TEXTURE_TARGETS];
+    GLuint buffers[BUFFER_TARGETS];
+    GLuint uniformBases[BUFFER_BASES];
+    GLuint storageBases[BUFFER_BASES];
+    int capabilities[CAPABILITIES];     // -1 unknown, 0 off, 1 on
+    GLenum depthFunction;
+    int depthWrite;
+    int colorWrite;
+    GLenum blendSource, blendDestination;
+    GLint viewportRect[4];
+    bool viewportKnown;
+    GLfloat clearRGBA[4];
+    bool clearColorKnown;
+
+    GLStateStats frameStats;
+    GLStateStats lastStats;
+};
+
+// Cache for the render context. Only the thread that currently owns that context may use it.
+GLStateCache& UGLState();
+
+#endif
+//END
@@ -0,0 +1,141 @@
+
+//GPU Resource Tracker - owns GL object creation/deletion and reports VRAM usage and leaks
+
+#include <iomanip>
+
+#include "GpuResources.h"
+
+using namespace std; // standard namespace
+
+GpuResourceTracker& UGpuResources()
+{
+    static GpuResourceTracker tracker;
+    return tracker;
+}
+
+const char* UGpuResourceTypeName(GpuResourceType type)
+{
+    switch (type) {
+    case GpuResourceType::Buffer:       return "Buffers";
+    case GpuResourceType::VertexArray:  return "Vertex Arrays";
+    case GpuResourceType::Texture:      return "Textures";
+    case GpuResourceType::Program:      return "Programs";
+    default:                            return "Unknown";
+    }
+}
+
+GLuint GpuResourceTracker::create(GpuResourceType type, const char* label)
+{
+    GLuint id = 0;
+    switch (type) {
+    case GpuResourceType::Buffer:       glGenBuffers(1, &id); break;
+    case GpuResourceType::VertexArray:  glGenVertexArrays(1, &id); break;
+    case GpuResourceType::Texture:      glGenTextures(1, &id); break;
+    case GpuResourceType::Program:      id = glCreateProgram(); break;
+    default: break;
+    }
+
+    if (id != 0) {
+        lock_guard<mutex> guard(lock);
+        Entry entry = { label ? label : "", 0 };
+        live[(int)type][id] = entry;
+    }
+    return id;
+}
+
+void GpuResourceTracker::destroy(GpuResourceType type, GLuint id)
+{
+    if (id == 0)
+        return;
+
+    switch (type) {
+    case GpuResourceType::Buffer:       glDeleteBuffers(1, &id); break;
+    case GpuResourceType::VertexArray:  glDeleteVertexArrays(1, &id); break;
+    case GpuResourceType::Texture:      glDeleteTextures(1, &id); break;
+    case GpuResourceType::Program:      glDeleteProgram(id); break;
+    default: break;
+    }
+
+    lock_guard<mutex> guard(lock);
+    live[(int)type].erase(id);
+}
+
+void GpuResourceTracker::setSize(GpuResourceType type, GLuint id, size_t bytes)
+{
+    lock_guard<mutex> guard(lock);
+    auto found = live[(int)type].find(id);
+    if (found != live[(int)type].end())
+        found->second.bytes = bytes;
+}
+
+size_t GpuResourceTracker::liveCount(GpuResourceType type) const
+{
+    lock_guard<mutex> guard(lock);
+    return live[(int)type].size();
+}
+
+size_t GpuResourceTracker::liveBytes(GpuResourceType type) const
+{
+    lock_guard<mutex> guard(lock);
+    size_t bytes = 0;
+    for (const auto& entry : live[(int)type])
+        bytes += entry.second.bytes;
+    return bytes;
+}
+
+size_t GpuResourceTracker::totalBytes() const
+{
+    size_t bytes = 0;
+    for (int type = 0; type < (int)GpuResourceType::Count; ++type)
+        bytes += liveBytes((GpuResourceType)type);
+    return bytes;
+}
+
+void GpuResourceTracker::printReport(ostream& out) const
+{
+    const double MB = 1024.0 * 1024.0;
+
+    out << "===== GPU Resources =====\n";
+    for (int type = 0; type < (int)GpuResourceType::Count; ++type) {
+        GpuResourceType t = (GpuResourceType)type;
+        out << setw(14) << UGpuResourceTypeName(t) << ": "
+            << setw(5) << liveCount(t) << " live, "
+            << fixed << setprecision(2) << liveBytes(t) / MB << " MB\n";
+    }
+    out << setw(14) << "Total" << ": " << fixed << setprecision(2) << totalBytes() / MB << " MB" << endl;
+}
+
+size_t GpuResourceTracker::reportLeaks(ostream& out) const
+{
+    lock_guard<mutex> guard(lock);
+
+    size_t leaks = 0;
+    for (int type = 0; type < (int)GpuResourceType::Count; ++type) {
+        for (const auto& entry : live[type]) {
+            out << "LEAK: " << UGpuResourceTypeName((GpuResourceType)type) << " #" << entry.first
+                << " '" << entry.second.label << "' (" << entry.second.bytes << " bytes)\n";
+            ++leaks;
+        }
+    }
+
+    if (leaks == 0)
+        out << "INFO: No GPU resources leaked" << endl;
+    else
+        out << "ERROR: " << leaks << " GPU resources leaked" << endl;
+
+    return leaks;
+}
+
+void UBufferData(GpuBuffer& buffer, GLenum target, GLsizeiptr bytes, const void* data, GLenum usage)
+{
+    glBufferData(target, bytes, data, usage);
+    buffer.setSize((size_t)bytes);
+}
+
+void UBufferStorage(GpuBuffer& buffer, GLenum target, GLsizeiptr bytes, const void* data, GLbitfield flags)
+{
+    glBufferStorage(target, bytes, data, flags);
+    buffer.setSize((size_t)bytes);
+}
+
+// END
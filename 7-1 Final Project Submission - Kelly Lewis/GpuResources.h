@@ -0,0 +1,115 @@
+#pragma once
+
+//GPU Resource Header - central tracker and RAII handles for buffers, vertex arrays, textures and programs
+
+#ifndef GPU_RESOURCES_H
+#define GPU_RESOURCES_H
+
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+#include <GL/glew.h>        // GLEW library
+
+enum class GpuResourceType {
+    Buffer,
+    VertexArray,
+    Texture,
+    Program,
+    Count
+};
+
+// Records every live GL object with a label and its byte size.
+// Thread safe, the mesh loader allocates buffers from its own shared context.
+class GpuResourceTracker {
+public:
+    GLuint create(GpuResourceType type, const char* label);
+    void destroy(GpuResourceType type, GLuint id);
+    void setSize(GpuResourceType type, GLuint id, size_t bytes);
+
+    size_t liveCount(GpuResourceType type) const;
+    size_t liveBytes(GpuResourceType type) const;
+    size_t totalBytes() const;
+
+    // Live usage by category
+    void printReport(std::ostream& out) const;
+
+    // Lists every object still alive, returns how many there were
+    size_t reportLeaks(std::ostream& out) const;
+
+private:
+    struct Entry {
+        std::string label;
+        size_t bytes;
+    };
+
+    mutable std::mutex lock;
+    std::unordered_map<GLuint, Entry> live[(int)GpuResourceType::Count];
+};
+
+// Global tracker shared by all handles
+GpuResourceTracker& UGpuResources();
+
+const char* UGpuResourceTypeName(GpuResourceType type);
+
+// Move-only owner of a single GL object. Converts to GLuint so it can be passed straight to GL calls.
+template <GpuResourceType Type>
+class GpuHandle {
+public:
+    GpuHandle() : id(0) {}
+    ~GpuHandle() { reset(); }
+
+    GpuHandle(const GpuHandle&) = delete;
+    GpuHandle& operator=(const GpuHandle&) = delete;
+
+    GpuHandle(GpuHandle&& other) noexcept : id(other.id) { other.id = 0; }
+    GpuHandle& operator=(GpuHandle&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            id = other.id;
+            other.id = 0;
+        }
+        return *this;
+    }
+
+    // Creates a new object, releasing any object already held
+    GLuint create(const char* label)
+    {
+        reset();
+        id = UGpuResources().create(Type, label);
+        return id;
+    }
+
+    void reset()
+    {
+        if (id != 0) {
+            UGpuResources().destroy(Type, id);
+            id = 0;
+        }
+    }
+
+    void setSize(size_t bytes) { UGpuResources().setSize(Type, id, bytes); }
+
+    GLuint get() const { return id; }
+    operator GLuint() const { return id; }
+
+private:
+    GLuint id;
+};
+
+typedef GpuHandle<GpuResourceType::Buffer> GpuBuffer;
+typedef GpuHandle<GpuResourceType::VertexArray> GpuVertexArray;
+typedef GpuHandle<GpuResourceType::Texture> GpuTexture;
+typedef GpuHandle<GpuResourceType::Program> GpuProgram;
+
+// glBufferData on the buffer bound to target, recording the allocation size
+void UBufferData(GpuBuffer& buffer, GLenum target, GLsizeiptr bytes, const void* data, GLenum usage);
+
+// glBufferStorage (immutable storage) on the buffer bound to target, recording the allocation size
+void UBufferStorage(GpuBuffer& buffer, GLenum target, GLsizeiptr bytes, const void* data, GLbitfield flags);
+
+#endif
+//END
@@ -0,0 +1,190 @@
+
+//Headless Context - EGL context creation without a surface, and the offscreen target frames are read back from
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <cstring>
+#include <iostream>
+
+#include "HeadlessContext.h"
+
+using namespace std; // standard namespace
+
+#ifdef __linux__
+
+bool HeadlessContext::create()
+{
+    destroy();
+
+    // Mesa's surfaceless platform needs no display server; other drivers get their default display
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay != nullptr && clientExtensions != nullptr && strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (eglDisplay == EGL_NO_DISPLAY)
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major = 0, minor = 0;
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+        cout << "ERROR::HEADLESS::NO_DISPLAY EGL could not be initialized" << endl;
+        return false;
+    }
+    display = eglDisplay;
+
+    const char* extensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+    if (extensions == nullptr || !strstr(extensions, "EGL_KHR_surfaceless_context")) {
+        cout << "ERROR::HEADLESS::NO_SURFACELESS EGL " << major << "." << minor << " can not make a context current without a surface" << endl;
+        destroy();
+        return false;
+    }
+
+    // Any config that renders desktop GL; nothing is drawn to a surface, so its surface types do not matter
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, 0,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configCount) || configCount == 0) {
+        cout << "ERROR::HEADLESS::NO_CONFIG EGL has no desktop OpenGL config" << endl;
+        destroy();
+        return false;
+    }
+
+    // Same version and profile the window asks GLFW for
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 4,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    context = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT) {
+        cout << "ERROR::HEADLESS::NO_CONTEXT EGL could not create an OpenGL 4.4 core context (0x" << hex << eglGetError() << dec << ")" << endl;
+        context = nullptr;
+        destroy();
+        return false;
+    }
+
+    if (!makeCurrent()) {
+        destroy();
+        return false;
+    }
+    return true;
+}
+
+void HeadlessContext::destroy()
+{
+    if (display == nullptr)
+        return;
+
+    if (context != nullptr) {
+        eglMakeCurrent((EGLDisplay)display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext((EGLDisplay)display, (EGLContext)context);
+        context = nullptr;
+    }
+    eglTerminate((EGLDisplay)display);
+    display = nullptr;
+}
+
+bool HeadlessContext::makeCurrent()
+{
+    if (!eglMakeCurrent((EGLDisplay)display, EGL_NO_SURFACE, EGL_NO_SURFACE, (EGLContext)context)) {
+        cout << "ERROR::HEADLESS::MAKE_CURRENT failed (0x" << hex << eglGetError() << dec << ")" << endl;
+        return false;
+    }
+    return true;
+}
+
+void HeadlessContext::release()
+{
+    eglMakeCurrent((EGLDisplay)display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+#else
+
+bool HeadlessContext::create()
+{
+    cout << "ERROR::HEADLESS::UNAVAILABLE headless rendering needs EGL, only built on Linux" << endl;
+    return false;
+}
+
+void HeadlessContext::destroy()
+{
+}
+
+bool HeadlessContext::makeCurrent()
+{
+    return false;
+}
+
+void HeadlessContext::release()
+{
+}
+
+#endif
+
+void OffscreenTarget::create(int width, int height)
+{
+    reset();
+    targetWidth = width > 0 ? width : 1;
+    targetHeight = height > 0 ? height : 1;
+
+    color.create("Headless frame colour");
+    glBindTexture(GL_TEXTURE_2D, color);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, targetWidth, targetHeight);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    color.setSize((size_t)targetWidth * targetHeight * 4);
+
+    depth.create("Headless frame depth");
+    glBindTexture(GL_TEXTURE_2D, depth);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, targetWidth, targetHeight);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    depth.setSize((size_t)targetWidth * targetHeight * 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        cout << "ERROR::HEADLESS::INCOMPLETE at " << targetWidth << "x" << targetHeight << endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void OffscreenTarget::reset()
+{
+    if (framebuffer != 0) {
+        glDeleteFramebuffers(1, &framebuffer);
+        framebuffer = 0;
+    }
+    color.reset();
+    depth.reset();
+    targetWidth = targetHeight = 0;
+}
+
+void OffscreenTarget::readPixels(vector<uint8_t>& rgb) const
+{
+    const size_t rowBytes = (size_t)targetWidth * 3;
+    vector<uint8_t> flipped(rowBytes * targetHeight);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, targetWidth, targetHeight, GL_RGB, GL_UNSIGNED_BYTE, flipped.data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    // GL reads bottom row first
+    rgb.resize(flipped.size());
+    for (int y = 0; y < targetHeight; ++y)
+        memcpy(&rgb[rowBytes * y], &flipped[rowBytes * (targetHeight - 1 - y)], rowBytes);
+}
+
+// END
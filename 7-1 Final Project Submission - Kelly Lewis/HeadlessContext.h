@@ -0,0 +1,59 @@
+#pragma once
+
+//Headless Context Header - GL without a window: an EGL context with no surface and the offscreen target it draws to
+
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>        // GLEW library
+
+#include "GpuResources.h"
+
+// OpenGL 4.4 core context on EGL, preferring Mesa's surfaceless platform so it needs neither a display server nor
+// a GPU (llvmpipe renders on the CPU). It has no default framebuffer; frames go to an OffscreenTarget. Only built on
+// Linux, elsewhere create() reports that it is unavailable.
+class HeadlessContext {
+public:
+    ~HeadlessContext() { destroy(); }
+
+    // Create the context and make it current on the calling thread
+    bool create();
+    void destroy();
+
+    // Move the context between threads, like glfwMakeContextCurrent
+    bool makeCurrent();
+    void release();
+
+private:
+    void* display = nullptr;    // EGLDisplay and EGLContext, kept opaque so this header needs no EGL
+    void* context = nullptr;
+};
+
+// Colour and depth target standing in for the window's framebuffer
+class OffscreenTarget {
+public:
+    ~OffscreenTarget() { reset(); }
+
+    void create(int width, int height);
+    void reset();
+
+    // Read the colour back as 8 bit RGB, top row first, ready for UWritePng
+    void readPixels(std::vector<uint8_t>& rgb) const;
+
+    GLuint target() const { return framebuffer; }
+    int width() const { return targetWidth; }
+    int height() const { return targetHeight; }
+
+private:
+    GpuTexture color;
+    GpuTexture depth;
+    GLuint framebuffer = 0;
+    int targetWidth = 0;
+    int targetHeight = 0;
+};
+
+#endif
+//END
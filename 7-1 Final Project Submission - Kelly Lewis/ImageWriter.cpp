@@ -0,0 +1,124 @@
+
+//Image Writer - PNG chunks around stored (uncompressed) deflate blocks
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include "ImageWriter.h"
+
+using namespace std; // standard namespace
+
+namespace {
+
+    const size_t MAX_STORED_BLOCK = 65535;  // deflate stored blocks carry at most this many bytes
+
+    // CRC-32 as PNG uses it (reflected, polynomial 0xEDB88320), table built on first use
+    uint32_t UCrc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+        static const vector<uint32_t> table = []() {
+            vector<uint32_t> entries(256);
+            for (uint32_t n = 0; n < 256; ++n) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k)
+                    c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                entries[n] = c;
+            }
+            return entries;
+        }();
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i)
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    void UPutBigEndian(vector<uint8_t>& out, uint32_t value) {
+        out.push_back((uint8_t)(value >> 24));
+        out.push_back((uint8_t)(value >> 16));
+        out.push_back((uint8_t)(value >> 8));
+        out.push_back((uint8_t)value);
+    }
+
+    // Length, type, data, then the CRC of type and data
+    void UWriteChunk(ostream& file, const char type[4], const vector<uint8_t>& data) {
+        vector<uint8_t> chunk;
+        chunk.reserve(data.size() + 12);
+        UPutBigEndian(chunk, (uint32_t)data.size());
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        UPutBigEndian(chunk, UCrc32(chunk.data() + 4, chunk.size() - 4));
+        file.write((const char*)chunk.data(), chunk.size());
+    }
+}
+
+bool UWritePng(const string& path, int width, int height, const vector<uint8_t>& rgb)
+{
+    const size_t rowBytes = (size_t)width * 3;
+    if (width <= 0 || height <= 0 || rgb.size() < rowBytes * height) {
+        cout << "ERROR::PNG::BAD_IMAGE " << width << "x" << height << " for " << path << endl;
+        return false;
+    }
+
+    ofstream file(path, ios::binary);
+    if (!file) {
+        cout << "ERROR::PNG::OPEN_FAILED " << path << endl;
+        return false;
+    }
+
+    // Scanlines, each behind a filter type byte of 0 (none)
+    vector<uint8_t> raw;
+    raw.reserve((rowBytes + 1) * height);
+    for (int y = 0; y < height; ++y) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb.begin() + rowBytes * y, rgb.begin() + rowBytes * (y + 1));
+    }
+
+    // zlib stream: header, stored blocks, Adler-32 of the raw bytes
+    vector<uint8_t> compressed;
+    compressed.reserve(raw.size() + raw.size() / MAX_STORED_BLOCK * 5 + 16);
+    compressed.push_back(0x78);
+    compressed.push_back(0x01);
+    size_t offset = 0;
+    do {
+        size_t size = min(raw.size() - offset, MAX_STORED_BLOCK);
+        bool last = offset + size == raw.size();
+        compressed.push_back(last ? 1 : 0);
+        compressed.push_back((uint8_t)size);
+        compressed.push_back((uint8_t)(size >> 8));
+        compressed.push_back((uint8_t)~size);
+        compressed.push_back((uint8_t)(~size >> 8));
+        compressed.insert(compressed.end(), raw.begin() + offset, raw.begin() + offset + size);
+        offset += size;
+    } while (offset < raw.size());
+
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    UPutBigEndian(compressed, (b << 16) | a);
+
+    // 8 bit truecolour, no interlacing
+    vector<uint8_t> header;
+    UPutBigEndian(header, (uint32_t)width);
+    UPutBigEndian(header, (uint32_t)height);
+    header.push_back(8);
+    header.push_back(2);
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+
+    static const uint8_t SIGNATURE[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    file.write((const char*)SIGNATURE, sizeof(SIGNATURE));
+    UWriteChunk(file, "IHDR", header);
+    UWriteChunk(file, "IDAT", compressed);
+    UWriteChunk(file, "IEND", vector<uint8_t>());
+
+    if (!file) {
+        cout << "ERROR::PNG::WRITE_FAILED " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+// END
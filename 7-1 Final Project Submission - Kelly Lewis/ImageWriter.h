@@ -0,0 +1,18 @@
+#pragma once
+
+//Image Writer Header - PNG output for captured frames, no compression library needed
+
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Write 8 bit RGB pixels, top row first, as a PNG. The image data is stored in uncompressed deflate blocks:
+// larger files, but byte-identical output for identical pixels and nothing to link. Returns false if the file
+// could not be written.
+bool UWritePng(const std::string& path, int width, int height, const std::vector<uint8_t>& rgb);
+
+#endif
+//END
@@ -0,0 +1,271 @@
+
+//Indirect Scene - GPU-driven submission: shared geometry, per-object storage buffer and indirect commands
+
+#include <algorithm>
+#include <iostream>         // Output log and error
+#include <unordered_map>
+
+#include "IndirectScene.h"
+#include "GLStateCache.h"
+
+using namespace std; // standard namespace
+
+namespace {
+
+    // Where one mesh landed in the shared buffers
+    struct MeshRange {
+        GLuint firstIndex;
+        GLuint indexCount;
+        GLint baseVertex;
+    };
+
+    uint64_t UHandleKey(MeshHandle handle) {
+        return ((uint64_t)handle.generation << 32) | handle.index;
+    }
+}
+
+bool IndirectScene::supported()
+{
+    return (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect) && GLEW_ARB_shader_draw_parameters;
+}
+
+void IndirectScene::clear()
+{
+    objects.clear();
+    batches.clear();
+    commands.clear();
+}
+
+GLuint IndirectScene::add(RenderPass pass, MeshHandle mesh, GLuint texture, const glm::mat4& model, GLuint material)
+{
+    Object object = { pass, mesh, texture, material, model, -1 };
+    objects.push_back(object);
+    return (GLuint)objects.size() - 1;
+}
+
+void IndirectScene::build(const MeshPool& meshes)
+{
+    UDestroyMesh(geometry);
+    objectBuffer.reset();
+    commandBuffer.reset();
+    batches.clear();
+    commands.clear();
+
+    // Lay out every published mesh once, however many objects use it
+    unordered_map<uint64_t, MeshRange> ranges;
+    vector<const GLMesh*> sources;
+    GLuint totalVertices = 0;
+    GLuint totalIndices = 0;
+
+    for (Object& object : objects) {
+        object.slot = -1;
+
+        const GLMesh* mesh = meshes.get(object.mesh);
+        if (mesh == nullptr || mesh->vbo == 0) // Not published yet
+            continue;
+
+        uint64_t key = UHandleKey(object.mesh);
+        if (ranges.count(key) != 0)
+            continue;
+
+        MeshRange range;
+        range.firstIndex = totalIndices;
+        range.indexCount = mesh->nIndices > 0 ? mesh->nIndices : mesh->nVertices;
+        range.baseVertex = (GLint)totalVertices;
+        ranges[key] = range;
+        sources.push_back(mesh);
+
+        totalVertices += mesh->nVertices;
+        totalIndices += range.indexCount;
+    }
+
+    if (sources.empty())
+        return;
+
+    // Shared vertex and index buffers, filled by buffer-to-buffer copies
+    geometry.nVertices = totalVertices;
+    geometry.nIndices = totalIndices;
+
+    geometry.vbo.create("Indirect Scene VBO");
+    glBindBuffer(GL_COPY_WRITE_BUFFER, geometry.vbo);
+    UBufferData(geometry.vbo, GL_COPY_WRITE_BUFFER, (GLsizeiptr)totalVertices * MESH_STRIDE, NULL, GL_STATIC_DRAW);
+
+    geometry.ibo.create("Indirect Scene IBO");
+    glBindBuffer(GL_COPY_WRITE_BUFFER, geometry.ibo);
+    UBufferData(geometry.ibo, GL_COPY_WRITE_BUFFER, (GLsizeiptr)totalIndices * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+
+    GLintptr vertexOffset = 0;
+    GLintptr indexOffset = 0;
+    vector<GLuint> sequential;
+    for (const GLMesh* mesh : sources) {
+        GLsizeiptr vertexBytes = (GLsizeiptr)mesh->nVertices * MESH_STRIDE;
+        glBindBuffer(GL_COPY_READ_BUFFER, mesh->vbo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, geometry.vbo);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, vertexOffset, vertexBytes);
+        vertexOffset += vertexBytes;
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, geometry.ibo);
+        if (mesh->nIndices > 0) {
+            GLsizeiptr indexBytes = (GLsizeiptr)mesh->nIndices * sizeof(GLuint);
+            glBindBuffer(GL_COPY_READ_BUFFER, mesh->ibo);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, indexOffset, indexBytes);
+            indexOffset += indexBytes;
+        }
+        else {
+            // glDrawArrays meshes get 0..n-1, baseVertex does the rest
+            sequential.resize(mesh->nVertices);
+            for (GLuint i = 0; i < mesh->nVertices; ++i)
+                sequential[i] = i;
+            GLsizeiptr indexBytes = (GLsizeiptr)sequential.size() * sizeof(GLuint);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, indexBytes, sequential.data());
+            indexOffset += indexBytes;
+        }
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    UCreateMeshVertexArray(geometry);
+
+    // Slots in pass, then texture order, so each batch is a contiguous run of commands
+    vector<GLuint> order;
+    for (GLuint i = 0; i < (GLuint)objects.size(); ++i) {
+        if (ranges.count(UHandleKey(objects[i].mesh)) != 0)
+            order.push_back(i);
+    }
+    stable_sort(order.begin(), order.end(), [this](GLuint a, GLuint b) {
+        if (objects[a].pass != objects[b].pass)
+            return objects[a].pass < objects[b].pass;
+        return objects[a].texture < objects[b].texture;
+    });
+
+    vector<ObjectData> objectData(order.size());
+    commands.resize(order.size());
+    for (GLuint slot = 0; slot < (GLuint)order.size(); ++slot) {
+        Object& object = objects[order[slot]];
+        const MeshRange& range = ranges[UHandleKey(object.mesh)];
+        object.slot = (GLint)slot;
+
+        objectData[slot].model = object.model;
+        objectData[slot].material = glm::uvec4(object.material, 0u, 0u, 0u);
+
+        DrawElementsIndirectCommand& command = commands[slot];
+        command.count = range.indexCount;
+        command.instanceCount = 1;
+        command.firstIndex = range.firstIndex;
+        command.baseVertex = range.baseVertex;
+        command.baseInstance = 0;
+
+        if (batches.empty() || batches.back().pass != object.pass || batches.back().texture != object.texture) {
+            Batch batch = { object.pass, object.texture, slot, 0 };
+            batches.push_back(batch);
+        }
+        ++batches.back().commandCount;
+    }
+
+    objectBuffer.create("Indirect Scene Objects");
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+    UBufferData(objectBuffer, GL_SHADER_STORAGE_BUFFER, objectData.size() * sizeof(ObjectData), objectData.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    commandBuffer.create("Indirect Scene Commands");
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    UBufferData(commandBuffer, GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void IndirectScene::setModel(GLuint object, const glm::mat4& model)
+{
+    if (object >= objects.size())
+        return;
+
+    objects[object].model = model;
+    if (objects[object].slot < 0)
+        return;
+
+    UGLState().bindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, objects[object].slot * sizeof(ObjectData), sizeof(glm::mat4), &model);
+}
+
+void IndirectScene::setVisible(const vector<uint32_t>& visible)
+{
+    // Objects that are not built have no command, they are not counted as visible either
+    bool changed = false;
+    size_t next = 0;
+    frameStats.visibleObjects = 0;
+    for (GLuint id = 0; id < (GLuint)objects.size(); ++id) {
+        bool shown = next < visible.size() && visible[next] == id;
+        if (shown)
+            ++next;
+
+        GLint slot = objects[id].slot;
+        if (slot < 0)
+            continue;
+
+        GLuint instances = shown ? 1 : 0;
+        frameStats.visibleObjects += instances;
+        if (commands[slot].instanceCount != instances) {
+            commands[slot].instanceCount = instances;
+            changed = true;
+        }
+    }
+
+    // Only re-upload when the visible set actually changed
+    if (!changed)
+        return;
+
+    UGLState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+}
+
+void IndirectScene::beginFrame()
+{
+    lastStats = frameStats;
+    frameStats = IndirectSceneStats();
+    frameStats.objects = (GLuint)objects.size();
+    frameStats.visibleObjects = frameStats.objects;
+}
+
+void IndirectScene::draw(RenderPass pass, const Uniform<GLuint>& drawBase)
+{
+    if (!built())
+        return;
+
+    GLStateCache& state = UGLState();
+    state.bindVertexArray(geometry.vao);
+    state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    state.bindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_DATA_BINDING, objectBuffer);
+    state.activeTexture(GL_TEXTURE0);
+
+    for (const Batch& batch : batches) {
+        if (batch.pass != pass)
+            continue;
+
+        if (batch.texture != 0 && state.bindTexture(GL_TEXTURE_2D, batch.texture))
+            ++frameStats.textureBinds;
+
+        // gl_DrawIDARB restarts at 0 for every multi-draw
+        drawBase.set(batch.firstCommand);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+            (const void*)(batch.firstCommand * sizeof(DrawElementsIndirectCommand)), batch.commandCount, 0);
+        ++frameStats.multiDrawCalls;
+    }
+}
+
+void IndirectScene::printStats(ostream& out) const
+{
+    out << "===== Indirect Scene =====\n"
+        << "Objects: " << lastStats.objects << " (" << lastStats.visibleObjects << " visible), multi-draw calls: " << lastStats.multiDrawCalls
+        << ", texture binds: " << lastStats.textureBinds << endl;
+}
+
+void IndirectScene::reset()
+{
+    UDestroyMesh(geometry);
+    objectBuffer.reset();
+    commandBuffer.reset();
+    objects.clear();
+    batches.clear();
+    commands.clear();
+}
+
+// END
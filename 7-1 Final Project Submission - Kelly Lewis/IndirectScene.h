@@ -0,0 +1,125 @@
+#pragma once
+
+//Indirect Scene Header - all scene geometry in shared buffers, drawn with glMultiDrawElementsIndirect
+
+#ifndef INDIRECT_SCENE_H
+#define INDIRECT_SCENE_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include <GL/glew.h>        // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "GpuResources.h"
+#include "Mesh.h"
+#include "RenderQueue.h"
+#include "ShaderProgram.h"
+
+// Shader storage binding point reserved for the per-object array
+const GLuint OBJECT_DATA_BINDING = 0;
+
+// Layout fixed by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// CPU mirror of one std430 ObjectRecord
+struct ObjectData {
+    glm::mat4 model;
+    glm::uvec4 material;    // x: material index, rest reserved
+};
+
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, "Indirect command layout is fixed by GL");
+static_assert(sizeof(ObjectData) == 64 + 16, "ObjectData must match the std430 layout of the GLSL struct");
+
+// GLSL declaration of the per-object array. Draw i of a multi-draw reads objects[drawBase + gl_DrawIDARB].
+#define OBJECT_DATA_BLOCK \
+    "struct ObjectRecord {\n" \
+    "    mat4 model;\n" \
+    "    uvec4 material;\n" \
+    "};\n" \
+    "layout(std430) readonly buffer ObjectData {\n" \
+    "    ObjectRecord objects[];\n" \
+    "};\n" \
+    "uniform uint drawBase;\n"
+
+// Draws made by the last frame
+struct IndirectSceneStats {
+    GLuint objects = 0;
+    GLuint visibleObjects = 0;
+    GLuint multiDrawCalls = 0;
+    GLuint textureBinds = 0;
+};
+
+// Every object becomes one indirect command and one ObjectData slot. Commands are grouped by pass and
+// texture, so a pass costs one glMultiDrawElementsIndirect per texture it uses, however many objects it has.
+class IndirectScene {
+public:
+    // Needs multi-draw indirect, shader storage buffers and gl_DrawIDARB
+    static bool supported();
+
+    // Describe the scene. Returns the object's id for setModel.
+    void clear();
+    GLuint add(RenderPass pass, MeshHandle mesh, GLuint texture, const glm::mat4& model, GLuint material = 0);
+
+    // Copy the geometry of every referenced mesh into the shared buffers (GPU to GPU) and write the object and
+    // command buffers. Objects whose mesh is not published yet are left out until the next build.
+    void build(const MeshPool& meshes);
+    bool built() const { return geometry.vao != 0; }
+
+    // Update one object's transform in place
+    void setModel(GLuint object, const glm::mat4& model);
+
+    // Culling result for the frame: ascending object ids to draw. Hidden objects keep their command with
+    // instanceCount 0, so batches and gl_DrawIDARB indexing stay the same.
+    void setVisible(const std::vector<uint32_t>& visible);
+
+    // Issue the pass. The matching program must be bound; drawBase is its drawBase uniform.
+    void draw(RenderPass pass, const Uniform<GLuint>& drawBase);
+
+    // Frame bookkeeping, call once before the first draw of a frame
+    void beginFrame();
+    const IndirectSceneStats& stats() const { return lastStats; }
+    void printStats(std::ostream& out) const;
+
+    void reset();
+
+private:
+    struct Object {
+        RenderPass pass;
+        MeshHandle mesh;
+        GLuint texture;
+        GLuint material;
+        glm::mat4 model;
+        GLint slot;         // position in the object and command buffers, -1 when not built
+    };
+
+    struct Batch {
+        RenderPass pass;
+        GLuint texture;
+        GLuint firstCommand;
+        GLuint commandCount;
+    };
+
+    std::vector<Object> objects;
+    std::vector<Batch> batches;
+    std::vector<DrawElementsIndirectCommand> commands;     // CPU copy of commandBuffer
+
+    GLMesh geometry;            // every mesh's vertices and indices, one vertex array
+    GpuBuffer objectBuffer;     // ObjectData per slot
+    GpuBuffer commandBuffer;    // DrawElementsIndirectCommand per slot
+
+    IndirectSceneStats frameStats;
+    IndirectSceneStats lastStats;
+};
+
+#endif
+//END
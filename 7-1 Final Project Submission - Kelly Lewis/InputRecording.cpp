@@ -0,0 +1,225 @@
+
+//Input Recording - event log writer and the frame by frame reader replays are driven from
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>         // Output log and error
+#include <utility>
+
+#include "InputRecording.h"
+
+using namespace std; // standard namespace
+
+namespace {
+
+    const char INPUT_LOG_MAGIC[4] = { 'C', 'G', 'V', 'I' };
+
+}
+
+bool InputRecorder::start(const string& path, const InputLogHeader& state)
+{
+    stop();
+
+    file.open(path, ios::binary | ios::trunc);
+    if (!file) {
+        cout << "ERROR::INPUT_LOG::OPEN_FAILED " << path << endl;
+        return false;
+    }
+
+    filePath = path;
+    header = state;
+    memcpy(header.magic, INPUT_LOG_MAGIC, sizeof(header.magic));
+    header.version = INPUT_LOG_VERSION;
+    header.frameCount = 0;
+    header.eventCount = 0;
+    bytes = 0;
+    put(&header, sizeof(header));
+    return true;
+}
+
+void InputRecorder::stop()
+{
+    if (!file.is_open())
+        return;
+
+    // Counts are only known now
+    file.seekp(0);
+    file.write((const char*)&header, sizeof(header));
+    file.close();
+
+    if (file.fail())
+        cout << "ERROR::INPUT_LOG::WRITE_FAILED " << filePath << endl;
+    else
+        cout << "INFO: Recorded " << header.frameCount << " frames and " << header.eventCount << " input events to "
+            << filePath << " (" << bytes << " bytes)" << endl;
+}
+
+void InputRecorder::key(int key, int scancode, int action, int mods)
+{
+    if (!active())
+        return;
+
+    uint8_t type = (uint8_t)InputEventType::Key;
+    int16_t values[2] = { (int16_t)key, (int16_t)scancode };
+    uint8_t flags[2] = { (uint8_t)action, (uint8_t)mods };
+    put(&type, sizeof(type));
+    put(values, sizeof(values));
+    put(flags, sizeof(flags));
+    ++header.eventCount;
+}
+
+void InputRecorder::cursorPos(double x, double y)
+{
+    if (!active())
+        return;
+
+    uint8_t type = (uint8_t)InputEventType::CursorPos;
+    double position[2] = { x, y };
+    put(&type, sizeof(type));
+    put(position, sizeof(position));
+    ++header.eventCount;
+}
+
+void InputRecorder::scroll(double x, double y)
+{
+    if (!active())
+        return;
+
+    uint8_t type = (uint8_t)InputEventType::Scroll;
+    double offset[2] = { x, y };
+    put(&type, sizeof(type));
+    put(offset, sizeof(offset));
+    ++header.eventCount;
+}
+
+void InputRecorder::mouseButton(int button, int action, int mods)
+{
+    if (!active())
+        return;
+
+    uint8_t values[4] = { (uint8_t)InputEventType::MouseButton, (uint8_t)button, (uint8_t)action, (uint8_t)mods };
+    put(values, sizeof(values));
+    ++header.eventCount;
+}
+
+void InputRecorder::frame(float time, float deltaTime)
+{
+    if (!active())
+        return;
+
+    uint8_t type = (uint8_t)InputEventType::Frame;
+    float times[2] = { time, deltaTime };
+    put(&type, sizeof(type));
+    put(times, sizeof(times));
+    ++header.frameCount;
+}
+
+void InputRecorder::put(const void* data, size_t size)
+{
+    file.write((const char*)data, size);
+    bytes += size;
+}
+
+bool InputReplay::load(const string& path)
+{
+    log.clear();
+    offset = 0;
+    fill(keys.begin(), keys.end(), 0);
+
+    ifstream file(path, ios::binary | ios::ate);
+    if (!file) {
+        cout << "ERROR::INPUT_LOG::OPEN_FAILED " << path << endl;
+        return false;
+    }
+
+    vector<uint8_t> contents((size_t)file.tellg());
+    file.seekg(0);
+    file.read((char*)contents.data(), contents.size());
+
+    if (!file || contents.size() < sizeof(InputLogHeader)) {
+        cout << "ERROR::INPUT_LOG::TRUNCATED " << path << endl;
+        return false;
+    }
+    memcpy(&header, contents.data(), sizeof(header));
+    if (memcmp(header.magic, INPUT_LOG_MAGIC, sizeof(header.magic)) != 0 || header.version != INPUT_LOG_VERSION) {
+        cout << "ERROR::INPUT_LOG::BAD_HEADER " << path << " is not a version " << INPUT_LOG_VERSION << " input log" << endl;
+        return false;
+    }
+    if (header.frameCount == 0) {
+        cout << "ERROR::INPUT_LOG::EMPTY " << path << " has no frames (was the recording closed?)" << endl;
+        return false;
+    }
+
+    log = move(contents);
+    offset = sizeof(header);
+    return true;
+}
+
+template <typename T>
+bool InputReplay::get(T& value)
+{
+    if (log.size() - offset < sizeof(T))
+        return false;
+    memcpy(&value, log.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+bool InputReplay::nextFrame(vector<InputEvent>& events, float& time, float& deltaTime)
+{
+    events.clear();
+
+    uint8_t type;
+    while (get(type)) {
+        InputEvent event = {};
+        event.type = (InputEventType)type;
+
+        bool complete = false;
+        switch (event.type) {
+        case InputEventType::Frame:
+            return get(time) && get(deltaTime);
+
+        case InputEventType::Key: {
+            int16_t key, scancode;
+            uint8_t action, mods;
+            complete = get(key) && get(scancode) && get(action) && get(mods);
+            event.key = key;
+            event.scancode = scancode;
+            event.action = action;
+            event.mods = mods;
+            if (complete && key >= 0 && key < (int)keys.size())
+                keys[key] = action != GLFW_RELEASE;
+            break;
+        }
+
+        case InputEventType::CursorPos:
+        case InputEventType::Scroll:
+            complete = get(event.x) && get(event.y);
+            break;
+
+        case InputEventType::MouseButton: {
+            uint8_t button, action, mods;
+            complete = get(button) && get(action) && get(mods);
+            event.key = button;
+            event.action = action;
+            event.mods = mods;
+            break;
+        }
+        }
+
+        if (!complete) {
+            cout << "ERROR::INPUT_LOG::CORRUPT record " << (int)type << " at byte " << offset << endl;
+            offset = log.size();
+            return false;
+        }
+        events.push_back(event);
+    }
+    return false; // Events after the last frame were never applied
+}
+
+bool InputReplay::keyDown(int key) const
+{
+    return key >= 0 && key < (int)keys.size() && keys[key] != 0;
+}
+
+// END
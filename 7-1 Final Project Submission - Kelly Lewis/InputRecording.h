@@ -0,0 +1,107 @@
+#pragma once
+
+//Input Recording Header - binary log of GLFW input events and frame times, and the replay that reads it back
+
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <GLFW/glfw3.h>     // GLFW library
+
+// File layout: InputLogHeader, then records of a one byte InputEventType followed by that type's fields, packed
+// in host byte order. Each Frame record closes the events delivered before that frame's input was processed.
+const uint32_t INPUT_LOG_VERSION = 1;
+
+// State the recording started from, so a replay starts from it too
+struct InputLogHeader {
+    char magic[4];              // "CGVI"
+    uint32_t version;
+    uint32_t frameCount;        // filled in when the recording is closed
+    uint32_t eventCount;
+    int32_t framebufferWidth;
+    int32_t framebufferHeight;
+    float cameraPosition[3];
+    float cameraYaw;
+    float cameraPitch;
+    float cameraZoom;
+};
+
+enum class InputEventType : uint8_t {
+    Frame,          // float time, float delta time (seconds)
+    Key,            // int16 key, int16 scancode, uint8 action, uint8 mods
+    CursorPos,      // double x, double y
+    Scroll,         // double x offset, double y offset
+    MouseButton     // uint8 button, uint8 action, uint8 mods
+};
+
+// One replayed event, with the arguments its GLFW callback received
+struct InputEvent {
+    InputEventType type;
+    int key;            // key, or mouse button
+    int scancode;
+    int action;
+    int mods;
+    double x;           // cursor position or scroll offset
+    double y;
+};
+
+// Streams events to disk as the callbacks deliver them; the header's counts are written by stop()
+class InputRecorder {
+public:
+    ~InputRecorder() { stop(); }
+
+    // Open the log and write the starting state. Returns false if the file could not be created.
+    bool start(const std::string& path, const InputLogHeader& state);
+    // Close the log, reporting its size. Safe to call when not recording.
+    void stop();
+    bool active() const { return file.is_open(); }
+
+    void key(int key, int scancode, int action, int mods);
+    void cursorPos(double x, double y);
+    void scroll(double x, double y);
+    void mouseButton(int button, int action, int mods);
+
+    // Close the current frame: everything recorded since the previous one is applied before it
+    void frame(float time, float deltaTime);
+
+private:
+    void put(const void* data, size_t size);
+
+    std::ofstream file;
+    std::string filePath;
+    InputLogHeader header = {};
+    uint64_t bytes = 0;
+};
+
+// Reads a whole log up front and hands it back one frame at a time
+class InputReplay {
+public:
+    bool load(const std::string& path);
+    bool active() const { return !log.empty(); }
+
+    const InputLogHeader& state() const { return header; }
+    size_t frameCount() const { return header.frameCount; }
+
+    // Events of the next frame in recorded order, then its time step. Key events also update keyDown().
+    // Returns false after the last frame.
+    bool nextFrame(std::vector<InputEvent>& events, float& time, float& deltaTime);
+
+    // Whether a key is held after the events returned so far, the replay's glfwGetKey
+    bool keyDown(int key) const;
+
+private:
+    template <typename T>
+    bool get(T& value);
+
+    std::vector<uint8_t> log;
+    size_t offset = 0;
+    InputLogHeader header = {};
+    std::vector<uint8_t> keys = std::vector<uint8_t>(GLFW_KEY_LAST + 1, 0);
+};
+
+#endif
+//END
@@ -14,6 +14,15 @@
 
 #include <iostream>         // Output log and error
 #include <cstdlib>          // C Standard Library for EXIT_FAILURE
+#include <cstring>          // strcmp for command line options
+#include <algorithm>        // min
+#include <vector>
+#include <thread>         // Render thread
+#include <random>         // Point light placement
+#include <iomanip>        // Lighting benchmark table
+#include <limits>         // Shadow bounds
+#include <chrono>         // Headless frame timings
+#include <cstdio>         // sscanf and snprintf for headless options and captures
 
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
@@ -29,6 +38,27 @@
 
 //My Headers
 #include "Cylinder.h"
+#include "Mesh.h"
+#include "MeshLoader.h"
+#include "ShaderProgram.h"
+#include "FrameData.h"
+#include "RenderQueue.h"
+#include "IndirectScene.h"
+#include "TextureArray.h"
+#include "FrustumCulling.h"
+#include "OcclusionCulling.h"
+#include "TransformHierarchy.h"
+#include "StaticBatch.h"
+#include "SpscRing.h"
+#include "FramePacing.h"
+#include "GLStateCache.h"
+#include "ClusteredLighting.h"
+#include "DeferredShading.h"
+#include "ShadowMapping.h"
+#include "DynamicResolution.h"
+#include "HeadlessContext.h"
+#include "ImageWriter.h"
+#include "InputRecording.h"
 
 
 using namespace std; // standard namespace
@@ -40,8 +70,45 @@ using namespace std; // standard namespace
 #define GLSL(Version, Source) "#version " #Version " core \n" #Source
 #endif
 
+/*Shader program Macro with the shared FrameData uniform block declared ahead of the source*/
+#ifndef GLSL_FRAME
+#define GLSL_FRAME(Version, Source) "#version " #Version " core \n" FRAME_DATA_BLOCK #Source
+#endif
+
+/*Phong lighting shared by every lit shader: the sum over the lights reaching a fragment's cluster, shadowed by the key light's map.
+  Pasted after LIGHT_DATA_BLOCK and SHADOW_BLOCK, so a lighting change is made once for forward, indirect and deferred shading.*/
+#ifndef PHONG_LIGHTING_BLOCK
+#define PHONG_LIGHTING_BLOCK \
+    "vec3 phongLighting(vec3 fragPos, vec3 norm) {\n" \
+    "    vec3 viewDir = normalize(viewPosition.xyz - fragPos);\n" \
+    "    vec3 result = vec3(0.0);\n" \
+    "    uvec2 cluster = clusterLights(fragPos);\n" \
+    "    for (uint i = 0u; i < cluster.y; ++i) {\n" \
+    "        uint light = lightIndices[cluster.x + i];\n" \
+    "        result += phongLight(lights[light], fragPos, norm, viewDir, lightShadow(light, fragPos, norm));\n" \
+    "    }\n" \
+    "    return result;\n" \
+    "}\n"
+#endif
+
+/*Shader program Macro for lit shaders: FrameData plus the clustered light lists, the key light's shadow lookup and the Phong sum*/
+#ifndef GLSL_LIT
+#define GLSL_LIT(Version, Source) "#version " #Version " core \n" FRAME_DATA_BLOCK LIGHT_DATA_BLOCK SHADOW_BLOCK PHONG_LIGHTING_BLOCK #Source
+#endif
+
+/*Shader program Macro for the deferred path: the lit declarations plus the G-buffer encoding helpers*/
+#ifndef GLSL_DEFERRED
+#define GLSL_DEFERRED(Version, Source) "#version " #Version " core \n" FRAME_DATA_BLOCK LIGHT_DATA_BLOCK SHADOW_BLOCK PHONG_LIGHTING_BLOCK GBUFFER_BLOCK #Source
+#endif
+
+/*Shader program Macro for multi-draw indirect: FrameData plus the per-object array indexed by gl_DrawIDARB*/
+#ifndef GLSL_INDIRECT
+#define GLSL_INDIRECT(Version, Source) "#version " #Version " core \n" \
+    "#extension GL_ARB_shader_draw_parameters : require \n" FRAME_DATA_BLOCK OBJECT_DATA_BLOCK #Source
+#endif
+
 /* Object Vertex Shader Source Code*/
-const GLchar* objectVertexShaderSource = GLSL(440,
+const GLchar* objectVertexShaderSource = GLSL_FRAME(440,
 
     layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
 layout(location = 1) in vec3 normal; // VAP position 1 for normals
@@ -51,10 +118,10 @@ out vec3 vertexNormal; // For outgoing normals to fragment shader
 out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
 out vec2 vertexTextureCoordinate;
 
-//Uniform / Global variables for the  transform matrices
+//Uniform / Global variables for the  transform matrices (view and projection come from FrameData)
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+invariant gl_Position; // Must match the depth prepass bit for bit
 
 void main()
 {
@@ -69,7 +136,7 @@ void main()
 
 
 /* Object Fragment Shader Source Code*/
-const GLchar* objectFragmentShaderSource = GLSL(440,
+const GLchar* objectFragmentShaderSource = GLSL_LIT(440,
 
     in vec3 vertexNormal; // For incoming normals
 in vec3 vertexFragmentPos; // For incoming fragment position
@@ -77,62 +144,20 @@ in vec2 vertexTextureCoordinate;
 
 out vec4 fragmentColor; // For outgoing cube color to the GPU
 
-// Uniform / Global variables for object color, light color, light position, and camera/view position
+// Uniform / Global variables for object color (camera/view position comes from FrameData, lights from the light list)
 uniform vec3 objectColor;
-uniform vec3 kLightColor; // Key Light color
-uniform vec3 fLightColor; // Fill Light color
-uniform vec3 kLightPos;   // Key Light Pos
-uniform vec3 fLightPos;   // Fill Light Pos
-uniform vec3 viewPosition;
 uniform sampler2D uTexture;
 
 uniform vec2 uvScale;
 
 void main()
 {
-    /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
-
-    // Begin Fill Light
-    //Calculate Ambient fill lighting*/
-    float fAmbientStrength = 0.1f; // Set ambient or global lighting strength
-    vec3 fAmbient = fAmbientStrength * fLightColor; // Generate ambient light color
-
-    //Calculate Diffuse fill lighting*/
-    vec3 fNorm = normalize(vertexNormal); // Normalize vectors to 1 unit
-    vec3 fLightDirection = normalize(fLightPos - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-    float fImpact = max(dot(fNorm, fLightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-    vec3 fDiffuse = fImpact * fLightColor; // Generate diffuse light color
-
-    //Calculate Specular fill lighting*/
-    float fSpecularIntensity = 0.1f; // Set specular light strength
-    float fHighlightSize = 32.0f; // Set specular highlight size
-    vec3 fViewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
-    vec3 fReflectDir = reflect(-fLightDirection, fNorm);// Calculate reflection vector
-    //Calculate specular fill component
-    float fSpecularComponent = pow(max(dot(fViewDir, fReflectDir), 0.0), fHighlightSize);
-    vec3 fSpecular = fSpecularIntensity * fSpecularComponent * fLightColor;
-    //END Fill Light
-
-    //Begin Key Light
-    //Calculate Ambient key lighting*/
-    float kAmbientStrength = 0.1f; // Set ambient or global lighting strength
-    vec3 kAmbient = kAmbientStrength * kLightColor; // Generate ambient light color
-
-    //Calculate Diffuse key lighting*/
-    vec3 kNorm = normalize(vertexNormal); // Normalize vectors to 1 unit
-    vec3 kLightDirection = normalize(kLightPos - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-    float kImpact = max(dot(kNorm, kLightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-    vec3 kDiffuse = kImpact * kLightColor; // Generate diffuse light color
-
-    //Calculate Specular key lighting*/
-    float kSpecularIntensity = 0.5f; // Set specular light strength
-    float kHighlightSize = 16.0f; // Set specular highlight size
-    vec3 kViewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
-    vec3 kReflectDir = reflect(-kLightDirection, kNorm);// Calculate reflection vector
-    //Calculate specular key component
-    float kSpecularComponent = pow(max(dot(kViewDir, kReflectDir), 0.0), kHighlightSize);
-    vec3 kSpecular = kSpecularIntensity * kSpecularComponent * kLightColor;
-    //END Key Light
+    /*Phong lighting model calculations to generate ambient, diffuse, and specular components, summed over the lights reaching this fragment's cluster*/
+
+    vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
+
+    // Lights (the key and fill lamps reach every cluster, point lights only the clusters their range touches)
+    vec3 lightingResult = phongLighting(vertexFragmentPos, norm);
 
     // Texture holds the color to be used for all three components
 
@@ -140,9 +165,6 @@ void main()
 
 
     // Calculate phong result
-    vec3 fResult = (fAmbient + fDiffuse + fSpecular);
-    vec3 kResult = (kAmbient + kDiffuse + kSpecular);
-    vec3 lightingResult = fResult + kResult;
     vec3 phong = lightingResult * textureColor.xyz;
 
     fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
@@ -151,14 +173,12 @@ void main()
 
 
 /* Lamp Shader Source Code*/
-const GLchar* lampVertexShaderSource = GLSL(440,
+const GLchar* lampVertexShaderSource = GLSL_FRAME(440,
 
     layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
 
-        //Uniform / Global variables for the  transform matrices
+        //Uniform / Global variables for the  transform matrices (view and projection come from FrameData)
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 void main()
 {
@@ -178,36 +198,508 @@ void main()
 }
 );
 
+
+/* Depth Prepass Vertex Shader Source Code (position only, same transform as the object shader)*/
+const GLchar* depthVertexShaderSource = GLSL_FRAME(440,
+
+    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+
+//Uniform / Global variables for the  transform matrices (view and projection come from FrameData)
+uniform mat4 model;
+
+invariant gl_Position; // Must match the object shader bit for bit, the shading pass tests GL_EQUAL
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+}
+);
+
+
+/* Depth Prepass Fragment Shader Source Code (depth only, no color output)*/
+const GLchar* depthFragmentShaderSource = GLSL(440,
+
+void main()
+{
+}
+);
+
+
+/* Shadow Map Vertex Shader Source Code (position only, seen from the key light; paired with the depth prepass fragment shader)*/
+const GLchar* shadowVertexShaderSource = GLSL(440,
+
+    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+
+//Uniform / Global variables for the transform matrices
+uniform mat4 shadowViewProjection; // Light camera fitted around the scene
+uniform mat4 model;
+
+void main()
+{
+    gl_Position = shadowViewProjection * model * vec4(position, 1.0f); // Transforms vertices into the light's clip coordinates
+}
+);
+
+
+/* Object Vertex Shader Source Code, indirect path (model comes from the object array)*/
+const GLchar* objectIndirectVertexShaderSource = GLSL_INDIRECT(440,
+
+    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+layout(location = 1) in vec3 normal; // VAP position 1 for normals
+layout(location = 2) in vec2 textureCoordinate;
+
+out vec3 vertexNormal; // For outgoing normals to fragment shader
+out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
+out vec2 vertexTextureCoordinate;
+flat out uint vertexMaterial; // Texture array layer
+
+void main()
+{
+    ObjectRecord object = objects[drawBase + uint(gl_DrawIDARB)]; // This draw's transform and material
+    mat4 model = object.model;
+    vertexMaterial = object.material.x;
+
+    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+
+    vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+
+    vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
+    vertexTextureCoordinate = textureCoordinate;
+}
+);
+
+
+/* Lamp Vertex Shader Source Code, indirect path*/
+const GLchar* lampIndirectVertexShaderSource = GLSL_INDIRECT(440,
+
+    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+
+void main()
+{
+    mat4 model = objects[drawBase + uint(gl_DrawIDARB)].model; // This draw's transform
+
+    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+}
+);
+
+/* Object Fragment Shader Source Code, indirect path (texture comes from the material array)*/
+const GLchar* objectIndirectFragmentShaderSource = GLSL_LIT(440,
+
+    in vec3 vertexNormal; // For incoming normals
+in vec3 vertexFragmentPos; // For incoming fragment position
+in vec2 vertexTextureCoordinate;
+flat in uint vertexMaterial; // Texture array layer
+
+out vec4 fragmentColor; // For outgoing cube color to the GPU
+
+// Uniform / Global variables for object color (camera/view position comes from FrameData, lights from the light list)
+uniform vec3 objectColor;
+uniform sampler2DArray uMaterials;
+
+uniform vec2 uvScale;
+
+void main()
+{
+    /*Phong lighting model calculations to generate ambient, diffuse, and specular components, summed over the lights reaching this fragment's cluster*/
+
+    vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
+
+    // Lights (the key and fill lamps reach every cluster, point lights only the clusters their range touches)
+    vec3 lightingResult = phongLighting(vertexFragmentPos, norm);
+
+    // Texture holds the color to be used for all three components
+
+    vec4 textureColor = texture(uMaterials, vec3(vertexTextureCoordinate * uvScale, float(vertexMaterial)));
+
+
+    // Calculate phong result
+    vec3 phong = lightingResult * textureColor.xyz;
+
+    fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
+}
+);
+
+
+/* G-Buffer Fragment Shader Source Code (deferred path: surface attributes only, the lighting pass lights them)*/
+const GLchar* gBufferFragmentShaderSource = GLSL_DEFERRED(440,
+
+    in vec3 vertexNormal; // For incoming normals
+in vec2 vertexTextureCoordinate;
+
+layout(location = 0) out vec4 gBufferAlbedo; // Texture color
+layout(location = 1) out vec2 gBufferNormal; // Octahedral world-space normal
+
+uniform sampler2D uTexture;
+
+uniform vec2 uvScale;
+
+void main()
+{
+    gBufferAlbedo = vec4(texture(uTexture, vertexTextureCoordinate * uvScale).xyz, 1.0);
+    gBufferNormal = octEncode(normalize(vertexNormal));
+}
+);
+
+
+/* G-Buffer Fragment Shader Source Code, indirect path (texture comes from the material array)*/
+const GLchar* gBufferIndirectFragmentShaderSource = GLSL_DEFERRED(440,
+
+    in vec3 vertexNormal; // For incoming normals
+in vec2 vertexTextureCoordinate;
+flat in uint vertexMaterial; // Texture array layer
+
+layout(location = 0) out vec4 gBufferAlbedo; // Texture color
+layout(location = 1) out vec2 gBufferNormal; // Octahedral world-space normal
+
+uniform sampler2DArray uMaterials;
+
+uniform vec2 uvScale;
+
+void main()
+{
+    gBufferAlbedo = vec4(texture(uMaterials, vec3(vertexTextureCoordinate * uvScale, float(vertexMaterial))).xyz, 1.0);
+    gBufferNormal = octEncode(normalize(vertexNormal));
+}
+);
+
+
+/* Full-Screen Vertex Shader Source Code (one triangle covering the viewport, no vertex data)*/
+const GLchar* fullScreenVertexShaderSource = GLSL(440,
+
+void main()
+{
+    vec2 corner = vec2(float((gl_VertexID & 1) << 2), float((gl_VertexID & 2) << 1)); // (0,0), (4,0), (0,4)
+    gl_Position = vec4(corner - 1.0, 0.0, 1.0);
+}
+);
+
+
+/* Deferred Lighting Fragment Shader Source Code (the same Phong sum as the object shader, once per pixel)*/
+const GLchar* deferredLightingFragmentShaderSource = GLSL_DEFERRED(440,
+
+    out vec4 fragmentColor; // For outgoing lit color to the GPU
+
+uniform sampler2D uAlbedo;
+uniform sampler2D uNormal;
+uniform sampler2D uDepth;
+
+uniform mat4 inverseViewProjection; // Rebuilds world position from depth
+uniform vec2 viewportSize; // Pixels drawn this frame, the G-buffer can be larger
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(uDepth, pixel, 0).r;
+    if (depth == 1.0)
+        discard; // Nothing was drawn here, keep the clear color
+
+    vec3 fragmentPos = worldFromDepth(gl_FragCoord.xy, viewportSize, depth, inverseViewProjection);
+    vec3 norm = octDecode(texelFetch(uNormal, pixel, 0).xy);
+
+    vec3 lightingResult = phongLighting(fragmentPos, norm);
+
+    fragmentColor = vec4(lightingResult * texelFetch(uAlbedo, pixel, 0).xyz, 1.0);
+    gl_FragDepth = depth; // The lamps are drawn afterwards and depth test against the scene
+}
+);
+
+
+/* Upscale Fragment Shader Source Code (stretches the scaled frame over the window, optionally sharpened)*/
+const GLchar* upscaleFragmentShaderSource = GLSL(440,
+
+    out vec4 fragmentColor; // For outgoing color to the GPU
+
+uniform sampler2D uScene;
+
+uniform vec2 outputSize; // Window pixels
+uniform vec2 sourceSize; // Pixels rendered, in the lower left corner of uScene
+uniform float sharpness; // Unsharp mask weight, 0 is plain bilinear
+
+// Bilinear tap at a source pixel position, kept inside the rendered corner so nothing outside it bleeds in
+vec3 sceneAt(vec2 position)
+{
+    position = clamp(position, vec2(0.5), sourceSize - 0.5);
+    return textureLod(uScene, position / vec2(textureSize(uScene, 0)), 0.0).rgb;
+}
+
+void main()
+{
+    vec2 position = gl_FragCoord.xy * (sourceSize / outputSize);
+    vec3 center = sceneAt(position);
+
+    if (sharpness > 0.0) {
+        vec3 left = sceneAt(position - vec2(1.0, 0.0));
+        vec3 right = sceneAt(position + vec2(1.0, 0.0));
+        vec3 down = sceneAt(position - vec2(0.0, 1.0));
+        vec3 up = sceneAt(position + vec2(0.0, 1.0));
+        vec3 low = min(center, min(min(left, right), min(down, up)));
+        vec3 high = max(center, max(max(left, right), max(down, up)));
+        vec3 blurred = (left + right + down + up) * 0.25;
+        center = clamp(center + (center - blurred) * sharpness, low, high); // No halos past the neighbours
+    }
+
+    fragmentColor = vec4(center, 1.0);
+}
+);
+
 //END SHADER SOURCES --------------------------------------------------------------------------------------------
 
 namespace {
 
-    // Struct to store GL data relative to a given mesh
-    struct GLMesh {
-        GLuint vao;         // vertex array object
-        GLuint vbo;         // vertex buffer object
-        GLuint ibo;         // Index buffer object
-        GLuint nVertices;   // Vertices of the mesh
-        GLuint nIndices;    // Indices of the mesh
+    // Mesh storage, all meshes live in the pool and are referenced by handle
+    MeshPool gMeshes;
+
+    // Scene mesh handles
+    MeshHandle pyramidMesh;
+    MeshHandle paperMesh;
+    MeshHandle paperBMesh;
+    MeshHandle tableMesh;
+    MeshHandle lampMeshA;
+    MeshHandle lampMeshB;
+    MeshHandle pencilBodyMesh;
+    MeshHandle pencilTipMesh;
+    MeshHandle threadMesh;
+    MeshHandle spoolMesh;
+    MeshHandle spoolBMesh;
+    MeshHandle glassRingMesh;
+    MeshHandle glassMesh;
+    MeshHandle magHandleMesh;
+
+    // Shapes the scene can build
+    enum class MeshShape {
+        Pyramid,
+        Cube,
+        Plane,
+        Cylinder
+    };
+
+    // Mesh description: which shape to build and, for cylinders, its parameters
+    struct MeshDesc {
+        MeshHandle* handle;
+        MeshShape shape;
+        bool positionStream;    // also build the position-only stream
+        GLfloat tRad = 0.0f, bRad = 0.0f, h = 0.0f;    // cylinder only
+        GLint slices = 0, stacks = 0;                   // cylinder only
+    };
+
+    // Scene meshes, created in this order by UCreateMeshObjects. Every one has a position stream: the depth prepass
+    // and the shadow pass draw them, and the lamp shader only reads position.
+    const MeshDesc SCENE_MESHES[] = {
+        { &pyramidMesh,    MeshShape::Pyramid,  true },
+        { &paperMesh,      MeshShape::Plane,    true },
+        { &paperBMesh,     MeshShape::Plane,    true },
+        { &lampMeshA,      MeshShape::Cube,     true },
+        { &lampMeshB,      MeshShape::Cube,     true },
+        { &magHandleMesh,  MeshShape::Cube,     true },
+        { &tableMesh,      MeshShape::Plane,    true },
+        { &pencilBodyMesh, MeshShape::Cylinder, true, 1.0f, 1.0f, 3.0f, 6, 1 },
+        { &pencilTipMesh,  MeshShape::Cylinder, true, 1.0f, 0.0f, 3.0f, 6, 1 },
+        { &threadMesh,     MeshShape::Cylinder, true, 1.0f, 1.0f, 3.0f, 25, 1 },
+        { &spoolMesh,      MeshShape::Cylinder, true, 1.0f, 1.0f, 0.5f, 25, 1 },
+        { &spoolBMesh,     MeshShape::Cylinder, true, 1.0f, 1.0f, 0.5f, 25, 1 },
+        { &glassRingMesh,  MeshShape::Cylinder, true, 1.0f, 1.0f, 0.5f, 25, 1 },
+        { &glassMesh,      MeshShape::Cylinder, true, 1.0f, 1.0f, 0.5f, 25, 1 },
+    };
+
+    // Background loader for cylinder geometry
+    MeshLoader gMeshLoader;
+
+    // Texture
+    GpuTexture galTexture;
+    GpuTexture PencilBody;
+    GpuTexture PencilCut;
+    GpuTexture PaperTexture;
+    GpuTexture darkWood;
+    GpuTexture threadTexture;
+    GpuTexture spoolWood;
+    GpuTexture lightWood;
+    GpuTexture Glass;
+
+    // Material textures, loaded in this order. A material's index is also its layer in the material array.
+    struct MaterialDesc {
+        const char* filename;   // relative to project's directory
+        GpuTexture* texture;
+    };
+
+    const MaterialDesc SCENE_MATERIALS[] = {
+        { "resources/galaxyTexture.jpg", &galTexture },
+        { "resources/PencilBody.jpg",    &PencilBody },
+        { "resources/PencilCut.jpg",     &PencilCut },
+        { "resources/PaperTexture.jpg",  &PaperTexture },
+        { "resources/darkWood.jpg",      &darkWood },
+        { "resources/Thread.jpg",        &threadTexture },
+        { "resources/spoolWood.jpg",     &spoolWood },
+        { "resources/lightWood.jpg",     &lightWood },
+        { "resources/Glass.jpg",         &Glass },
+    };
+
+    // Every material resampled into one texture array, so the indirect path never rebinds textures
+    TextureArray gMaterialArray;
+    bool gPackMaterials = true;
+    const int MATERIAL_LAYER_SIZE = 1024;
+
+    // Textured object placed in the scene: model = translate(position) * rotate(angle, axis) * scale(scale)
+    struct SceneObject {
+        MeshHandle* mesh;
+        GpuTexture* texture;
+        glm::vec3 position;
+        GLfloat angle;          // radians
+        glm::vec3 axis;
+        glm::vec3 scale;
+        bool occluder = false;  // rasterized for occlusion culling (planes, cubes and pyramids only)
+    };
+
+    // Scene objects, submitted to the render queue every frame in any order
+    const SceneObject SCENE_OBJECTS[] = {
+        // Cubes
+        { &magHandleMesh,  &lightWood,     glm::vec3(2.5f, 0.075f, -3.8f),     0.5f,    glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(2.0f, 0.1f, 0.25f) },
+        // Pyramids
+        { &pyramidMesh,    &galTexture,    glm::vec3(-3.0f, 0.51f, -3.0f),     -10.0f,  glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 1.0f, 1.0f),    true },
+        // Cylinders
+        { &pencilBodyMesh, &PencilBody,    glm::vec3(3.0f, 0.175f, 1.5f),      -15.0f,  glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.2f, 0.2f, 0.75f) },
+        { &pencilTipMesh,  &PencilCut,     glm::vec3(2.076f, 0.175f, 0.418f),  -15.0f,  glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.2f, 0.2f, 0.2f) },
+        { &threadMesh,     &threadTexture, glm::vec3(-4.0f, 0.3f, 0.0f),       -45.0f,  glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.2f, 0.2f, 0.2f) },
+        { &spoolMesh,      &spoolWood,     glm::vec3(-3.725f, 0.3f, -0.175f),  -45.0f,  glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.3f, 0.3f, 0.2f) },
+        { &spoolBMesh,     &spoolWood,     glm::vec3(-4.275f, 0.3f, 0.175f),   -45.0f,  glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.3f, 0.3f, 0.2f) },
+        { &glassRingMesh,  &lightWood,     glm::vec3(1.0f, 0.075f, -3.0f),     1.5713f, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.75f, 0.75f, 0.25f) },
+        { &glassMesh,      &Glass,         glm::vec3(1.0f, 0.08f, -3.0f),      1.5713f, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.70f, 0.70f, 0.25f) },
+        // Planes
+        { &tableMesh,      &darkWood,      glm::vec3(0.0f, 0.0f, 0.0f),        0.0f,    glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(10.0f, 1.0f, 10.0f),  true },
+        { &paperMesh,      &PaperTexture,  glm::vec3(2.0f, 0.01f, 1.5f),       -10.0f,  glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(3.0f, 1.0f, 5.0f),    true },
+        { &paperBMesh,     &PaperTexture,  glm::vec3(2.0f, 0.001f, 1.5f),      -9.9f,   glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(3.0f, 1.0f, 5.0f),    true },
+    };
+
+    const uint32_t SCENE_OBJECT_COUNT = sizeof(SCENE_OBJECTS) / sizeof(SCENE_OBJECTS[0]);
+
+    // Objects that move with another object, matched by mesh. The parent must come first in SCENE_OBJECTS.
+    struct SceneAttachment {
+        MeshHandle* child;
+        MeshHandle* parent;
+    };
+
+    const SceneAttachment SCENE_ATTACHMENTS[] = {
+        { &pencilTipMesh, &pencilBodyMesh },    // the tip follows the pencil body
+    };
+
+    // Transform of every scene object, then lamp A and lamp B. Node ids double as bounds table
+    // entries and indirect scene object ids.
+    TransformHierarchy gTransforms;
+    const uint32_t LAMP_NODE_A = SCENE_OBJECT_COUNT;
+    const uint32_t LAMP_NODE_B = SCENE_OBJECT_COUNT + 1;
+
+    // World boxes for frustum culling: SCENE_OBJECTS in order, then lamp A and lamp B
+    BoundsTable gSceneBounds;
+    vector<uint32_t> gVisibleObjects;
+
+    // Frustum survivors are then tested against the occluders, rasterized on the CPU
+    OcclusionCuller gOcclusion;
+    bool gUseOcclusion = true;      // F4 toggles
+
+    // Draws are collected here, sorted by state and replayed
+    RenderQueue gRenderQueue;
+    OpaqueOrder gOpaqueOrder = OpaqueOrder::StateSorted; // --opaque-order, F7 cycles state sorted, front to back, depth prepass
+
+    // Scene objects baked into world space and merged per texture, drawn by the render queue path.
+    // Only the lamps stay dynamic.
+    StaticBatcher gStaticBatches;
+    bool gUseStaticBatching = true; // F5 toggles
+    bool gBatchesDirty = true;      // baked once the loader has published every mesh; a static object that moves leaves its batch
+    vector<uint8_t> gBatchVisible;
+
+    // GPU-driven path: the same objects drawn with one multi-draw per texture per pass
+    IndirectScene gIndirectScene;
+    bool gUseIndirect = true;       // --no-indirect starts on the render queue, F3 toggles, only used when supported
+    bool gIndirectDirty = true;     // rebuild after meshes are published
+
+    // Deferred path: opaque surfaces go to the G-buffer, then one full-screen pass lights every pixel once
+    ShadingPath gShadingPath = ShadingPath::Forward;    // --deferred starts deferred, F8 toggles
+    GBuffer gGBuffer;
+
+    // Key light shadows: the scene objects are static casters, cached until the key lamp or one of them moves;
+    // lamp B is the one dynamic caster, drawn over the cache when it moves. Lamp A holds the light and casts nothing.
+    ShadowProjection gShadowProjection = ShadowProjection::Perspective; // --shadows off|perspective|ortho, F9 cycles
+    Bounds gShadowBounds;   // static scene box the shadow camera is fitted around
+    ShadowMap gShadowMap;
+
+    // Dynamic resolution: the render thread times each frame on the GPU and shrinks the scene to fit the budget,
+    // then stretches it over the window. At full scale the scene is drawn straight to the window.
+    double gGpuBudgetMs = -1.0;     // --gpu-budget ms, 0 turns scaling off; defaults to the --fps (or 60 Hz) period
+    bool gUseDynamicResolution = true;  // F10 toggles
+    UpscaleFilter gUpscaleFilter = UpscaleFilter::Sharpen;  // --upscale bilinear|sharpen
+    GpuFrameTimer gGpuFrameTimer;
+    ResolutionController gResolution;
+    ScaledRenderTarget gSceneTarget;
+
+    // Headless mode (--headless): an EGL context without a window draws --frames N frames into an offscreen target,
+    // stepping the simulation by a fixed amount each frame so the same options always produce the same images
+    bool gHeadless = false;
+    HeadlessContext gHeadlessContext;
+    OffscreenTarget gHeadlessTarget;
+    GLuint gOutputFramebuffer = 0;  // where finished frames go: the window's default framebuffer or the headless target
+    int gHeadlessFrames = 1;
+    const float HEADLESS_TIME_STEP = 1.0f / 60.0f;   // every scripted frame, replays included, unless --replay-recorded-steps
+    const int SCRIPTED_WARMUP_FRAMES = 1;  // timed but not summarized (llvmpipe also misreports its very first GPU timing)
+    string gPngPrefix;              // --png PREFIX writes PREFIX0000.png and on, numbered by frame
+    int gPngEvery = 0;              // --png-every N also captures every Nth frame, otherwise only the last
+    int gCaptureFailures = 0;
+    string gTimingLogPath;          // --timing-log PATH, per-frame CPU, render, GPU and frame times as CSV
+    FrameTimingLog gTimingLog;
+
+    // Input recording (--record PATH) logs every input event and each frame's time step. A replay (--replay PATH)
+    // hands recorded frame i's events to the same callbacks on frame i and steps by HEADLESS_TIME_STEP, so a
+    // flythrough reruns the same frames on any machine, in the window or headless. --replay-recorded-steps steps by
+    // the recorded times instead, following the live run's path at its frame rate.
+    InputRecorder gInputRecorder;
+    InputReplay gInputReplay;
+    vector<InputEvent> gReplayEvents;
+    bool gReplayRecordedSteps = false;
+
+    // Everything the render thread needs to draw one frame. The main thread fills a packet from input,
+    // simulation and culling; the render thread only reads it.
+    struct FramePacket {
+        FrameData frame;                    // camera and light cluster constants
+        vector<LightData> lights;           // light list, the lamps first
+        vector<LightCluster> lightGrid;     // each cluster's run of lightIndices
+        vector<GLuint> lightIndices;
+        vector<uint32_t> visible;           // nodes that survived culling
+        vector<uint32_t> movedNodes;        // nodes whose model changed since the previous packet
+        vector<glm::mat4> movedModels;
+        glm::vec2 uvScale;
+        glm::vec3 objectColor;
+        int framebufferWidth;
+        int framebufferHeight;
+        bool useIndirect;
+        bool useStaticBatching;
+        OpaqueOrder opaqueOrder;
+        ShadingPath shadingPath;
+        ShadowProjection shadowProjection;
+        glm::mat4 shadowViewProjection;     // key light camera, unchanged while the lamp is still
+        double gpuBudget;                   // milliseconds, 0 when dynamic resolution is off
+        UpscaleFilter upscaleFilter;
+        PresentMode presentMode;
+        uint64_t frameIndex;                // counts drawn frames from 0, keys the timing log and captures
+        bool capture;                       // headless: write this frame out as a PNG
+        bool printStats;                    // F2 was pressed, the render thread prints its side
+        bool resumedFromIdle;               // first frame after an idle wait, its interval is not a frame time
     };
 
-    // Mesh data
-    GLMesh pyramidMesh;
-    GLMesh paperMesh;
-    GLMesh paperBMesh;
-    GLMesh tableMesh;
-    GLMesh lampMainMesh;
-    GLMesh lampMeshA;
-    GLMesh lampMeshB;
-    GLMesh pencilBodyMesh;
-    GLMesh pencilTipMesh;
-    GLMesh handleMesh;
-    GLMesh threadMesh;
-    GLMesh spoolMesh;
-    GLMesh spoolBMesh;
-    GLMesh glassRingMesh;
-    GLMesh glassMesh;
-    GLMesh magHandleMesh;
+    // Two packets: the render thread draws one while the main thread fills the other, so the main thread is
+    // never more than one frame ahead of the screen
+    SpscRing<FramePacket, 2> gFramePackets;
+    thread gRenderThread;
+    bool gUseRenderThread = true;   // --single-thread draws each packet on the main thread instead
+    bool gPrintRenderStats = false;
+
+    // Render thread's copy of every node's model, kept current by the moved nodes in each packet
+    vector<glm::mat4> gRenderModels;
+
+    // Presentation: the swap interval is applied by the render thread, the limiter paces the main thread
+    // (and through the packets, the render thread behind it). Frame times are taken at each swap.
+    PresentMode gPresentMode = PresentMode::Vsync;  // --vsync off|on|adaptive, F6 cycles
+    PresentMode gAppliedPresentMode = PresentMode::Vsync;
+    bool gPresentModeApplied = false;
+    FrameLimiter gFrameLimiter;                     // --fps N, uncapped by default
+    FrameTimeStats gFrameTimes;
 
     // Main GLFW window
     GLFWwindow* gWindow = nullptr;
@@ -218,6 +710,12 @@ namespace {
     const int WINDOW_WIDTH = 800;
     const int WINDOW_HEIGHT = 600;
 
+    // Framebuffer size from --size and the resize callback (main thread), and the size the viewport was last set to (render thread)
+    int gFramebufferWidth = WINDOW_WIDTH;
+    int gFramebufferHeight = WINDOW_HEIGHT;
+    int gViewportWidth = WINDOW_WIDTH;
+    int gViewportHeight = WINDOW_HEIGHT;
+
     // Timing Variables
     float gDeltaTime = 0.0f; // time between current frame and last frame
     float gLastFrame = 0.0f;
@@ -229,20 +727,53 @@ namespace {
     bool gFirstMouse = true;
 
     // Shader programs
-    GLuint gProgramId; // Object Shader
-    GLuint gLampProgramId; // Lamp Shader
+    ShaderProgram gProgramId; // Object Shader
+    ShaderProgram gLampProgramId; // Lamp Shader
+    ShaderProgram gIndirectProgramId; // Object Shader, indirect path
+    ShaderProgram gLampIndirectProgramId; // Lamp Shader, indirect path
+    ShaderProgram gDepthProgramId; // Depth prepass Shader
+    ShaderProgram gGBufferProgramId; // G-buffer Shader, deferred path
+    ShaderProgram gGBufferIndirectProgramId; // G-buffer Shader, deferred and indirect path
+    ShaderProgram gLightingProgramId; // Deferred lighting Shader
+    ShaderProgram gShadowProgramId; // Shadow map Shader
+    ShaderProgram gUpscaleProgramId; // Dynamic resolution upscale Shader
+
+    // Uniform locations, cached once after the programs link
+    struct ObjectUniforms {
+        Uniform<glm::mat4> model;
+        Uniform<glm::vec2> uvScale;
+        Uniform<glm::vec3> objectColor;
+    } gObjectUniforms, gGBufferUniforms;
+
+    struct LampUniforms {
+        Uniform<glm::mat4> model;
+    } gLampUniforms, gDepthUniforms;
+
+    struct IndirectUniforms {
+        Uniform<GLuint> drawBase;
+        Uniform<glm::vec2> uvScale;
+        Uniform<glm::vec3> objectColor;
+    } gIndirectUniforms, gLampIndirectUniforms, gGBufferIndirectUniforms;
+
+    struct LightingUniforms {
+        Uniform<glm::mat4> inverseViewProjection;
+        Uniform<glm::vec2> viewportSize;
+    } gLightingUniforms;
+
+    struct ShadowUniforms {
+        Uniform<glm::mat4> shadowViewProjection;
+        Uniform<glm::mat4> model;
+    } gShadowUniforms;
+
+    struct UpscaleUniforms {
+        Uniform<glm::vec2> outputSize;
+        Uniform<glm::vec2> sourceSize;
+        Uniform<GLfloat> sharpness;
+    } gUpscaleUniforms;
+
+    // Camera and lighting shared by every program, uploaded once per frame
+    FrameUniformBuffer gFrameUniforms;
 
-    // Texture
-    GLuint galTexture;
-    GLuint PencilBody;
-    GLuint PencilCut;
-    GLuint PaperTexture;
-    GLuint PhotoTexture;
-    GLuint darkWood;
-    GLuint threadTexture;
-    GLuint spoolWood;
-    GLuint lightWood;
-    GLuint Glass;
     glm::vec2 gUVScale(1.0f, 1.0f);
     GLint gTexWrapMode = GL_REPEAT;
 
@@ -259,9 +790,28 @@ namespace {
     glm::vec3 gLightPositionB(0.0f, 5.0f, -5.0f);
     glm::vec3 gLightScaleB(0.3f);
 
+    // Light list: the key and fill lamps, then --lights N point lights scattered over the table.
+    // The main thread bins it into view-space clusters, the render thread uploads the result.
+    vector<LightData> gLights;
+    const size_t KEY_LIGHT = 0;
+    const size_t FILL_LIGHT = 1;
+    int gPointLightCount = 0;
+    LightClusterer gLightClusters;
+    LightBuffers gLightBuffers;
+
     // Lamp animation
     bool gIsLampOrbiting = true;
 
+    // On-demand rendering: with nothing animating, loading or being pressed, the loop sleeps in
+    // glfwWaitEventsTimeout instead of producing frames. Input callbacks request one more frame.
+    bool gRenderOnDemand = true;    // --continuous redraws every iteration
+    bool gFrameRequested = true;
+    int gKeysHeld = 0;              // held keys keep drawing, the camera moves every frame they are down
+    const double IDLE_WAIT_SECONDS = 0.25; // wake now and then to notice loader progress
+    uint64_t gFramesDrawn = 0;
+    uint64_t gIdleWaits = 0;
+    bool gResumedFromIdle = false;  // the next packet follows an idle wait
+
     //view mode
     bool isOrtho = false;
     
@@ -270,6 +820,11 @@ namespace {
 //Function Declarations
 // Window Operations and Init
 bool UInitialize(int, char* [], GLFWwindow** window);
+bool UInitializeHeadless();
+void UMakeContextCurrent();
+void UReleaseContext();
+bool UParseSize(const char* text, int& width, int& height);
+bool UParseCameraPose(const char* text, Camera& camera);
 void UResizeWindow(GLFWwindow* window, int width, int height);
 
 //Input Handling
@@ -277,162 +832,457 @@ void UProcessInput(GLFWwindow* window);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+void UKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void UWindowRefreshCallback(GLFWwindow* window);
+bool UFrameNeeded();
+bool UKeyPressed(GLFWwindow* window, int key);
+bool UReplayFrameInput(float& deltaTime);
 
 //Shader Construction and Destruction
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, ShaderProgram& programId);
 bool ULoadShaders();
-void UDestroyShaderProgram(GLuint programId);
+void UDestroyShaderProgram(ShaderProgram& programId);
 
 //Texture
 void flipImageVertically(unsigned char* image, int width, int height, int channels);
-bool UCreateTexture(const char* filename, GLuint& textureId);
+bool UCreateTexture(const char* filename, GpuTexture& textureId, TextureArray* layers = nullptr, GLuint layer = 0);
 bool ULoadTextures();
-void UDestroyTexture(GLuint textureId);
+GLuint UMaterialLayer(const GpuTexture* texture);
+void UDestroyTexture(GpuTexture& textureId);
 
 //Rendering
-void URender();
+void UBuildFramePacket(FramePacket& packet);
+void URender(const FramePacket& packet);
+void ULightGBuffer(const FrameData& frame, GLuint target, int width, int height);
+void UUpdateShadowMap(const FramePacket& packet);
+void UBenchmarkLighting(ostream& out);
+void URenderThread();
+void UStopRenderThread();
+void UPresent(const FramePacket& packet);
+void UFinishFrame(const FramePacket& packet, bool scaled, chrono::steady_clock::time_point renderStart);
+void UCaptureFrame(uint64_t frameIndex);
+void UAnimateLamps(float deltaTime);
+void URunScripted();
+void UFinishScripted();
+void UBuildIndirectScene();
+void UBuildStaticBatches();
+glm::mat4 UObjectPlacement(const SceneObject& object);
+uint32_t UFindObject(const MeshHandle* mesh);
+void UBuildTransforms();
+const MeshDesc* UFindMeshDesc(const MeshHandle* mesh);
+Bounds UMeshBounds(const MeshHandle* mesh);
+Bounds UNodeBounds(uint32_t node);
+void UBuildSceneBounds();
+void UBuildOccluders();
+void UBuildLights();
 void UCreateMeshObjects();
 void UDestroyScene();
 
 //Shape
-void UCreatePyramid(GLMesh& mesh);
-void UCreateCube(GLMesh& mesh);
-void UCreatePlane(GLMesh& mesh);
+void UCreatePyramid(GLMesh& mesh, bool positionStream = false);
+void UCreateCube(GLMesh& mesh, bool positionStream = false);
+void UCreatePlane(GLMesh& mesh, bool positionStream = false);
 void UCreateCylinder(GLMesh& mesh, GLfloat tRad, GLfloat bRad, GLfloat h, GLint slices, GLint stacks);
 
-void UDestroyMesh(GLMesh& mesh);
+//Resources
+void UPrintGpuResources();
 
 // Main Function and Entry point for OpenGL
 int main(int argc, char* argv[]) {
 
+    bool benchLighting = false;
+    bool sizeGiven = false;
+    string recordPath;
+    string replayPath;
+
+    // Benchmark the culling kernels and exit, no window needed
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--bench-culling") == 0) {
+            UBenchmarkFrustumCulling(cout);
+            return EXIT_SUCCESS;
+        }
+        if (strcmp(argv[i], "--single-thread") == 0)
+            gUseRenderThread = false;
+        if (strcmp(argv[i], "--continuous") == 0)
+            gRenderOnDemand = false;
+        if (strcmp(argv[i], "--no-indirect") == 0)
+            gUseIndirect = false;
+        if (strcmp(argv[i], "--opaque-order") == 0 && i + 1 < argc && !UParseOpaqueOrder(argv[++i], gOpaqueOrder))
+            cout << "ERROR::OPTIONS::OPAQUE_ORDER expected sorted, front-to-back or prepass, got '" << argv[i] << "'" << endl;
+        if (strcmp(argv[i], "--vsync") == 0 && i + 1 < argc && !UParsePresentMode(argv[++i], gPresentMode))
+            cout << "ERROR::OPTIONS::VSYNC expected off, on or adaptive, got '" << argv[i] << "'" << endl;
+        if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+            gFrameLimiter.setTargetFps(atof(argv[++i]));
+        if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+            gPointLightCount = max(atoi(argv[++i]), 0);
+        if (strcmp(argv[i], "--deferred") == 0)
+            gShadingPath = ShadingPath::Deferred;
+        if (strcmp(argv[i], "--shadows") == 0 && i + 1 < argc && !UParseShadowProjection(argv[++i], gShadowProjection))
+            cout << "ERROR::OPTIONS::SHADOWS expected off, perspective or ortho, got '" << argv[i] << "'" << endl;
+        if (strcmp(argv[i], "--gpu-budget") == 0 && i + 1 < argc)
+            gGpuBudgetMs = max(atof(argv[++i]), 0.0);
+        if (strcmp(argv[i], "--upscale") == 0 && i + 1 < argc && !UParseUpscaleFilter(argv[++i], gUpscaleFilter))
+            cout << "ERROR::OPTIONS::UPSCALE expected bilinear or sharpen, got '" << argv[i] << "'" << endl;
+        if (strcmp(argv[i], "--bench-lighting") == 0)
+            benchLighting = true;
+        if (strcmp(argv[i], "--headless") == 0)
+            gHeadless = true;
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            gHeadlessFrames = max(atoi(argv[++i]), 1);
+        if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            sizeGiven = UParseSize(argv[++i], gFramebufferWidth, gFramebufferHeight);
+            if (!sizeGiven)
+                cout << "ERROR::OPTIONS::SIZE expected WIDTHxHEIGHT, got '" << argv[i] << "'" << endl;
+        }
+        if (strcmp(argv[i], "--camera") == 0 && i + 1 < argc && !UParseCameraPose(argv[++i], gCamera))
+            cout << "ERROR::OPTIONS::CAMERA expected x,y,z or x,y,z,yaw,pitch, got '" << argv[i] << "'" << endl;
+        if (strcmp(argv[i], "--png") == 0 && i + 1 < argc)
+            gPngPrefix = argv[++i];
+        if (strcmp(argv[i], "--png-every") == 0 && i + 1 < argc)
+            gPngEvery = max(atoi(argv[++i]), 0);
+        if (strcmp(argv[i], "--timing-log") == 0 && i + 1 < argc)
+            gTimingLogPath = argv[++i];
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            recordPath = argv[++i];
+        if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replayPath = argv[++i];
+        if (strcmp(argv[i], "--replay-recorded-steps") == 0)
+            gReplayRecordedSteps = true;
+    }
+
+    // A replay starts where its recording did: same camera, and the same framebuffer unless --size overrides it
+    if (!replayPath.empty()) {
+        if (!gInputReplay.load(replayPath))
+            return EXIT_FAILURE;
+        const InputLogHeader& state = gInputReplay.state();
+        gCamera = Camera(glm::vec3(state.cameraPosition[0], state.cameraPosition[1], state.cameraPosition[2]),
+            glm::vec3(0.0f, 1.0f, 0.0f), state.cameraYaw, state.cameraPitch);
+        gCamera.Zoom = state.cameraZoom;
+        if (!sizeGiven) {
+            gFramebufferWidth = state.framebufferWidth;
+            gFramebufferHeight = state.framebufferHeight;
+        }
+        cout << "INFO: Replaying " << state.frameCount << " frames and " << state.eventCount << " input events from "
+            << replayPath << (gReplayRecordedSteps ? " at their recorded time steps" : " at a fixed 60 Hz step") << endl;
+    }
+    if (!recordPath.empty() && (gHeadless || gInputReplay.active())) {
+        cout << "ERROR::OPTIONS::RECORD needs live input, not --headless or --replay" << endl;
+        recordPath.clear();
+    }
+
+    // GPU budget follows the frame rate the limiter aims for, 60 Hz when uncapped. Headless frames stay at full
+    // resolution unless a budget is given, so their images do not depend on how fast the machine is.
+    if (gGpuBudgetMs < 0.0 && gHeadless)
+        gGpuBudgetMs = 0.0;
+    if (gGpuBudgetMs < 0.0)
+        gGpuBudgetMs = 1000.0 / (gFrameLimiter.targetFps() > 0.0 ? gFrameLimiter.targetFps() : 60.0);
+    gUseDynamicResolution = gGpuBudgetMs > 0.0;
+
     // If UInitialize fails
     if (!UInitialize(argc, argv, &gWindow)) { // Error Check
         return EXIT_FAILURE; // Error Handle
     }
 
+    // Record from the state the first frame sees
+    if (!recordPath.empty()) {
+        InputLogHeader state = {};
+        state.framebufferWidth = gFramebufferWidth;
+        state.framebufferHeight = gFramebufferHeight;
+        state.cameraPosition[0] = gCamera.Position.x;
+        state.cameraPosition[1] = gCamera.Position.y;
+        state.cameraPosition[2] = gCamera.Position.z;
+        state.cameraYaw = gCamera.Yaw;
+        state.cameraPitch = gCamera.Pitch;
+        state.cameraZoom = gCamera.Zoom;
+        if (gInputRecorder.start(recordPath, state))
+            cout << "INFO: Recording input to " << recordPath << endl;
+    }
+
     // Create mesh objects
     UCreateMeshObjects();
-
-    ULoadShaders();
+    UBuildTransforms();
+    UBuildSceneBounds();
+    UBuildOccluders();
+    UBuildLights();
+    if (gPointLightCount > 0)
+        cout << "INFO: " << gPointLightCount << " point lights added to the light list" << endl;
+    gOcclusion.start();
+    gLightClusters.start();
+
+    // Shaders are required, nothing can be drawn without them
+    if (!ULoadShaders()) {
+        gMeshLoader.stop();
+        gOcclusion.stop();
+        gLightClusters.stop();
+        UDestroyScene();
+        return EXIT_FAILURE;
+    }
 
     ULoadTextures();
 
+    // Forward against deferred shading, then exit. Needs the context and the table, not the render thread.
+    if (benchLighting) {
+        UBenchmarkLighting(cout);
+        gMeshLoader.stop();
+        gOcclusion.stop();
+        gLightClusters.stop();
+        UDestroyScene();
+        return EXIT_SUCCESS;
+    }
+
     // Set the background color to black
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
+    // Headless frames must not depend on when the loader finishes, so every mesh is in before the first one
+    if (gHeadless) {
+        while (gMeshLoader.pendingCount() > 0) {
+            gMeshLoader.publishReady(gMeshes);
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        UGLState().invalidate();
+    }
+
+    // Hand the GL context to the render thread. The main thread keeps events, input, simulation and culling.
+    if (gUseRenderThread) {
+        UReleaseContext();
+        gRenderThread = thread(URenderThread);
+    }
+
+    // Headless runs and replays draw their scripted frames instead of the interactive loop
+    bool scripted = gHeadless || gInputReplay.active();
+    if (scripted)
+        URunScripted();
+
     // Start Render Loop (aka Game Loop)
-    while (!glfwWindowShouldClose(gWindow)) { // Infinite Loop with Exit Condition
+    while (!scripted && !glfwWindowShouldClose(gWindow)) { // Infinite Loop with Exit Condition
+
+        // Nothing changed since the last frame: sleep until an event arrives, without drawing
+        if (gRenderOnDemand && !UFrameNeeded()) {
+            glfwWaitEventsTimeout(IDLE_WAIT_SECONDS);
+            gLastFrame = glfwGetTime(); // time spent idle does not move anything
+            ++gIdleWaits;
+            gResumedFromIdle = true;
+            continue;
+        }
+        gFrameRequested = false;
+        ++gFramesDrawn;
 
         // Frame Timing Variables
         float currentFrame = glfwGetTime();
         gDeltaTime = currentFrame - gLastFrame;
         gLastFrame = currentFrame;
+        gInputRecorder.frame(currentFrame, gDeltaTime); // Closes the events that arrived since the last frame
 
         // Lamp orbits around the origin
-        const float angularVelocity = glm::radians(45.0f);
-        if (gIsLampOrbiting)
-        {
-            //Lamp A
-            glm::vec4 newPosition = glm::rotate(angularVelocity * gDeltaTime, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(gLightPositionA, 1.0f);
-            gLightPositionA.x = newPosition.x;
-            gLightPositionA.y = newPosition.y;
-            gLightPositionA.z = newPosition.z;
-            //Lamp B
-            newPosition = glm::rotate(angularVelocity * gDeltaTime, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(gLightPositionB, 1.0f);
-            gLightPositionB.x = newPosition.x;
-            gLightPositionB.y = newPosition.y;
-            gLightPositionB.z = newPosition.z;
-        }
-
-        // Enable z-depth
-        glEnable(GL_DEPTH_TEST);
-
-        // Clear background set to black
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        glUseProgram(gProgramId);
+        UAnimateLamps(gDeltaTime);
 
         // Call to handle input
         UProcessInput(gWindow);
 
-        // Render frame function call
-        URender();
+        // Describe the frame for the render thread. Waits here while both packets are still in use.
+        FramePacket* packet = gFramePackets.beginWrite();
+        UBuildFramePacket(*packet);
+        gFramePackets.endWrite();
+
+        // Render frame function call, when there is no render thread to do it
+        if (!gUseRenderThread) {
+            URender(*gFramePackets.beginRead());
+            gFramePackets.endRead();
+        }
+
+        // Hold the target frame rate, if one was set
+        gFrameLimiter.wait();
 
         // Poll for events (aka inputs)
         glfwPollEvents();
     }
 
-    // Clean-up call
+    // Clean-up call, with the GL context back on this thread
+    gInputRecorder.stop();
+    UStopRenderThread();
+    if (scripted)
+        UFinishScripted();
+    gMeshLoader.stop();
+    gOcclusion.stop();
+    gLightClusters.stop();
     UDestroyScene();
+    gHeadlessContext.destroy();
+
+    exit(gCaptureFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE); // Terminates the program, failed if a capture was lost
+}
+
+// Scripted frame loop, for headless runs and replays: no live input, and a fixed time step (or the replay's recorded
+// ones) instead of the clock. CPU time covers the main thread's half of each frame, not the wait for a free packet.
+void URunScripted() {
+    typedef chrono::steady_clock Clock;
+
+    const int frameCount = gInputReplay.active() ? (int)gInputReplay.frameCount() : gHeadlessFrames;
+    gTimingLog.start(frameCount, SCRIPTED_WARMUP_FRAMES);
+
+    for (int i = 0; i < frameCount; ++i) {
+        // A replay in the window can still be closed
+        if (gWindow != nullptr) {
+            glfwPollEvents();
+            if (glfwWindowShouldClose(gWindow))
+                break;
+        }
+
+        Clock::time_point start = Clock::now();
+        gDeltaTime = HEADLESS_TIME_STEP;
+        float recordedDelta;
+        if (gInputReplay.active() && !UReplayFrameInput(recordedDelta)) {
+            cout << "ERROR::INPUT_LOG::SHORT the log ended after " << i << " of " << frameCount << " frames" << endl;
+            break;
+        }
+        if (gInputReplay.active() && gReplayRecordedSteps)
+            gDeltaTime = recordedDelta;
+        ++gFramesDrawn;
+
+        UAnimateLamps(gDeltaTime);
+        if (gInputReplay.active())
+            UProcessInput(gWindow);
+        Clock::duration cpuTime = Clock::now() - start;
+
+        FramePacket* packet = gFramePackets.beginWrite();
+        start = Clock::now();
+        UBuildFramePacket(*packet);
+        packet->capture = gHeadless && !gPngPrefix.empty() && (i == frameCount - 1 || (gPngEvery > 0 && i % gPngEvery == 0));
+        cpuTime += Clock::now() - start;
+        gTimingLog.setCpu(packet->frameIndex, chrono::duration<double, milli>(cpuTime).count());
+        gFramePackets.endWrite();
+
+        if (!gUseRenderThread) {
+            URender(*gFramePackets.beginRead());
+            gFramePackets.endRead();
+        }
+    }
+}
+
+// Scripted run is over: collect the GPU timings still in flight, then summarize and write the timing log.
+// Needs the GL context back on this thread.
+void UFinishScripted() {
+    gGpuFrameTimer.finish();
+    double gpuMilliseconds;
+    uint64_t timedFrame;
+    while (gGpuFrameTimer.read(gpuMilliseconds, timedFrame))
+        gTimingLog.setGpu(timedFrame, gpuMilliseconds);
+    if (gGpuFrameTimer.dropped() > 0)
+        cout << "WARNING: " << gGpuFrameTimer.dropped() << " frames have no GPU time, the GPU fell a whole query ring behind" << endl;
+
+    cout << "INFO: " << (gInputReplay.active() ? "Replay" : "Headless run") << " drew " << gFramesDrawn << " frames at "
+        << gFramebufferWidth << "x" << gFramebufferHeight << endl;
+    if (!gUseIndirect && gUseStaticBatching && gStaticBatches.built())
+        gStaticBatches.printStats(cout);
+    gTimingLog.printSummary(cout);
+    if (!gTimingLogPath.empty() && gTimingLog.writeCsv(gTimingLogPath))
+        cout << "INFO: Frame timings written to " << gTimingLogPath << endl;
+}
 
-    exit(EXIT_SUCCESS); // Terminates the program successfully
+// Lamp orbits around the origin
+void UAnimateLamps(float deltaTime) {
+    const float angularVelocity = glm::radians(45.0f);
+    if (gIsLampOrbiting)
+    {
+        //Lamp A
+        glm::vec4 newPosition = glm::rotate(angularVelocity * deltaTime, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(gLightPositionA, 1.0f);
+        gLightPositionA.x = newPosition.x;
+        gLightPositionA.y = newPosition.y;
+        gLightPositionA.z = newPosition.z;
+        //Lamp B
+        newPosition = glm::rotate(angularVelocity * deltaTime, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(gLightPositionB, 1.0f);
+        gLightPositionB.x = newPosition.x;
+        gLightPositionB.y = newPosition.y;
+        gLightPositionB.z = newPosition.z;
+    }
 }
 
 // Function to call mesh creation
+// Every mesh gets a slot in gMeshes up front. Static primitives are built immediately; cylinders are
+// generated and uploaded by the loader thread and appear once their uploads have completed.
 void UCreateMeshObjects() {
-    UCreatePyramid(pyramidMesh); // Call to create a standard pyramid
-    UCreatePlane(paperMesh); // Call to create a standard cube
-    UCreatePlane(paperBMesh); // Call to create a standard cube
-    UCreateCube(lampMeshA); // Call to create a standard cube
-    UCreateCube(lampMeshB); // Call to create a standard cube
-    UCreateCube(magHandleMesh); // Call to create a standard cube
-    UCreatePlane(tableMesh); // Call to create a plane
-    UCreateCylinder(pencilBodyMesh, 1.0f, 1.0f, 3.0f, 6, 1); // Call to create a cylinder
-    UCreateCylinder(pencilTipMesh, 1.0f, 0.0f, 3.0f, 6, 1); // Call to create a cylinder
-    UCreateCylinder(threadMesh, 1.0f, 1.0f, 3.0f, 25, 1); // Call to create a cylinder
-    UCreateCylinder(spoolMesh, 1.0f, 1.0f, 0.5f, 25, 1); // Call to create a cylinder
-    UCreateCylinder(spoolBMesh, 1.0f, 1.0f, 0.5f, 25, 1); // Call to create a cylinder
-    UCreateCylinder(glassRingMesh, 1.0f, 1.0f, 0.5f, 25, 1); // Call to create a cylinder
-    UCreateCylinder(glassMesh, 1.0f, 1.0f, 0.5f, 25, 1); // Call to create a cylinder
-
+    gMeshLoader.start(gWindow);
+
+    gMeshes.reserve(sizeof(SCENE_MESHES) / sizeof(SCENE_MESHES[0]));
+
+    for (const MeshDesc& desc : SCENE_MESHES) {
+        *desc.handle = gMeshes.insert(GLMesh());
+        GLMesh& mesh = gMeshes[*desc.handle];
+
+        switch (desc.shape) {
+        case MeshShape::Pyramid:
+            UCreatePyramid(mesh, desc.positionStream); // Call to create a standard pyramid
+            break;
+        case MeshShape::Cube:
+            UCreateCube(mesh, desc.positionStream); // Call to create a standard cube
+            break;
+        case MeshShape::Plane:
+            UCreatePlane(mesh, desc.positionStream); // Call to create a plane
+            break;
+        case MeshShape::Cylinder:
+            gMeshLoader.requestCylinder(*desc.handle, desc.tRad, desc.bRad, desc.h, desc.slices, desc.stacks, desc.positionStream); // Queue a cylinder
+            break;
+        }
+    }
 }
 
 //Function to call mesh destruction
 void UDestroyScene() {
 
     // Mesh Clean-up
-    UDestroyMesh(pyramidMesh);
-    UDestroyMesh(paperMesh);
-    UDestroyMesh(tableMesh);
-    UDestroyMesh(lampMeshA);
-    UDestroyMesh(lampMeshB);
-    UDestroyMesh(pencilBodyMesh);
-    UDestroyMesh(pencilTipMesh);
-    UDestroyMesh(threadMesh);
-    UDestroyMesh(spoolMesh);
-    UDestroyMesh(glassRingMesh);
-    UDestroyMesh(glassMesh);
-    UDestroyMesh(magHandleMesh);
-    
+    for (GLMesh& mesh : gMeshes)
+        UDestroyMesh(mesh);
+    gMeshes.clear();
 
     // Shader Clean-up
     UDestroyShaderProgram(gProgramId);
     UDestroyShaderProgram(gLampProgramId);
+    UDestroyShaderProgram(gIndirectProgramId);
+    UDestroyShaderProgram(gLampIndirectProgramId);
+    UDestroyShaderProgram(gDepthProgramId);
+    UDestroyShaderProgram(gGBufferProgramId);
+    UDestroyShaderProgram(gGBufferIndirectProgramId);
+    UDestroyShaderProgram(gLightingProgramId);
+    UDestroyShaderProgram(gShadowProgramId);
+    UDestroyShaderProgram(gUpscaleProgramId);
+    gGBuffer.reset();
+    gShadowMap.reset();
+    gSceneTarget.reset();
+    gGpuFrameTimer.reset();
+    gHeadlessTarget.reset();
+    gRenderQueue.reset();
+    gFrameUniforms.reset();
+    gLightBuffers.reset();
+    gIndirectScene.reset();
+    gStaticBatches.reset();
+    gMaterialArray.reset();
 
     // Texture Clean-up
     UDestroyTexture(darkWood);
     UDestroyTexture(PaperTexture);
     UDestroyTexture(PencilBody);
     UDestroyTexture(PencilCut);
-    UDestroyTexture(PhotoTexture);
     UDestroyTexture(galTexture);
+    UDestroyTexture(threadTexture);
+    UDestroyTexture(spoolWood);
     UDestroyTexture(lightWood);
     UDestroyTexture(Glass);
-    UDestroyTexture(galTexture);
+
+    // Anything still alive at this point was never released
+    UGpuResources().reportLeaks(cout);
 }
 
-// Render Function
-void URender() {
+// Print live GPU memory by category
+void UPrintGpuResources() {
+    UGpuResources().printReport(cout);
+}
+
+// Main thread half of a frame: camera, lamp transforms and culling, written into the packet the render thread draws
+void UBuildFramePacket(FramePacket& packet) {
 
     glm::mat4 view;
     glm::mat4 projection;
-    glm::mat4 model;
-
-    GLint modelLoc;
-    GLint viewLoc;
-    GLint projLoc;
-    GLint UVScaleLoc;
+    const GLfloat nearPlane = 0.1f;
+    const GLfloat farPlane = 100.0f;
 
 
     //View and Projection
@@ -441,277 +1291,818 @@ void URender() {
 
     // Perspective Projection
     if (!isOrtho){
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+        // Aspect of the actual framebuffer, a minimized window reports zero
+        GLfloat aspect = (GLfloat)max(gFramebufferWidth, 1) / (GLfloat)max(gFramebufferHeight, 1);
+        projection = glm::perspective(glm::radians(gCamera.Zoom), aspect, nearPlane, farPlane);
     }
     else{
-        projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f);
+        projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, nearPlane, farPlane);
+    }
+
+    // Lamps only dirty their nodes when they actually moved, a still scene does no matrix math here
+    gTransforms.setPosition(LAMP_NODE_A, gLightPositionA);
+    gTransforms.setPosition(LAMP_NODE_B, gLightPositionB);
+    gTransforms.update();
+
+    // Push recomputed transforms to the culling boxes, and pass them on to the render thread
+    packet.movedNodes.clear();
+    packet.movedModels.clear();
+    for (uint32_t node : gTransforms.updated()) {
+        gSceneBounds.set(node, UTransformBounds(UNodeBounds(node), gTransforms.model(node)));
+        packet.movedNodes.push_back(node);
+        packet.movedModels.push_back(gTransforms.model(node));
+    }
+
+    // Frustum culling
+    UFrustumCull(gSceneBounds, UExtractFrustum(projection * view), gVisibleObjects);
+
+    // Then drop anything hidden behind the occluders
+    if (gUseOcclusion) {
+        gOcclusion.render(projection * view);
+        gOcclusion.filter(gSceneBounds, gVisibleObjects);
+    }
+    packet.visible = gVisibleObjects;
+
+    // The lamps follow their cubes, then every light is binned into the clusters it can reach
+    gLights[KEY_LIGHT].positionRange = glm::vec4(gLightPositionA, 0.0f);
+    gLights[FILL_LIGHT].positionRange = glm::vec4(gLightPositionB, 0.0f);
+    gLightClusters.assign(gLights, view, projection, nearPlane, farPlane, packet.lightGrid, packet.lightIndices);
+    packet.lights = gLights;
+
+    // Per-frame camera and light cluster constants, one upload shared by every program
+    FrameData& frame = packet.frame;
+    frame.view = view;
+    frame.projection = projection;
+    frame.viewPosition = glm::vec4(gCamera.Position, 1.0f);
+    frame.clusterScale = gLightClusters.clusterScale(gFramebufferWidth, gFramebufferHeight);
+    frame.clusterGrid = gLightClusters.clusterGrid(gLights.size());
+
+    // Key light shadow camera, fitted around the static scene. Nothing here changes while the lamp is still,
+    // which is what lets the render thread keep its cached map.
+    packet.shadowProjection = gShadowProjection;
+    if (gShadowProjection != ShadowProjection::Off) {
+        packet.shadowViewProjection = UFitShadowCamera(gShadowProjection, gLightPositionA, gShadowBounds);
+        frame.shadowMatrix = UShadowTextureMatrix(packet.shadowViewProjection);
+        frame.shadowParams = glm::vec4(1.0f, SHADOW_NORMAL_OFFSET, (float)KEY_LIGHT, 0.0f);
+    }
+    else {
+        packet.shadowViewProjection = glm::mat4(1.0f);
+        frame.shadowMatrix = glm::mat4(1.0f);
+        frame.shadowParams = glm::vec4(0.0f);
     }
 
+    packet.uvScale = gUVScale;
+    packet.objectColor = gObjectColor;
+    packet.framebufferWidth = gFramebufferWidth;
+    packet.framebufferHeight = gFramebufferHeight;
+    packet.useIndirect = gUseIndirect;
+    packet.useStaticBatching = gUseStaticBatching;
+    packet.opaqueOrder = gOpaqueOrder;
+    packet.shadingPath = gShadingPath;
+    packet.gpuBudget = gUseDynamicResolution && gUpscaleProgramId != 0 ? gGpuBudgetMs : 0.0;
+    packet.upscaleFilter = gUpscaleFilter;
+    packet.presentMode = gPresentMode;
+    packet.frameIndex = gFramesDrawn - 1;
+    packet.capture = false;
+    packet.printStats = gPrintRenderStats;
+    gPrintRenderStats = false;
+    packet.resumedFromIdle = gResumedFromIdle;
+    gResumedFromIdle = false;
+}
 
-    // Create Matrix variables to pass to Uniform
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    viewLoc = glGetUniformLocation(gProgramId, "view");
-    projLoc = glGetUniformLocation(gProgramId, "projection");
-    UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
+// Render thread: owns the GL context and draws packets until the ring is closed
+void URenderThread() {
+    UMakeContextCurrent();
 
-    GLint objectColorLoc = glGetUniformLocation(gProgramId, "objectColor");
-    GLint keyLightColorLoc = glGetUniformLocation(gProgramId, "kLightColor");
-    GLint keyLightPositionLoc = glGetUniformLocation(gProgramId, "kLightPos");
-    GLint fillLightColorLoc = glGetUniformLocation(gProgramId, "fLightColor");
-    GLint fillLightPositionLoc = glGetUniformLocation(gProgramId, "fLightPos");
-    GLint viewPositionLoc = glGetUniformLocation(gProgramId, "viewPosition");
+    FramePacket* packet;
+    while ((packet = gFramePackets.beginRead()) != nullptr) {
+        URender(*packet);
+        gFramePackets.endRead();
+    }
 
-    // Set Uniforms
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
+    UReleaseContext();
+}
 
-    glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
-    glUniform3f(keyLightColorLoc, gLightColorA.r, gLightColorA.g, gLightColorA.b);
-    glUniform3f(fillLightColorLoc, gLightColorB.r, gLightColorB.g, gLightColorB.b);
-    glUniform3f(keyLightPositionLoc, gLightPositionA.x, gLightPositionA.y, gLightPositionA.z);
-    glUniform3f(fillLightPositionLoc, gLightPositionB.x, gLightPositionB.y, gLightPositionB.z);
-    const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+// Let the render thread finish what was already published, then take the GL context back for clean-up
+void UStopRenderThread() {
+    if (!gRenderThread.joinable())
+        return;
 
-    // Draw Primitives with Texture and Transformations
-    // Cubes ---------------------------------------------------------------------------------------------------
-    //Cube  
-    glActiveTexture(GL_TEXTURE0); // Set Active Texture Location
-    glBindTexture(GL_TEXTURE_2D, lightWood); // Set Active Texture
-    glBindVertexArray(magHandleMesh.vao); // Bind VAO
-    model = glm::mat4(1.0f); // Set Identity Matrix
-    model = glm::translate(glm::vec3(2.5f, 0.075f, -3.8f)) *      // Change object position (Translate)
-        glm::rotate(0.5f, glm::vec3(0.0f, 1.0f, 0.0f)) * // Change object rotation
-        glm::scale(glm::vec3(2.0f, 0.1f, 0.25f));            // Change object scale
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model)); // Set Transformation Uniform before Draw
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, magHandleMesh.nVertices);
-    glBindVertexArray(0);  // Deativate the VAO
-    // END Cube
-
-    // Pyramids -------------------------------------------------------------------------------------------------
-
-    //Pyramid
-    glActiveTexture(GL_TEXTURE0); // Set Active Texture Location
-    glBindTexture(GL_TEXTURE_2D, galTexture); // Set Active Texture
-    glBindVertexArray(pyramidMesh.vao); // Bind VAO
-    model = glm::mat4(1.0f); // Set Identity Matrix
-    model = glm::translate(glm::vec3(-3.0f, 0.51f, -3.0f)) *    // Change object position (Translate)
-        glm::rotate(-10.0f, glm::vec3(0.0f, 1.0f, 0.0f)) * // Change object rotation
-        glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));           // Change object scale
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model)); // Set Transformation Uniform before Draw
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, pyramidMesh.nVertices);
-    glBindVertexArray(0);  // Deativate the VAO
-    // END Pyramid
-
-    // Cylinders -------------------------------------------------------------------------------------------------
-
-    //Cylinder - Pencil Body
-    glActiveTexture(GL_TEXTURE0); // Set Active Texture Location
-    glBindTexture(GL_TEXTURE_2D, PencilBody); // Set Active Texture
-    glBindVertexArray(pencilBodyMesh.vao); // Bind VAO
-    model = glm::mat4(1.0f); // Set Identity Matrix
-    model = glm::translate(glm::vec3(3.0f, 0.175f, 1.5f)) *    // Change object position (Translate)
-        glm::rotate(-15.0f, glm::vec3(0.0f, 1.0f, 0.0f)) * // Change object rotation
-        glm::scale(glm::vec3(0.2f, 0.2f, 0.75f));           // Change object scale
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model)); // Set Transformation Uniform before Draw
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, pencilBodyMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-    glBindVertexArray(0);  // Deativate the VAO
-    //End cylinder
-
-    //Cylinder - Pencil Tip
-    glActiveTexture(GL_TEXTURE0); // Set Active Texture Location
-    glBindTexture(GL_TEXTURE_2D, PencilCut); // Set Active Texture
-    glBindVertexArray(pencilTipMesh.vao); // Bind VAO
-    model = glm::mat4(1.0f); // Set Identity Matrix
-    model = glm::translate(glm::vec3(2.076f, 0.175f, 0.418f)) *    // Change object position (Translate)
-        glm::rotate(-15.0f, glm::vec3(0.0f, 1.0f, 0.0f)) * // Change object rotation
-        glm::scale(glm::vec3(0.2f, 0.2f, 0.2f));           // Change object scale
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model)); // Set Transformation Uniform before Draw
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, pencilTipMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-    glBindVertexArray(0);  // Deativate the VAO
-    //End cylinder
-
-    //Cylinder - Thread Side
-    glActiveTexture(GL_TEXTURE0); // Set Active Texture Location
-    glBindTexture(GL_TEXTURE_2D, threadTexture); // Set Active Texture
-    glBindVertexArray(threadMesh.vao); // Bind VAO
-    model = glm::mat4(1.0f); // Set Identity Matrix
-    model = glm::translate(glm::vec3(-4.0f, 0.3f, 0.0f)) *    // Change object position (Translate)
-        glm::rotate(-45.0f, glm::vec3(0.0f, 1.0f, 0.0f)) * // Change object rotation
-        glm::scale(glm::vec3(0.2f, 0.2f, 0.2f));           // Change object scale
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model)); // Set Transformation Uniform before Draw
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, threadMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-    glBindVertexArray(0);  // Deativate the VAO
-    //End cylinder
-
-    //Cylinder - Thread Spool Top
-    glActiveTexture(GL_TEXTURE0); // Set Active Texture Location
-    glBindTexture(GL_TEXTURE_2D, spoolWood); // Set Active Texture
-    glBindVertexArray(spoolMesh.vao); // Bind VAO
-    model = glm::mat4(1.0f); // Set Identity Matrix
-    model = glm::translate(glm::vec3(-3.725f, 0.3f, -0.175f)) *    // Change object position (Translate)
-        glm::rotate(-45.0f, glm::vec3(0.0f, 1.0f, 0.0f)) * // Change object rotation
-        glm::scale(glm::vec3(0.3f, 0.3f, 0.2f));           // Change object scale
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model)); // Set Transformation Uniform before Draw
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, spoolMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-    glBindVertexArray(0);  // Deativate the VAO
-    //End cylinder
-
-    //Cylinder - Thread Spool bottom
-    glActiveTexture(GL_TEXTURE0); // Set Active Texture Location
-    glBindTexture(GL_TEXTURE_2D, spoolWood); // Set Active Texture
-    glBindVertexArray(spoolBMesh.vao); // Bind VAO
-    model = glm::mat4(1.0f); // Set Identity Matrix
-    model = glm::translate(glm::vec3(-4.275f, 0.3f, 0.175f)) *    // Change object position (Translate)
-        glm::rotate(-45.0f, glm::vec3(0.0f, 1.0f, 0.0f)) * // Change object rotation
-        glm::scale(glm::vec3(0.3f, 0.3f, 0.2f));           // Change object scale
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model)); // Set Transformation Uniform before Draw
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, spoolBMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-    glBindVertexArray(0);  // Deativate the VAO
-    //End cylinder
-
-    //Cylinder - Magnifying Glass Ring
-    glActiveTexture(GL_TEXTURE0); // Set Active Texture Location
-    glBindTexture(GL_TEXTURE_2D, lightWood); // Set Active Texture
-    glBindVertexArray(glassRingMesh.vao); // Bind VAO
-    model = glm::mat4(1.0f); // Set Identity Matrix
-    model = glm::translate(glm::vec3(1.0f, 0.075f, -3.0f)) *    // Change object position (Translate)
-        glm::rotate(1.5713f, glm::vec3(1.0f, 0.0f, 0.0f)) * // Change object rotation
-        glm::scale(glm::vec3(0.75f, 0.75f, 0.25f));           // Change object scale
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model)); // Set Transformation Uniform before Draw
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, glassRingMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-    glBindVertexArray(0);  // Deativate the VAO
-    //End cylinder
-
-    //Cylinder - Glass
-    glActiveTexture(GL_TEXTURE0); // Set Active Texture Location
-    glBindTexture(GL_TEXTURE_2D, Glass); // Set Active Texture
-    glBindVertexArray(glassMesh.vao); // Bind VAO
-    model = glm::mat4(1.0f); // Set Identity Matrix
-    model = glm::translate(glm::vec3(1.0f, 0.08f, -3.0f)) *    // Change object position (Translate)
-        glm::rotate(1.5713f, glm::vec3(1.0f, 0.0f, 0.0f)) * // Change object rotation
-        glm::scale(glm::vec3(0.70f, 0.70f, 0.25f));           // Change object scale
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model)); // Set Transformation Uniform before Draw
-    // Draws the triangles
-    glDrawElements(GL_TRIANGLES, glassMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-    glBindVertexArray(0);  // Deativate the VAO
-    //End cylinder
-
-    // Planes ------------------------------------------------------------------------------------------------------
-
-    //Plane - Table
-    glActiveTexture(GL_TEXTURE0); // Set Active Texture Location
-    glBindTexture(GL_TEXTURE_2D, darkWood); // Set Active Texture
-    glBindVertexArray(tableMesh.vao);
-    model = glm::mat4(1.0f); // Set Identity Matrix
-    model = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f)) *      // Change object position (Translate) 
-        glm::rotate(0.0f, glm::vec3(0.0f, 1.0f, 0.0f)) *   // Change object rotation
-        glm::scale(glm::vec3(10.0f, 1.0f, 10.0f));         // Change object scale
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model)); // Set Transformation Uniform before Draw
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, tableMesh.nVertices);
-    glBindVertexArray(0);  // Deativate the VAO
-    // END Plane
-
-    //Plane - Paper
-    glActiveTexture(GL_TEXTURE0); // Set Active Texture Location
-    glBindTexture(GL_TEXTURE_2D, PaperTexture); // Set Active Texture
-    glBindVertexArray(paperMesh.vao);
-    model = glm::mat4(1.0f); // Set Identity Matrix
-    model = glm::translate(glm::vec3(2.0f, 0.01f, 1.5f)) *      // Change object position (Translate) 
-        glm::rotate(-10.0f, glm::vec3(0.0f, 1.0f, 0.0f)) *   // Change object rotation
-        glm::scale(glm::vec3(3.0f, 1.0f, 5.0f));         // Change object scale
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model)); // Set Transformation Uniform before Draw
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, paperMesh.nVertices);
-    glBindVertexArray(0);  // Deativate the VAO
-    // END Plane
-
-    //Plane - Paper 2
-    glActiveTexture(GL_TEXTURE0); // Set Active Texture Location
-    glBindTexture(GL_TEXTURE_2D, PaperTexture); // Set Active Texture
-    glBindVertexArray(paperBMesh.vao);
-    model = glm::mat4(1.0f); // Set Identity Matrix
-    model = glm::translate(glm::vec3(2.0f, 0.001f, 1.5f)) *      // Change object position (Translate) 
-        glm::rotate(-9.9f, glm::vec3(0.0f, 1.0f, 0.0f)) *   // Change object rotation
-        glm::scale(glm::vec3(3.0f, 1.0f, 5.0f));         // Change object scale
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model)); // Set Transformation Uniform before Draw
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, paperBMesh.nVertices);
-    glBindVertexArray(0);  // Deativate the VAO
-    // END Plane
+    gFramePackets.close();
+    gRenderThread.join();
+    UMakeContextCurrent();
+}
 
-    // Draw Light Sources---------------------------------------------------------------------------------------------
+// Swap, or when headless capture the frame if the packet asks for it, and record the interval since the previous frame
+// unless the loop slept in between
+void UPresent(const FramePacket& packet) {
+    if (!gHeadless)
+        glfwSwapBuffers(gWindow);    // Swap Back buffer with Front buffer
+    else if (packet.capture)
+        UCaptureFrame(packet.frameIndex);
+    if (packet.resumedFromIdle)
+        gFrameTimes.restart(); // the gap since the last swap was spent asleep, not drawing
+    gTimingLog.setFrame(packet.frameIndex, gFrameTimes.mark());
+}
+
+// Read the headless target back and write it to the next numbered PNG
+void UCaptureFrame(uint64_t frameIndex) {
+    vector<uint8_t> pixels;
+    gHeadlessTarget.readPixels(pixels);
+
+    char number[32];
+    snprintf(number, sizeof(number), "%04llu.png", (unsigned long long)frameIndex);
+    if (!UWritePng(gPngPrefix + number, gHeadlessTarget.width(), gHeadlessTarget.height(), pixels))
+        ++gCaptureFailures;
+}
+
+// Render Function
+// GL half of a frame. Only reads the packet; everything it touches besides that belongs to the render thread.
+void URender(const FramePacket& packet) {
+
+    const GLfloat farPlane = 100.0f;
+    const glm::mat4& view = packet.frame.view;
+    GLStateCache& state = UGLState();
+    chrono::steady_clock::time_point renderStart = chrono::steady_clock::now();
+
+    state.beginFrame();
+
+    // Hand any meshes finished by the loader thread to the scene. Creating their vertex arrays binds behind the cache.
+    if (gMeshLoader.publishReady(gMeshes) > 0) {
+        gIndirectDirty = true;
+        gBatchesDirty = true;
+        gShadowMap.invalidateStatic(); // New casters
+        state.invalidate();
+    }
+
+    // Transforms the main thread recomputed, into the render copy and the indirect object buffer
+    for (size_t i = 0; i < packet.movedNodes.size(); ++i) {
+        uint32_t node = packet.movedNodes[i];
+        gRenderModels[node] = packet.movedModels[i];
+        gIndirectScene.setModel(node, gRenderModels[node]);
+        if (gStaticBatches.release(node)) // Drawn on its own from now on, the rest of its batch stays baked
+            state.invalidate();
+        if (node < SCENE_OBJECT_COUNT)
+            gShadowMap.invalidateStatic();
+    }
+
+    // Last frame's draw calls and state changes, before this frame resets them
+    if (packet.printStats) {
+        if (packet.useIndirect)
+            gIndirectScene.printStats(cout);
+        else
+            gRenderQueue.printStats(cout);
+        if (!packet.useIndirect && packet.useStaticBatching)
+            gStaticBatches.printStats(cout);
+        if (packet.shadingPath == ShadingPath::Deferred && gGBuffer.width() > 0)
+            cout << "===== Deferred Shading =====\nG-buffer: " << gGBuffer.width() << "x" << gGBuffer.height() << ", "
+                << GBuffer::BYTES_PER_PIXEL << " bytes per pixel" << endl;
+        if (packet.shadowProjection != ShadowProjection::Off)
+            gShadowMap.printStats(cout);
+        if (packet.gpuBudget > 0.0)
+            gResolution.printStats(cout, gViewportWidth, gViewportHeight);
+        state.printStats(cout);
+        gFrameTimes.printStats(cout);
+    }
+
+    // Swap interval belongs to the context, so it is set here. Headless never swaps.
+    if (!gPresentModeApplied || packet.presentMode != gAppliedPresentMode) {
+        if (!gHeadless)
+            glfwSwapInterval(USwapInterval(packet.presentMode));
+        gAppliedPresentMode = packet.presentMode;
+        gPresentModeApplied = true;
+        gFrameTimes.reset();
+    }
+
+    // Finished GPU timings, oldest first, pick this frame's scale and go to the timing log; then this frame is timed in turn
+    gResolution.setBudget(packet.gpuBudget);
+    double gpuMilliseconds;
+    uint64_t timedFrame;
+    while (gGpuFrameTimer.read(gpuMilliseconds, timedFrame)) {
+        gResolution.update(gpuMilliseconds);
+        gTimingLog.setGpu(timedFrame, gpuMilliseconds);
+    }
+    // Only timed when something reads the result: the scale, or a scripted run's timing log
+    if (packet.gpuBudget > 0.0 || gTimingLog.active())
+        gGpuFrameTimer.begin(packet.frameIndex);
+    else
+        gGpuFrameTimer.reset(); // Timings from before scaling was turned off would be stale when it comes back
+    if (packet.gpuBudget <= 0.0)
+        gSceneTarget.reset(); // Not coming back until scaling is turned on again
+
+    // Shadow map first, it has its own framebuffer and viewport
+    UUpdateShadowMap(packet);
+
+    // Resizes arrive through the packet, the callback runs on the main thread without a context
+    if (packet.framebufferWidth != gViewportWidth || packet.framebufferHeight != gViewportHeight) {
+        gViewportWidth = packet.framebufferWidth;
+        gViewportHeight = packet.framebufferHeight;
+    }
+
+    // A scaled frame draws into the corner of the offscreen target and is stretched over the window at the end;
+    // at full scale the scene goes straight to the window (or the headless target)
+    bool scaled = gResolution.scale() < MAX_RENDER_SCALE;
+    GLuint sceneTarget = gOutputFramebuffer;
+    int renderWidth = gViewportWidth;
+    int renderHeight = gViewportHeight;
+    if (scaled) {
+        if (gSceneTarget.resize(gViewportWidth, gViewportHeight))
+            state.invalidate();
+        gSceneTarget.setScale(gResolution.scale());
+        sceneTarget = gSceneTarget.target();
+        renderWidth = gSceneTarget.renderWidth();
+        renderHeight = gSceneTarget.renderHeight();
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneTarget);
+    state.viewport(0, 0, renderWidth, renderHeight);
+
+    // Cluster tiles were sized for the window, gl_FragCoord now only spans the rendered pixels
+    FrameData frame = packet.frame;
+    frame.clusterScale.x *= (float)gViewportWidth / renderWidth;
+    frame.clusterScale.y *= (float)gViewportHeight / renderHeight;
+
+    // Deferred shading draws the opaque pass into the G-buffer and lights it before the lamps are drawn.
+    // The G-buffer stays at the window size, scaled frames use its corner like they do the scene target's.
+    bool deferred = packet.shadingPath == ShadingPath::Deferred && gLightingProgramId != 0 &&
+        (!packet.useIndirect || gGBufferIndirectProgramId != 0);
+    if (deferred && gGBuffer.resize(gViewportWidth, gViewportHeight))
+        state.invalidate();
+
+    // Enable z-depth
+    state.enable(GL_DEPTH_TEST);
+    state.depthMask(GL_TRUE); // Clears only write depth when writes are on
+
+    // Clear background set to black
+    state.clearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    state.useProgram(gProgramId);
+
+    gFrameUniforms.update(frame);
+    gLightBuffers.update(packet.lights, packet.lightGrid, packet.lightIndices);
+    gShadowMap.bind();
+
+    // GPU-driven path: one multi-draw per texture per pass
+    if (packet.useIndirect) {
+        if (gIndirectDirty) {
+            UBuildIndirectScene();
+            gIndirectDirty = false;
+            state.invalidate();
+        }
+
+        gIndirectScene.beginFrame();
+        gIndirectScene.setVisible(packet.visible); // Object ids are node ids
+
+        if (deferred)
+            gGBuffer.beginGeometry();
+
+        state.activeTexture(GL_TEXTURE0);
+        state.bindTexture(GL_TEXTURE_2D_ARRAY, gMaterialArray); // Every material, bound once for the whole pass
 
-     // Begin Lamp A (Key Light)
-    glUseProgram(gLampProgramId); // Switch Shaders
-    glBindVertexArray(lampMeshA.vao); // Activate First Lamp Mesh
+        const IndirectUniforms& opaqueUniforms = deferred ? gGBufferIndirectUniforms : gIndirectUniforms;
+        state.useProgram(deferred ? gGBufferIndirectProgramId : gIndirectProgramId);
+        opaqueUniforms.uvScale.set(packet.uvScale);
+        opaqueUniforms.objectColor.set(packet.objectColor);
+        gIndirectScene.draw(RenderPass::Opaque, opaqueUniforms.drawBase);
 
-    model = glm::translate(gLightPositionA) * glm::scale(gLightScaleA); // Transform cube used as visual indicator
+        if (deferred)
+            ULightGBuffer(frame, sceneTarget, renderWidth, renderHeight);
 
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLampProgramId, "model");
-    viewLoc = glGetUniformLocation(gLampProgramId, "view");
-    projLoc = glGetUniformLocation(gLampProgramId, "projection");
+        state.useProgram(gLampIndirectProgramId);
+        gIndirectScene.draw(RenderPass::Lamp, gLampIndirectUniforms.drawBase);
 
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        UFinishFrame(packet, scaled, renderStart);
+        return;
+    }
+
+    // Set Uniforms (locations were cached when the program linked)
+    const ShaderProgram& opaqueProgram = deferred ? gGBufferProgramId : gProgramId;
+    const ObjectUniforms& opaqueUniforms = deferred ? gGBufferUniforms : gObjectUniforms;
+    state.useProgram(opaqueProgram);
+    opaqueUniforms.uvScale.set(packet.uvScale);
+    opaqueUniforms.objectColor.set(packet.objectColor);
 
-    glDrawArrays(GL_TRIANGLES, 0, lampMeshA.nVertices); // Drawn Visual Cube
+    // Draw Primitives with Texture and Transformations
+    // Submission order does not matter, the queue groups draws by program, texture and mesh (or by depth)
+    gRenderQueue.setOpaqueOrder(packet.opaqueOrder);
+    gRenderQueue.begin(farPlane, (GLuint)(renderWidth * renderHeight));
+
+    // One bake, once streaming is over; until then every object is drawn on its own
+    if (packet.useStaticBatching && gBatchesDirty && gMeshLoader.pendingCount() == 0) {
+        UBuildStaticBatches();
+        gBatchesDirty = false;
+        state.invalidate();
+    }
+    gBatchVisible.assign(gStaticBatches.all().size(), 0);
 
-    // Deactivate the Vertex Array Object and shader program
-    glBindVertexArray(0);
-    glUseProgram(0);
-    // END Lamp A (Key)
+    for (uint32_t index : packet.visible) {
+        if (index >= SCENE_OBJECT_COUNT) // Lamps are submitted below
+            continue;
 
-    //Begin Lamp B (Fill)
-    glUseProgram(gLampProgramId); //Activate Lamp Shader
-    glBindVertexArray(lampMeshB.vao); // Bind Mesh
+        // A batch is drawn whole when any of its objects survived culling
+        int batch = packet.useStaticBatching ? gStaticBatches.batchOf(index) : -1;
+        if (batch >= 0) {
+            gBatchVisible[batch] = 1;
+            continue;
+        }
 
-    model = glm::translate(gLightPositionB) * glm::scale(gLightScaleB); // Transform cube used as visual indicator
+        const SceneObject& object = SCENE_OBJECTS[index];
+        const GLMesh& mesh = gMeshes[*object.mesh];
+        if (mesh.vao == 0) // Skip until the loader has published it
+            continue;
+
+        DrawItem item;
+        item.pass = RenderPass::Opaque;
+        item.program = opaqueProgram;
+        item.texture = *object.texture;
+        item.vertexArray = mesh.vao;
+        item.positionVertexArray = UPositionVertexArray(mesh);
+        item.mode = GL_TRIANGLES;
+        item.indexed = mesh.nIndices > 0;
+        item.count = item.indexed ? mesh.nIndices : mesh.nVertices;
+        item.modelLocation = opaqueUniforms.model.location;
+        item.model = gRenderModels[index];
+        item.depth = -(view * item.model[3]).z;
+        gRenderQueue.submit(item);
+    }
 
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLampProgramId, "model");
-    viewLoc = glGetUniformLocation(gLampProgramId, "view");
-    projLoc = glGetUniformLocation(gLampProgramId, "projection");
+    // Static batches are already in world space
+    for (size_t i = 0; i < gBatchVisible.size(); ++i) {
+        if (!gBatchVisible[i])
+            continue;
+
+        const StaticBatcher::Batch& batch = gStaticBatches.all()[i];
+
+        DrawItem item;
+        item.pass = RenderPass::Opaque;
+        item.program = opaqueProgram;
+        item.texture = batch.material;
+        item.vertexArray = batch.mesh.vao;
+        item.positionVertexArray = UPositionVertexArray(batch.mesh);
+        item.mode = GL_TRIANGLES;
+        item.indexed = true;
+        item.count = batch.mesh.nIndices;
+        item.modelLocation = opaqueUniforms.model.location;
+        item.model = glm::mat4(1.0f);
+        item.depth = farPlane;
+        for (uint32_t node : batch.nodes) // Nearest member
+            item.depth = min(item.depth, -(view * gRenderModels[node][3]).z);
+        gRenderQueue.submit(item);
+    }
 
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    // Draw Light Sources---------------------------------------------------------------------------------------------
 
-    glDrawArrays(GL_TRIANGLES, 0, lampMeshB.nVertices); // Draw Visual Cube
+    // Lamp A (Key Light) and Lamp B (Fill Light), cubes used as visual indicators
+    const MeshHandle lampMeshes[] = { lampMeshA, lampMeshB };
+
+    for (uint32_t index : packet.visible) {
+        if (index < SCENE_OBJECT_COUNT)
+            continue;
+
+        const GLMesh& mesh = gMeshes[lampMeshes[index - LAMP_NODE_A]];
+
+        DrawItem item;
+        item.pass = RenderPass::Lamp;
+        item.program = gLampProgramId;
+        item.texture = 0;
+        item.vertexArray = UPositionVertexArray(mesh); // lamp shader only reads position
+        item.positionVertexArray = 0;
+        item.mode = GL_TRIANGLES;
+        item.indexed = false;
+        item.count = mesh.nVertices;
+        item.modelLocation = gLampUniforms.model.location;
+        item.model = gRenderModels[index];
+        item.depth = -(view * item.model[3]).z;
+        gRenderQueue.submit(item);
+    }
 
-    // Deactivate the Vertex Array Object and shader program
-    glBindVertexArray(0);
-    glUseProgram(0);
-    // END Lamp B (Fill)
+    if (deferred) {
+        gGBuffer.beginGeometry();
+        gRenderQueue.flushOpaque();
+        ULightGBuffer(frame, sceneTarget, renderWidth, renderHeight);
+        gRenderQueue.flushRemaining();
+    }
+    else {
+        gRenderQueue.flush();
+    }
 
     // END Light Sources and Primitives ----------------------------------------------------------------------------------
 
     // Call GLFW to swap buffers while checking for input
-    glfwSwapBuffers(gWindow);    // Swap Back buffer with Front buffer
+    UFinishFrame(packet, scaled, renderStart);
+}
+
+// End of a drawn frame: a scaled frame is stretched over the window, then the GPU timing closes, the render thread's
+// time is logged and the frame is presented
+void UFinishFrame(const FramePacket& packet, bool scaled, chrono::steady_clock::time_point renderStart) {
+    if (scaled) {
+        gSceneTarget.beginUpscale(gOutputFramebuffer);
+        UGLState().useProgram(gUpscaleProgramId);
+        gUpscaleUniforms.outputSize.set(glm::vec2((float)gSceneTarget.width(), (float)gSceneTarget.height()));
+        gUpscaleUniforms.sourceSize.set(glm::vec2((float)gSceneTarget.renderWidth(), (float)gSceneTarget.renderHeight()));
+        gUpscaleUniforms.sharpness.set(packet.upscaleFilter == UpscaleFilter::Sharpen ? UPSCALE_SHARPNESS : 0.0f);
+        gSceneTarget.drawFullScreen();
+    }
+
+    gGpuFrameTimer.end();
+    gTimingLog.setRender(packet.frameIndex, chrono::duration<double, milli>(chrono::steady_clock::now() - renderStart).count());
+    UPresent(packet);
+}
+
+// Deferred lighting: one full-screen pass over the G-buffer into the frame's target, width by height pixels of
+// it. Each pixel keeps its G-buffer depth, so the lamps drawn afterwards are still hidden behind the scene.
+void ULightGBuffer(const FrameData& frame, GLuint target, int width, int height) {
+    GLStateCache& state = UGLState();
+
+    gGBuffer.beginLighting(target);
+    state.useProgram(gLightingProgramId);
+    gLightingUniforms.inverseViewProjection.set(glm::inverse(frame.projection * frame.view));
+    gLightingUniforms.viewportSize.set(glm::vec2((float)width, (float)height));
+
+    state.depthFunc(GL_ALWAYS);
+    state.depthMask(GL_TRUE);
+    gGBuffer.drawFullScreen();
+    state.depthFunc(GL_LESS);
+}
+
+// Key light shadow map. The static casters are drawn only when the light camera changed or one of them did, lamp B
+// over them whenever it moved; a frame where nothing moved skips the pass entirely.
+void UUpdateShadowMap(const FramePacket& packet) {
+    if (packet.shadowProjection == ShadowProjection::Off || gShadowProgramId == 0)
+        return;
+
+    bool lampMoved = find(packet.movedNodes.begin(), packet.movedNodes.end(), LAMP_NODE_B) != packet.movedNodes.end();
+    if (!gShadowMap.begin(packet.shadowViewProjection, lampMoved))
+        return;
+
+    GLStateCache& state = UGLState();
+    state.useProgram(gShadowProgramId);
+    gShadowUniforms.shadowViewProjection.set(packet.shadowViewProjection);
+
+    // Casters only write depth, so they draw from the position stream
+    auto drawCaster = [&](const GLMesh& mesh, const glm::mat4& model) {
+        gShadowUniforms.model.set(model);
+        state.bindVertexArray(UPositionVertexArray(mesh));
+        if (mesh.nIndices > 0)
+            glDrawElements(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_INT, NULL);
+        else
+            glDrawArrays(GL_TRIANGLES, 0, mesh.nVertices);
+        gShadowMap.countDraw();
+    };
+
+    if (gShadowMap.redrawStatic()) {
+        gShadowMap.beginStatic();
+
+        // Current static batches stand in for their objects, as in the render queue
+        bool batched = !gBatchesDirty;
+        for (uint32_t index = 0; index < SCENE_OBJECT_COUNT; ++index) {
+            if (batched && gStaticBatches.batchOf(index) >= 0)
+                continue;
+
+            const GLMesh& mesh = gMeshes[*SCENE_OBJECTS[index].mesh];
+            if (mesh.vao == 0) // Not published yet, drawn once it is
+                continue;
+            drawCaster(mesh, gRenderModels[index]);
+        }
+        if (batched) {
+            for (const StaticBatcher::Batch& batch : gStaticBatches.all()) {
+                if (!batch.nodes.empty()) // Every member released
+                    drawCaster(batch.mesh, glm::mat4(1.0f));
+            }
+        }
+    }
+
+    gShadowMap.beginDynamic();
+    const GLMesh& lamp = gMeshes[lampMeshB];
+    drawCaster(lamp, gRenderModels[LAMP_NODE_B]);
+    gShadowMap.end();
+}
+
+// Forward against deferred shading on the GPU: the table drawn as a stack of overlapping layers under a growing
+// number of point lights. Forward pays for every light on every layer, deferred once per pixel.
+void UBenchmarkLighting(ostream& out) {
+    GLStateCache& state = UGLState();
+    state.invalidate();
+
+    int width = max(gFramebufferWidth, 1);
+    int height = max(gFramebufferHeight, 1);
+    state.viewport(0, 0, width, height);
+    gGBuffer.resize(width, height);
+    state.invalidate();
+
+    const float nearPlane = 0.1f;
+    const float farPlane = 100.0f;
+    FrameData frame;
+    frame.view = glm::lookAt(glm::vec3(0.0f, 7.0f, 7.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    frame.projection = glm::perspective(glm::radians(45.0f), (GLfloat)width / (GLfloat)height, nearPlane, farPlane);
+    frame.viewPosition = glm::vec4(0.0f, 7.0f, 7.0f, 1.0f);
+    frame.shadowMatrix = glm::mat4(1.0f);
+    frame.shadowParams = glm::vec4(0.0f); // Lighting cost only
+
+    const GLMesh& table = gMeshes[tableMesh];
+    const GLsizei tableCount = table.nIndices > 0 ? table.nIndices : table.nVertices;
+    auto drawTables = [&](const ObjectUniforms& uniforms, int layers) {
+        state.activeTexture(GL_TEXTURE0);
+        state.bindTexture(GL_TEXTURE_2D, darkWood);
+        state.bindVertexArray(table.vao);
+        uniforms.uvScale.set(gUVScale);
+        uniforms.objectColor.set(gObjectColor);
+        for (int layer = 0; layer < layers; ++layer) { // Bottom up, so every layer passes the depth test
+            uniforms.model.set(glm::translate(glm::vec3(0.0f, 0.05f * layer, 0.0f)) * glm::scale(glm::vec3(10.0f, 1.0f, 10.0f)));
+            if (table.nIndices > 0)
+                glDrawElements(GL_TRIANGLES, tableCount, GL_UNSIGNED_INT, NULL);
+            else
+                glDrawArrays(GL_TRIANGLES, 0, tableCount);
+        }
+    };
+
+    const bool hasDeferred = gLightingProgramId != 0;
+    out << "===== Lighting Benchmark =====\n"
+        << "Framebuffer: " << width << "x" << height << ", G-buffer " << GBuffer::BYTES_PER_PIXEL << " bytes per pixel\n"
+        << setw(10) << "Lights" << setw(10) << "Layers" << setw(14) << "Forward ms" << setw(14) << "Deferred ms" << "\n";
+
+    GLuint query;
+    glGenQueries(1, &query);
+    const int WARMUP_FRAMES = 2;
+    const int TIMED_FRAMES = 20;
+
+    // GPU time of one configuration, averaged over the timed frames
+    auto time = [&](bool deferred, int layers) {
+        GLuint64 total = 0;
+        for (int i = 0; i < WARMUP_FRAMES + TIMED_FRAMES; ++i) {
+            glBindFramebuffer(GL_FRAMEBUFFER, gOutputFramebuffer);
+            state.enable(GL_DEPTH_TEST);
+            state.depthFunc(GL_LESS);
+            state.depthMask(GL_TRUE);
+            state.colorMask(GL_TRUE);
+            state.clearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            if (deferred) {
+                gGBuffer.beginGeometry();
+                state.useProgram(gGBufferProgramId);
+                drawTables(gGBufferUniforms, layers);
+                ULightGBuffer(frame, gOutputFramebuffer, width, height);
+            }
+            else {
+                state.useProgram(gProgramId);
+                drawTables(gObjectUniforms, layers);
+            }
+            glEndQuery(GL_TIME_ELAPSED);
+
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed); // Waits for the GPU, fine outside the frame loop
+            if (i >= WARMUP_FRAMES)
+                total += elapsed;
+        }
+        return total / 1e6 / TIMED_FRAMES;
+    };
+
+    const int lightCounts[] = { 0, 64, 256, 1024 };
+    const int layerCounts[] = { 1, 4, 8 };
+    vector<LightCluster> grid;
+    vector<GLuint> indices;
+    for (int lights : lightCounts) {
+        gPointLightCount = lights;
+        UBuildLights();
+        gLightClusters.assign(gLights, frame.view, frame.projection, nearPlane, farPlane, grid, indices);
+        frame.clusterScale = gLightClusters.clusterScale(width, height);
+        frame.clusterGrid = gLightClusters.clusterGrid(gLights.size());
+        gFrameUniforms.update(frame);
+        gLightBuffers.update(gLights, grid, indices);
+
+        for (int layers : layerCounts) {
+            out << setw(10) << gLights.size() << setw(10) << layers
+                << setw(14) << fixed << setprecision(3) << time(false, layers);
+            if (hasDeferred)
+                out << setw(14) << time(true, layers);
+            out << "\n";
+        }
+    }
+    out << flush;
+
+    glDeleteQueries(1, &query);
+}
+
+// Object placement in the world: translate, then rotate. Scale is kept per node so children do not inherit it.
+glm::mat4 UObjectPlacement(const SceneObject& object) {
+    return glm::translate(object.position) *      // Change object position (Translate)
+        glm::rotate(object.angle, object.axis);    // Change object rotation
+}
+
+// Index of the scene object drawn with a mesh, TRANSFORM_NO_PARENT if there is none
+uint32_t UFindObject(const MeshHandle* mesh) {
+    for (uint32_t i = 0; i < SCENE_OBJECT_COUNT; ++i) {
+        if (SCENE_OBJECTS[i].mesh == mesh)
+            return i;
+    }
+    return TRANSFORM_NO_PARENT;
+}
+
+// One node per scene object, then the lamps. SCENE_OBJECTS places everything in world space, so an attached
+// object's local transform is its placement relative to its parent's.
+void UBuildTransforms() {
+    gTransforms.clear();
+
+    for (const SceneObject& object : SCENE_OBJECTS) {
+        uint32_t parent = TRANSFORM_NO_PARENT;
+        for (const SceneAttachment& attachment : SCENE_ATTACHMENTS) {
+            if (attachment.child == object.mesh)
+                parent = UFindObject(attachment.parent);
+        }
+
+        glm::mat4 local = UObjectPlacement(object);
+        if (parent != TRANSFORM_NO_PARENT)
+            local = glm::inverse(UObjectPlacement(SCENE_OBJECTS[parent])) * local;
+
+        gTransforms.add(local, object.scale, parent);
+    }
+
+    gTransforms.add(glm::translate(gLightPositionA), gLightScaleA);
+    gTransforms.add(glm::translate(gLightPositionB), gLightScaleB);
+    gTransforms.update();
+
+    // The render thread starts from the same placements
+    gRenderModels.resize(gTransforms.size());
+    for (uint32_t node = 0; node < (uint32_t)gTransforms.size(); ++node)
+        gRenderModels[node] = gTransforms.model(node);
+}
+
+// Description a scene mesh was built from
+const MeshDesc* UFindMeshDesc(const MeshHandle* mesh) {
+    for (const MeshDesc& desc : SCENE_MESHES) {
+        if (desc.handle == mesh)
+            return &desc;
+    }
+    return nullptr;
+}
+
+// Local box of a scene mesh, from the shape it was built as
+Bounds UMeshBounds(const MeshHandle* mesh) {
+    Bounds bounds = { glm::vec3(0.0f), glm::vec3(0.5f) }; // Pyramid and cube span -0.5 to 0.5
+
+    const MeshDesc* desc = UFindMeshDesc(mesh);
+    if (desc == nullptr)
+        return bounds;
+
+    if (desc->shape == MeshShape::Plane) {
+        bounds.extents = glm::vec3(0.5f, 0.0f, 0.5f);
+    }
+    else if (desc->shape == MeshShape::Cylinder) {
+        GLfloat radius = desc->tRad > desc->bRad ? desc->tRad : desc->bRad;
+        bounds.extents = glm::vec3(radius, radius, desc->h * 0.5f); // Centered on the z axis
+    }
+    return bounds;
+}
+
+// Local box of a transform node's mesh
+Bounds UNodeBounds(uint32_t node) {
+    if (node == LAMP_NODE_A)
+        return UMeshBounds(&lampMeshA);
+    if (node == LAMP_NODE_B)
+        return UMeshBounds(&lampMeshB);
+    return UMeshBounds(SCENE_OBJECTS[node].mesh);
+}
+
+// World boxes for every transform node. Afterwards only nodes the hierarchy recomputes are refreshed.
+void UBuildSceneBounds() {
+    gSceneBounds.clear();
+    gSceneBounds.reserve(gTransforms.size());
+
+    for (uint32_t node = 0; node < (uint32_t)gTransforms.size(); ++node)
+        gSceneBounds.add(UTransformBounds(UNodeBounds(node), gTransforms.model(node)));
+
+    // The shadow camera covers the scene objects, the lamps above them cast onto it but are not fitted
+    glm::vec3 low(numeric_limits<float>::max());
+    glm::vec3 high(-numeric_limits<float>::max());
+    for (uint32_t node = 0; node < SCENE_OBJECT_COUNT; ++node) {
+        Bounds box = UTransformBounds(UNodeBounds(node), gTransforms.model(node));
+        low = glm::min(low, box.center - box.extents);
+        high = glm::max(high, box.center + box.extents);
+    }
+    gShadowBounds.center = (low + high) * 0.5f;
+    gShadowBounds.extents = (high - low) * 0.5f;
+}
+
+// Occluder polygons for every static object flagged as an occluder, in world space.
+// Faces match UCreatePlane, UCreateCube and UCreatePyramid; cylinders are never occluders.
+void UBuildOccluders() {
+    gOcclusion.clearOccluders();
+
+    // Corners of the unit cube, faces wound around them
+    const glm::vec3 box[8] = {
+        glm::vec3(-0.5f, -0.5f,  0.5f), glm::vec3(0.5f, -0.5f,  0.5f), glm::vec3(0.5f, 0.5f,  0.5f), glm::vec3(-0.5f, 0.5f,  0.5f),
+        glm::vec3(-0.5f, -0.5f, -0.5f), glm::vec3(0.5f, -0.5f, -0.5f), glm::vec3(0.5f, 0.5f, -0.5f), glm::vec3(-0.5f, 0.5f, -0.5f)
+    };
+    const int cubeFaces[6][4] = { { 0, 1, 2, 3 }, { 5, 4, 7, 6 }, { 4, 0, 3, 7 }, { 1, 5, 6, 2 }, { 3, 2, 6, 7 }, { 4, 5, 1, 0 } };
+    const glm::vec3 apex(0.0f, 0.5f, 0.0f);
+
+    for (uint32_t i = 0; i < SCENE_OBJECT_COUNT; ++i) {
+        const MeshDesc* desc = UFindMeshDesc(SCENE_OBJECTS[i].mesh);
+        if (!SCENE_OBJECTS[i].occluder || desc == nullptr)
+            continue;
+
+        const glm::mat4& model = gTransforms.model(i);
+        auto world = [&model](const glm::vec3& local) { return glm::vec3(model * glm::vec4(local, 1.0f)); };
+
+        glm::vec3 corners[4];
+        switch (desc->shape) {
+        case MeshShape::Plane:
+            corners[0] = world(glm::vec3(-0.5f, 0.0f, 0.5f));
+            corners[1] = world(glm::vec3(0.5f, 0.0f, 0.5f));
+            corners[2] = world(glm::vec3(0.5f, 0.0f, -0.5f));
+            corners[3] = world(glm::vec3(-0.5f, 0.0f, -0.5f));
+            gOcclusion.addOccluder(corners, 4);
+            break;
+        case MeshShape::Cube:
+            for (const int* face : cubeFaces) {
+                for (int i = 0; i < 4; ++i)
+                    corners[i] = world(box[face[i]]);
+                gOcclusion.addOccluder(corners, 4);
+            }
+            break;
+        case MeshShape::Pyramid:
+            for (int i = 0; i < 4; ++i)
+                corners[i] = world(box[cubeFaces[5][i]]); // Base is the cube's bottom face
+            gOcclusion.addOccluder(corners, 4);
+            for (int i = 0; i < 4; ++i) {
+                glm::vec3 side[3] = { world(box[cubeFaces[5][i]]), world(box[cubeFaces[5][(i + 1) % 4]]), world(apex) };
+                gOcclusion.addOccluder(side, 3);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Light list: the two lamps keep their original Phong terms and reach everywhere, then point lights with a range.
+// Point lights are scattered over the table from a fixed seed, so every run lights the scene the same way.
+void UBuildLights() {
+    gLights.clear();
+
+    LightData keyLight;
+    keyLight.positionRange = glm::vec4(gLightPositionA, 0.0f);
+    keyLight.color = glm::vec4(gLightColorA, 1.0f);
+    keyLight.phong = glm::vec4(0.1f, 0.5f, 16.0f, 0.0f); // ambient strength, specular strength, highlight size
+    gLights.push_back(keyLight);
+
+    LightData fillLight;
+    fillLight.positionRange = glm::vec4(gLightPositionB, 0.0f);
+    fillLight.color = glm::vec4(gLightColorB, 1.0f);
+    fillLight.phong = glm::vec4(0.1f, 0.1f, 32.0f, 0.0f);
+    gLights.push_back(fillLight);
+
+    mt19937 random(330);
+    uniform_real_distribution<float> across(-4.5f, 4.5f);   // the table is 10 x 10 around the origin
+    uniform_real_distribution<float> height(0.2f, 1.5f);
+    uniform_real_distribution<float> range(0.75f, 2.0f);
+    uniform_real_distribution<float> channel(0.2f, 1.0f);
+
+    for (int i = 0; i < gPointLightCount; ++i) {
+        LightData light;
+        light.positionRange = glm::vec4(across(random), height(random), across(random), range(random));
+        light.color = glm::vec4(channel(random), channel(random), channel(random), 1.0f);
+        light.phong = glm::vec4(0.0f, 0.3f, 32.0f, 0.0f); // no ambient, hundreds of lights would wash the scene out
+        gLights.push_back(light);
+    }
+}
+
+// Bake every published scene object into per-texture batches. The indirect path already draws the whole
+// scene in one multi-draw per pass, so only the render queue path uses them.
+void UBuildStaticBatches() {
+    gStaticBatches.clear();
+    for (uint32_t i = 0; i < SCENE_OBJECT_COUNT; ++i)
+        gStaticBatches.add(i, *SCENE_OBJECTS[i].mesh, *SCENE_OBJECTS[i].texture);
+
+    gStaticBatches.build(gMeshes, gRenderModels);
+}
+
+// Describe the scene to the indirect path and copy all published geometry into its shared buffers.
+// Objects are added in transform node order, so node ids, culling results and object ids all line up.
+void UBuildIndirectScene() {
+    gIndirectScene.clear();
+
+    for (uint32_t i = 0; i < SCENE_OBJECT_COUNT; ++i) {
+        const SceneObject& object = SCENE_OBJECTS[i];
+        gIndirectScene.add(RenderPass::Opaque, *object.mesh, 0, gRenderModels[i], UMaterialLayer(object.texture)); // Texture comes from the material array
+    }
+
+    gIndirectScene.add(RenderPass::Lamp, lampMeshA, 0, gRenderModels[LAMP_NODE_A]);
+    gIndirectScene.add(RenderPass::Lamp, lampMeshB, 0, gRenderModels[LAMP_NODE_B]);
+
+    gIndirectScene.build(gMeshes);
 }
 
 // Define UCreateShaderProgram
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId) {
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, ShaderProgram& programId) {
     // Compilation and error reporting
     int success = 0;
     char infoLog[512];
 
     // Create Object to hold Shader Program
-    programId = glCreateProgram();
+    programId.id.create("Shader Program");
 
     // Create Two Shader Objects: Vertex Shader and Fragment Shader
     GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER); // Vertex
@@ -752,6 +2143,12 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
 
     glLinkProgram(programId);   // Link Shader Program
 
+    // Shader objects are no longer needed once linked into the program
+    glDetachShader(programId, vertexShaderId);
+    glDetachShader(programId, fragmentShaderId);
+    glDeleteShader(vertexShaderId);
+    glDeleteShader(fragmentShaderId);
+
     // Link Error Check
     glGetProgramiv(programId, GL_LINK_STATUS, &success);
     if (!success) { // Fail to link
@@ -761,6 +2158,9 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
         return false; // Error Handle
     }
 
+    // Reflect all active uniforms once so rendering never looks them up by name
+    programId.reflect();
+
     glUseProgram(programId);    // Use Shader Program
 
     return true;
@@ -770,15 +2170,145 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
 bool ULoadShaders() {
     // Create shader program
     if (!UCreateShaderProgram(objectVertexShaderSource, objectFragmentShaderSource, gProgramId)) // Error check
-        return EXIT_FAILURE; // Error Handle
+        return false; // Error Handle
 
     if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLampProgramId))
-        return EXIT_FAILURE;
+        return false;
+
+    // Both programs read camera and lighting from the same buffer, the object program also the light lists
+    gProgramId.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+    gProgramId.bindStorageBlock("LightData", LIGHT_DATA_BINDING);
+    gProgramId.bindStorageBlock("LightGrid", LIGHT_GRID_BINDING);
+    gProgramId.bindStorageBlock("LightIndices", LIGHT_INDEX_BINDING);
+    gLampProgramId.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+    gFrameUniforms.create();
+    gLightBuffers.create();
+
+    // Cache uniform handles
+    gObjectUniforms.model = gProgramId.uniform<glm::mat4>("model");
+    gObjectUniforms.uvScale = gProgramId.uniform<glm::vec2>("uvScale");
+    gObjectUniforms.objectColor = gProgramId.uniform<glm::vec3>("objectColor");
+    glUseProgram(gProgramId);
+    gProgramId.sampler("uShadowMap").set(SHADOW_MAP_UNIT);
+
+    gLampUniforms.model = gLampProgramId.uniform<glm::mat4>("model");
+
+    // Depth prepass is optional, the queue shades without it
+    if (UCreateShaderProgram(depthVertexShaderSource, depthFragmentShaderSource, gDepthProgramId)) {
+        gDepthProgramId.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+        gDepthUniforms.model = gDepthProgramId.uniform<glm::mat4>("model");
+        gRenderQueue.setDepthProgram(gDepthProgramId, gDepthUniforms.model.location);
+    }
+    else {
+        UDestroyShaderProgram(gDepthProgramId);
+        if (gOpaqueOrder == OpaqueOrder::DepthPrepass) {
+            cout << "WARNING: No depth prepass program, opaque draws are sorted by state" << endl;
+            gOpaqueOrder = OpaqueOrder::StateSorted;
+        }
+    }
+
+    // Indirect path is optional, the render queue draws the scene without it
+    if (IndirectScene::supported() &&
+        UCreateShaderProgram(objectIndirectVertexShaderSource, objectIndirectFragmentShaderSource, gIndirectProgramId) &&
+        UCreateShaderProgram(lampIndirectVertexShaderSource, lampFragmentShaderSource, gLampIndirectProgramId)) {
+
+        gIndirectProgramId.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+        gIndirectProgramId.bindStorageBlock("ObjectData", OBJECT_DATA_BINDING);
+        gIndirectProgramId.bindStorageBlock("LightData", LIGHT_DATA_BINDING);
+        gIndirectProgramId.bindStorageBlock("LightGrid", LIGHT_GRID_BINDING);
+        gIndirectProgramId.bindStorageBlock("LightIndices", LIGHT_INDEX_BINDING);
+        gLampIndirectProgramId.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+        gLampIndirectProgramId.bindStorageBlock("ObjectData", OBJECT_DATA_BINDING);
+
+        gIndirectUniforms.drawBase = gIndirectProgramId.uniform<GLuint>("drawBase");
+        gIndirectUniforms.uvScale = gIndirectProgramId.uniform<glm::vec2>("uvScale");
+        gIndirectUniforms.objectColor = gIndirectProgramId.uniform<glm::vec3>("objectColor");
+        glUseProgram(gIndirectProgramId);
+        gIndirectProgramId.sampler("uShadowMap").set(SHADOW_MAP_UNIT);
+        gLampIndirectUniforms.drawBase = gLampIndirectProgramId.uniform<GLuint>("drawBase");
+    }
+    else {
+        cout << "INFO: Multi-draw indirect unavailable, using the render queue" << endl;
+        UDestroyShaderProgram(gIndirectProgramId);
+        UDestroyShaderProgram(gLampIndirectProgramId);
+        gUseIndirect = false;
+    }
+
+    // Deferred path is optional, forward shading lights the scene without it
+    if (UCreateShaderProgram(objectVertexShaderSource, gBufferFragmentShaderSource, gGBufferProgramId) &&
+        UCreateShaderProgram(fullScreenVertexShaderSource, deferredLightingFragmentShaderSource, gLightingProgramId)) {
+
+        gGBufferProgramId.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+        gGBufferUniforms.model = gGBufferProgramId.uniform<glm::mat4>("model");
+        gGBufferUniforms.uvScale = gGBufferProgramId.uniform<glm::vec2>("uvScale");
+
+        gLightingProgramId.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+        gLightingProgramId.bindStorageBlock("LightData", LIGHT_DATA_BINDING);
+        gLightingProgramId.bindStorageBlock("LightGrid", LIGHT_GRID_BINDING);
+        gLightingProgramId.bindStorageBlock("LightIndices", LIGHT_INDEX_BINDING);
+        gLightingUniforms.inverseViewProjection = gLightingProgramId.uniform<glm::mat4>("inverseViewProjection");
+        gLightingUniforms.viewportSize = gLightingProgramId.uniform<glm::vec2>("viewportSize");
+
+        // G-buffer units never change, set once
+        glUseProgram(gLightingProgramId);
+        gLightingProgramId.sampler("uAlbedo").set(GBUFFER_ALBEDO_UNIT);
+        gLightingProgramId.sampler("uNormal").set(GBUFFER_NORMAL_UNIT);
+        gLightingProgramId.sampler("uDepth").set(GBUFFER_DEPTH_UNIT);
+        gLightingProgramId.sampler("uShadowMap").set(SHADOW_MAP_UNIT);
+        glUseProgram(0);
+
+        // Indirect geometry pass, only when the indirect path itself is available
+        if (gIndirectProgramId != 0 &&
+            UCreateShaderProgram(objectIndirectVertexShaderSource, gBufferIndirectFragmentShaderSource, gGBufferIndirectProgramId)) {
+            gGBufferIndirectProgramId.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+            gGBufferIndirectProgramId.bindStorageBlock("ObjectData", OBJECT_DATA_BINDING);
+            gGBufferIndirectUniforms.drawBase = gGBufferIndirectProgramId.uniform<GLuint>("drawBase");
+            gGBufferIndirectUniforms.uvScale = gGBufferIndirectProgramId.uniform<glm::vec2>("uvScale");
+        }
+        else {
+            UDestroyShaderProgram(gGBufferIndirectProgramId);
+        }
+    }
+    else {
+        cout << "INFO: Deferred shading unavailable, using forward shading" << endl;
+        UDestroyShaderProgram(gGBufferProgramId);
+        UDestroyShaderProgram(gLightingProgramId);
+        gShadingPath = ShadingPath::Forward;
+    }
+
+    // Shadows are optional, without them the key light reaches every surface
+    if (UCreateShaderProgram(shadowVertexShaderSource, depthFragmentShaderSource, gShadowProgramId)) {
+        gShadowUniforms.shadowViewProjection = gShadowProgramId.uniform<glm::mat4>("shadowViewProjection");
+        gShadowUniforms.model = gShadowProgramId.uniform<glm::mat4>("model");
+        gShadowMap.create(SHADOW_MAP_SIZE);
+    }
+    else {
+        cout << "INFO: Shadow mapping unavailable, the key light casts no shadows" << endl;
+        UDestroyShaderProgram(gShadowProgramId);
+        gShadowProjection = ShadowProjection::Off;
+    }
+
+    // Dynamic resolution is optional, without the upscale pass every frame renders at the window size
+    if (UCreateShaderProgram(fullScreenVertexShaderSource, upscaleFragmentShaderSource, gUpscaleProgramId)) {
+        gUpscaleUniforms.outputSize = gUpscaleProgramId.uniform<glm::vec2>("outputSize");
+        gUpscaleUniforms.sourceSize = gUpscaleProgramId.uniform<glm::vec2>("sourceSize");
+        gUpscaleUniforms.sharpness = gUpscaleProgramId.uniform<GLfloat>("sharpness");
+
+        glUseProgram(gUpscaleProgramId);
+        gUpscaleProgramId.sampler("uScene").set(0); // beginUpscale binds the scene on unit 0
+        glUseProgram(0);
+    }
+    else {
+        cout << "INFO: Dynamic resolution unavailable, rendering at the window size" << endl;
+        UDestroyShaderProgram(gUpscaleProgramId);
+    }
+
+    return true;
 }
 
 //Delete Shaders
-void UDestroyShaderProgram(GLuint programId) {
-    glDeleteProgram(programId); // Delete Shader Program
+void UDestroyShaderProgram(ShaderProgram& programId) {
+    programId.reset(); // Delete Shader Program and its reflected uniforms
 }
 
 // Images are loaded with y axis down by default, this flips to y going up
@@ -801,7 +2331,7 @@ void flipImageVertically(unsigned char* image, int width, int height, int channe
 }
 
 /*Generate the texture*/
-bool UCreateTexture(const char* filename, GLuint& textureId)
+bool UCreateTexture(const char* filename, GpuTexture& textureId, TextureArray* layers, GLuint layer)
 {
     int width, height, channels;
     unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
@@ -809,14 +2339,14 @@ bool UCreateTexture(const char* filename, GLuint& textureId)
     {
         flipImageVertically(image, width, height, channels);
 
-        glGenTextures(1, &textureId);
+        textureId.create(filename);
         glBindTexture(GL_TEXTURE_2D, textureId);
 
         // set the texture wrapping parameters
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        // set texture filtering parameters, trilinear like the material array so both draw paths sample alike
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
         if (channels == 3)
@@ -826,10 +2356,18 @@ bool UCreateTexture(const char* filename, GLuint& textureId)
         else
         {
             cout << "Not implemented to handle image with " << channels << " channels" << endl;
+            stbi_image_free(image);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            textureId.reset(); // Never given storage, nothing for the tracker to report
             return false;
         }
 
         glGenerateMipmap(GL_TEXTURE_2D);
+        textureId.setSize((size_t)width * height * channels * 4 / 3); // Base level plus mip chain
+
+        // Same pixels into the material array, decoded only once
+        if (layers != nullptr)
+            layers->setLayer(layer, image, width, height, channels);
 
         stbi_image_free(image);
         glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
@@ -843,74 +2381,61 @@ bool UCreateTexture(const char* filename, GLuint& textureId)
 
 //Load Textures
 bool ULoadTextures() {
-    // Load texture (relative to project's directory)
-    const char* texFilename = "resources/galaxyTexture.jpg";   // Texture 1
-    if (!UCreateTexture(texFilename, galTexture))
-    {
-        cout << "Failed to load texture " << texFilename << endl;
-        return EXIT_FAILURE;
+    const GLuint materialCount = sizeof(SCENE_MATERIALS) / sizeof(SCENE_MATERIALS[0]);
+
+    // Only the indirect path reads the array
+    TextureArray* layers = nullptr;
+    if (gPackMaterials && gIndirectProgramId != 0 &&
+        gMaterialArray.create(MATERIAL_LAYER_SIZE, MATERIAL_LAYER_SIZE, materialCount, "Material Array"))
+        layers = &gMaterialArray;
+
+    // Load textures (relative to project's directory)
+    bool loaded = true;
+    for (GLuint i = 0; i < materialCount; ++i) {
+        if (!UCreateTexture(SCENE_MATERIALS[i].filename, *SCENE_MATERIALS[i].texture, layers, i))
+        {
+            cout << "Failed to load texture " << SCENE_MATERIALS[i].filename << endl;
+            loaded = false;
+        }
     }
 
-    texFilename = "resources/PencilBody.jpg";   // Texture 2
-    if (!UCreateTexture(texFilename, PencilBody))
-    {
-        cout << "Failed to load texture " << texFilename << endl;
-        return EXIT_FAILURE;
+    if (layers != nullptr)
+        gMaterialArray.generateMipmaps();
+    else if (gIndirectProgramId != 0) {
+        // Without the array the indirect shaders have nothing to sample
+        cout << "INFO: Material array disabled, using the render queue" << endl;
+        UDestroyShaderProgram(gIndirectProgramId);
+        UDestroyShaderProgram(gLampIndirectProgramId);
+        gUseIndirect = false;
     }
+    // End Load Textures
 
-    texFilename = "resources/PencilCut.jpg";   // Texture 3
-    if (!UCreateTexture(texFilename, PencilCut))
-    {
-        cout << "Failed to load texture " << texFilename << endl;
-        return EXIT_FAILURE;
-    }
-    texFilename = "resources/PaperTexture.jpg";   // Texture 5
-    if (!UCreateTexture(texFilename, PaperTexture))
-    {
-        cout << "Failed to load texture " << texFilename << endl;
-        return EXIT_FAILURE;
-    }
-    texFilename = "resources/darkWood.jpg";   // Texture 6
-    if (!UCreateTexture(texFilename, darkWood))
-    {
-        cout << "Failed to load texture " << texFilename << endl;
-        return EXIT_FAILURE;
-    }
-    texFilename = "resources/Thread.jpg";   // Texture 6
-    if (!UCreateTexture(texFilename, threadTexture))
-    {
-        cout << "Failed to load texture " << texFilename << endl;
-        return EXIT_FAILURE;
-    }
-    texFilename = "resources/spoolWood.jpg";   // Texture 6
-    if (!UCreateTexture(texFilename, spoolWood))
-    {
-        cout << "Failed to load texture " << texFilename << endl;
-        return EXIT_FAILURE;
-    }
-    texFilename = "resources/lightWood.jpg";   // Texture 6
-    if (!UCreateTexture(texFilename, lightWood))
-    {
-        cout << "Failed to load texture " << texFilename << endl;
-        return EXIT_FAILURE;
-    }
-    texFilename = "resources/Glass.jpg";   // Texture 6
-    if (!UCreateTexture(texFilename, Glass))
-    {
-        cout << "Failed to load texture " << texFilename << endl;
-        return EXIT_FAILURE;
+    return loaded;
+}
+
+// Layer of a material texture in the material array. A texture missing from SCENE_MATERIALS has no layer;
+// it is reported and drawn with layer 0 rather than failing the whole scene.
+GLuint UMaterialLayer(const GpuTexture* texture) {
+    for (GLuint i = 0; i < sizeof(SCENE_MATERIALS) / sizeof(SCENE_MATERIALS[0]); ++i) {
+        if (SCENE_MATERIALS[i].texture == texture)
+            return i;
     }
-    // End Load Textures
+    cout << "ERROR::MATERIAL::UNKNOWN_TEXTURE texture " << (texture != nullptr ? texture->get() : 0)
+        << " is not in SCENE_MATERIALS, drawing it with layer 0 (" << SCENE_MATERIALS[0].filename << ")" << endl;
+    return 0;
 }
 
 //Destroy Texture Objects
-void UDestroyTexture(GLuint textureId)
+void UDestroyTexture(GpuTexture& textureId)
 {
-    glGenTextures(1, &textureId);
+    textureId.reset();
 }
 
 // Initialize GLFW, GLEW, and create window
 bool UInitialize(int argc, char* argv[], GLFWwindow** window) {
+    if (gHeadless)
+        return UInitializeHeadless();
+
     // Initialize GLFW with version info and specify core profile
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -922,7 +2447,7 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window) {
 #endif
 
     // GLFW create window
-    * window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
+    * window = glfwCreateWindow(gFramebufferWidth, gFramebufferHeight, WINDOW_TITLE, NULL, NULL);
 
     if (*window == NULL) { //Error Check
         cout << "Failed to create GLFW window" << endl; // Error Handle
@@ -932,9 +2457,15 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window) {
     // Set window to current (place on top)
     glfwMakeContextCurrent(*window);
     glfwSetFramebufferSizeCallback(*window, UResizeWindow); // Handle window size changes/ scaling
-    glfwSetCursorPosCallback(*window, UMousePositionCallback);
-    glfwSetScrollCallback(*window, UMouseScrollCallback);
-    glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
+    glfwSetWindowRefreshCallback(*window, UWindowRefreshCallback);
+
+    // A replay feeds the input callbacks from its log, live input would only disturb it
+    if (!gInputReplay.active()) {
+        glfwSetCursorPosCallback(*window, UMousePositionCallback);
+        glfwSetScrollCallback(*window, UMouseScrollCallback);
+        glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
+        glfwSetKeyCallback(*window, UKeyCallback);
+    }
 
     // tell GLFW to capture our mouse
     glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -950,6 +2481,70 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window) {
 
     cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl; // Displays GPU OpenGL version
 
+    // Window size is in screen coordinates, on high DPI displays the framebuffer is larger
+    glfwGetFramebufferSize(*window, &gFramebufferWidth, &gFramebufferHeight);
+
+    return true;
+}
+
+// Initialize an EGL context and the offscreen target standing in for the window
+bool UInitializeHeadless() {
+    if (!gHeadlessContext.create())
+        return false;
+
+    // glewInit also loads the window system's extensions, which fails without a GLX or WGL context;
+    // glewContextInit only loads OpenGL itself
+    glewExperimental = GL_TRUE;
+    GLenum GlewInitResult = glewContextInit();
+
+    if (GLEW_OK != GlewInitResult) { // Error Check
+        cerr << glewGetErrorString(GlewInitResult) << endl; // Error Handle
+        gHeadlessContext.destroy();
+        return false;
+    }
+
+    cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << " (headless)" << endl; // Displays GPU OpenGL version
+
+    gHeadlessTarget.create(gFramebufferWidth, gFramebufferHeight);
+    gOutputFramebuffer = gHeadlessTarget.target();
+    return true;
+}
+
+// Make the GL context current on the calling thread, the window's or the headless one
+void UMakeContextCurrent() {
+    if (gHeadless)
+        gHeadlessContext.makeCurrent();
+    else
+        glfwMakeContextCurrent(gWindow);
+}
+
+// Release the GL context from the calling thread, so another can take it
+void UReleaseContext() {
+    if (gHeadless)
+        gHeadlessContext.release();
+    else
+        glfwMakeContextCurrent(NULL);
+}
+
+// --size WIDTHxHEIGHT
+bool UParseSize(const char* text, int& width, int& height) {
+    int parsedWidth, parsedHeight;
+    char trailing;
+    if (sscanf(text, "%dx%d%c", &parsedWidth, &parsedHeight, &trailing) != 2 || parsedWidth <= 0 || parsedHeight <= 0)
+        return false;
+    width = parsedWidth;
+    height = parsedHeight;
+    return true;
+}
+
+// --camera x,y,z[,yaw,pitch], angles in degrees like the mouse look
+bool UParseCameraPose(const char* text, Camera& camera) {
+    float x, y, z, yaw = YAW, pitch = PITCH;
+    char trailing;
+    int count = sscanf(text, "%f,%f,%f,%f,%f%c", &x, &y, &z, &yaw, &pitch, &trailing);
+    if (count != 3 && count != 5)
+        return false;
+    camera = Camera(glm::vec3(x, y, z), glm::vec3(0.0f, 1.0f, 0.0f), yaw, pitch);
     return true;
 }
 
@@ -962,62 +2557,62 @@ void UProcessInput(GLFWwindow* window) {
     // Key Binds
     //-------------
     // Exit Program
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)          // ESC: Exit Key
+    if (UKeyPressed(window, GLFW_KEY_ESCAPE) && window != nullptr) // ESC: Exit Key (a headless replay ends with its log)
         glfwSetWindowShouldClose(window, true);
 
     // Camera Movement
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {             // W: Move Camera Forward
+    if (UKeyPressed(window, GLFW_KEY_W)) {             // W: Move Camera Forward
         gCamera.ProcessKeyboard(FORWARD, gDeltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {             // S: Move Camera Back
+    if (UKeyPressed(window, GLFW_KEY_S)) {             // S: Move Camera Back
         gCamera.ProcessKeyboard(BACKWARD, gDeltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {             // A: Move Camera Left
+    if (UKeyPressed(window, GLFW_KEY_A)) {             // A: Move Camera Left
         gCamera.ProcessKeyboard(LEFT, gDeltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {             // D: Move Camera Right
+    if (UKeyPressed(window, GLFW_KEY_D)) {             // D: Move Camera Right
         gCamera.ProcessKeyboard(RIGHT, gDeltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) {             // Q: Move Camera Down
+    if (UKeyPressed(window, GLFW_KEY_Q)) {             // Q: Move Camera Down
         gCamera.ProcessKeyboard(DOWN, gDeltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) {             // E: Move Camera Up
+    if (UKeyPressed(window, GLFW_KEY_E)) {             // E: Move Camera Up
         gCamera.ProcessKeyboard(UP, gDeltaTime);
     }
     //Change Perspective Mode
-    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS) {
+    if (UKeyPressed(window, GLFW_KEY_1)) {
         isOrtho = false;
     }
-    if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS) {
+    if (UKeyPressed(window, GLFW_KEY_2)) {
         isOrtho = true;
     }
 
     // Light Cube A Movement
         // While NOT Holding Left Shift
-    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) != GLFW_PRESS) {
-        if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {      //Down Arrow Key: Move Cube in -Y Direction
+    if (!UKeyPressed(window, GLFW_KEY_LEFT_SHIFT)) {
+        if (UKeyPressed(window, GLFW_KEY_DOWN)) {      //Down Arrow Key: Move Cube in -Y Direction
             gLightPositionA.y -= 0.1f;
         }
-        if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {        //Up Arrow Key: Move Cube in +Y Direction
+        if (UKeyPressed(window, GLFW_KEY_UP)) {        //Up Arrow Key: Move Cube in +Y Direction
             gLightPositionA.y += 0.1f;
         }
     }
     // While Holding Left Shift
-    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) {
-        if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {        //Up Arrow Key: Move Cube in +Z Direction
+    if (UKeyPressed(window, GLFW_KEY_LEFT_SHIFT)) {
+        if (UKeyPressed(window, GLFW_KEY_UP)) {        //Up Arrow Key: Move Cube in +Z Direction
             gLightPositionA.z -= 0.1f;
         }
-        if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {      //Down Arrow Key: Move Cube in -Z Direction
+        if (UKeyPressed(window, GLFW_KEY_DOWN)) {      //Down Arrow Key: Move Cube in -Z Direction
             gLightPositionA.z += 0.1f;
         }
     }
-    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {          //Left Arrow Key: Move Cube in -X Direction
+    if (UKeyPressed(window, GLFW_KEY_LEFT)) {          //Left Arrow Key: Move Cube in -X Direction
         gLightPositionA.x -= 0.1f;
     }
-    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {         //Right Arrow Key: Move Cube in +X Direction
+    if (UKeyPressed(window, GLFW_KEY_RIGHT)) {         //Right Arrow Key: Move Cube in +X Direction
         gLightPositionA.x += 0.1f;
     }
-    if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) {             // R Key: Reset Cube to Starting Position
+    if (UKeyPressed(window, GLFW_KEY_R)) {             // R Key: Reset Cube to Starting Position
         gLightPositionA.x = 0.0f;
         gLightPositionA.y = 5.0f;
         gLightPositionA.z = 5.0f;
@@ -1027,19 +2622,178 @@ void UProcessInput(GLFWwindow* window) {
         gLightPositionB.z = -5.0f;
     }
 
+    // F1: Print live GPU memory by category (once per press)
+    static bool isF1KeyDown = false;
+    bool f1Pressed = UKeyPressed(window, GLFW_KEY_F1);
+    if (f1Pressed && !isF1KeyDown) {
+        UPrintGpuResources();
+    }
+    isF1KeyDown = f1Pressed;
+
+    // F2: Print last frame's draw calls and state changes (once per press)
+    static bool isF2KeyDown = false;
+    bool f2Pressed = UKeyPressed(window, GLFW_KEY_F2);
+    if (f2Pressed && !isF2KeyDown) {
+        cout << "===== Frustum Culling =====\n" << gVisibleObjects.size() << " of " << gSceneBounds.size()
+            << " objects visible (" << (UCpuHasAVX2() ? "AVX2" : "scalar") << " kernel)" << endl;
+        if (gUseOcclusion)
+            gOcclusion.printStats(cout);
+        gLightClusters.printStats(cout);
+        cout << "===== On-Demand Rendering =====\n" << (gRenderOnDemand ? "On" : "Off") << ", frames drawn: " << gFramesDrawn
+            << ", idle waits: " << gIdleWaits << endl;
+        gPrintRenderStats = true; // Draw stats belong to the render thread, printed with the next packet
+    }
+    isF2KeyDown = f2Pressed;
+
+    // F3: Switch between the multi-draw indirect path and the render queue (once per press)
+    static bool isF3KeyDown = false;
+    bool f3Pressed = UKeyPressed(window, GLFW_KEY_F3);
+    if (f3Pressed && !isF3KeyDown && gIndirectProgramId != 0) {
+        gUseIndirect = !gUseIndirect;
+        cout << "INFO: Rendering with " << (gUseIndirect ? "multi-draw indirect" : "render queue") << endl;
+    }
+    isF3KeyDown = f3Pressed;
+
+    // F4: Toggle CPU occlusion culling (once per press)
+    static bool isF4KeyDown = false;
+    bool f4Pressed = UKeyPressed(window, GLFW_KEY_F4);
+    if (f4Pressed && !isF4KeyDown) {
+        gUseOcclusion = !gUseOcclusion;
+        cout << "INFO: Occlusion culling " << (gUseOcclusion ? "on" : "off") << endl;
+    }
+    isF4KeyDown = f4Pressed;
+
+    // F5: Toggle static batching on the render queue path (once per press)
+    static bool isF5KeyDown = false;
+    bool f5Pressed = UKeyPressed(window, GLFW_KEY_F5);
+    if (f5Pressed && !isF5KeyDown) {
+        gUseStaticBatching = !gUseStaticBatching;
+        cout << "INFO: Static batching " << (gUseStaticBatching ? "on" : "off") << endl;
+    }
+    isF5KeyDown = f5Pressed;
+
+    // F6: Cycle vsync off, on and adaptive (once per press)
+    static bool isF6KeyDown = false;
+    bool f6Pressed = UKeyPressed(window, GLFW_KEY_F6);
+    if (f6Pressed && !isF6KeyDown) {
+        gPresentMode = gPresentMode == PresentMode::Immediate ? PresentMode::Vsync
+            : gPresentMode == PresentMode::Vsync ? PresentMode::Adaptive : PresentMode::Immediate;
+        cout << "INFO: Presenting with " << UPresentModeName(gPresentMode) << endl;
+    }
+    isF6KeyDown = f6Pressed;
+
+    // F7: Cycle opaque ordering on the render queue path: state sorted, front to back, depth prepass (once per press)
+    static bool isF7KeyDown = false;
+    bool f7Pressed = UKeyPressed(window, GLFW_KEY_F7);
+    if (f7Pressed && !isF7KeyDown) {
+        gOpaqueOrder = gOpaqueOrder == OpaqueOrder::StateSorted ? OpaqueOrder::FrontToBack
+            : gOpaqueOrder == OpaqueOrder::FrontToBack && gDepthProgramId != 0 ? OpaqueOrder::DepthPrepass : OpaqueOrder::StateSorted;
+        cout << "INFO: Opaque draws " << (gOpaqueOrder == OpaqueOrder::FrontToBack ? "front to back"
+            : gOpaqueOrder == OpaqueOrder::DepthPrepass ? "after a depth prepass" : "sorted by state") << endl;
+    }
+    isF7KeyDown = f7Pressed;
+
+    // F8: Switch between forward and deferred shading (once per press)
+    static bool isF8KeyDown = false;
+    bool f8Pressed = UKeyPressed(window, GLFW_KEY_F8);
+    if (f8Pressed && !isF8KeyDown && gLightingProgramId != 0) {
+        gShadingPath = gShadingPath == ShadingPath::Forward ? ShadingPath::Deferred : ShadingPath::Forward;
+        cout << "INFO: Shading path " << UShadingPathName(gShadingPath) << endl;
+    }
+    isF8KeyDown = f8Pressed;
+
+    // F9: Cycle the key light's shadows: perspective, orthographic, off (once per press)
+    static bool isF9KeyDown = false;
+    bool f9Pressed = UKeyPressed(window, GLFW_KEY_F9);
+    if (f9Pressed && !isF9KeyDown && gShadowProgramId != 0) {
+        gShadowProjection = gShadowProjection == ShadowProjection::Perspective ? ShadowProjection::Orthographic
+            : gShadowProjection == ShadowProjection::Orthographic ? ShadowProjection::Off : ShadowProjection::Perspective;
+        cout << "INFO: Shadows " << UShadowProjectionName(gShadowProjection) << endl;
+    }
+    isF9KeyDown = f9Pressed;
+
+    // F10: Toggle dynamic resolution (once per press)
+    static bool isF10KeyDown = false;
+    bool f10Pressed = UKeyPressed(window, GLFW_KEY_F10);
+    if (f10Pressed && !isF10KeyDown && gUpscaleProgramId != 0 && gGpuBudgetMs > 0.0) {
+        gUseDynamicResolution = !gUseDynamicResolution;
+        cout << "INFO: Dynamic resolution " << (gUseDynamicResolution ? "on" : "off") << endl;
+    }
+    isF10KeyDown = f10Pressed;
+
     // Pause and resume lamp orbiting
     static bool isLKeyDown = false;
-    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS && !gIsLampOrbiting) { //L Key: Start Lighting Rotation
+    if (UKeyPressed(window, GLFW_KEY_L) && !gIsLampOrbiting) { //L Key: Start Lighting Rotation
         gIsLampOrbiting = true;
     }
-    else if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS && gIsLampOrbiting) { //K Key: Stop Lighting Rotation
+    else if (UKeyPressed(window, GLFW_KEY_K) && gIsLampOrbiting) { //K Key: Stop Lighting Rotation
         gIsLampOrbiting = false;
     }
 }
 
+// Key state for UProcessInput: the window's, or during a replay the state the recorded key events left
+bool UKeyPressed(GLFWwindow* window, int key) {
+    if (gInputReplay.active())
+        return gInputReplay.keyDown(key);
+    return glfwGetKey(window, key) == GLFW_PRESS;
+}
+
+// Replay: hand one recorded frame's events to the callbacks that received them live, and return its recorded time step.
+// Returns false when the log has no more frames.
+bool UReplayFrameInput(float& deltaTime) {
+    float time;
+    if (!gInputReplay.nextFrame(gReplayEvents, time, deltaTime))
+        return false;
+
+    for (const InputEvent& event : gReplayEvents) {
+        switch (event.type) {
+        case InputEventType::Key:
+            UKeyCallback(gWindow, event.key, event.scancode, event.action, event.mods);
+            break;
+        case InputEventType::CursorPos:
+            UMousePositionCallback(gWindow, event.x, event.y);
+            break;
+        case InputEventType::Scroll:
+            UMouseScrollCallback(gWindow, event.x, event.y);
+            break;
+        case InputEventType::MouseButton:
+            UMouseButtonCallback(gWindow, event.key, event.action, event.mods);
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+// Whether the next loop iteration has to produce a frame: input arrived, a key is held, the lamps are moving
+// or the loader still has meshes on the way
+bool UFrameNeeded() {
+    return gFrameRequested || gKeysHeld > 0 || gIsLampOrbiting || gMeshLoader.pendingCount() > 0;
+}
+
+// GLFW: Key events only wake the loop, keys themselves are polled by UProcessInput
+void UKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    gInputRecorder.key(key, scancode, action, mods);
+
+    if (action == GLFW_PRESS)
+        ++gKeysHeld;
+    else if (action == GLFW_RELEASE && gKeysHeld > 0)
+        --gKeysHeld;
+    gFrameRequested = true;
+}
+
+// GLFW: The window contents were damaged (uncovered, restored), draw them again
+void UWindowRefreshCallback(GLFWwindow* window) {
+    gFrameRequested = true;
+}
+
 //Mouse Inputs
 // GLFW: Check Mouse Position and Translate movement
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos) {
+    gInputRecorder.cursorPos(xpos, ypos);
+    gFrameRequested = true;
+
     if (gFirstMouse) {
         gLastX = xpos;
         gLastY = ypos;
@@ -1057,6 +2811,9 @@ void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos) {
 
 // GLFW: Mouse Scroll Checking
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
+    gInputRecorder.scroll(xoffset, yoffset);
+    gFrameRequested = true;
+
     // Mouse Scroll Wheel adjusts zoom, which affects speed.
     gCamera.ProcessMouseScroll(yoffset);
 }
@@ -1064,6 +2821,9 @@ void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
 // GLFW: Mouse Button Binds
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
+    gInputRecorder.mouseButton(button, action, mods);
+    gFrameRequested = true;
+
     switch (button)
     {
     case GLFW_MOUSE_BUTTON_LEFT:
@@ -1100,12 +2860,15 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 }
 
 // Call to GLFW to process window resize (by user or system)
+// Runs on the main thread; the render thread applies the new viewport with its next packet
 void UResizeWindow(GLFWwindow* window, int width, int height) {
-    glViewport(0, 0, width, height);
+    gFrameRequested = true;
+    gFramebufferWidth = width;
+    gFramebufferHeight = height;
 }
 
 // Define UCreateMesh function
-void UCreatePyramid(GLMesh& mesh) {
+void UCreatePyramid(GLMesh& mesh, bool positionStream) {
 
     // Specifies Normalized Device Coordinates (x,y,z) and color (r,g,b,a) for triangle vertices
     GLfloat verts[] = {
@@ -1155,13 +2918,13 @@ void UCreatePyramid(GLMesh& mesh) {
 
     mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
+    mesh.vao.create("Primitive VAO"); // Create the Vertex Array
     glBindVertexArray(mesh.vao);
 
     // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.vbo);
+    mesh.vbo.create("Primitive VBO");
     glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    UBufferData(mesh.vbo, GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
     // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
     GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
@@ -1175,10 +2938,16 @@ void UCreatePyramid(GLMesh& mesh) {
 
     glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
     glEnableVertexAttribArray(2);
+
+    // Optional position-only stream for passes that never read normals or UVs
+    if (positionStream) {
+        UUploadPositionBuffer(mesh, verts, mesh.nVertices);
+        UCreatePositionVertexArray(mesh);
+    }
 }
 
 // Cube
-void UCreateCube(GLMesh& mesh) {
+void UCreateCube(GLMesh& mesh, bool positionStream) {
 
     // Point Coordinates and Texture Coordinates
     GLfloat verts[] = {
@@ -1258,13 +3027,13 @@ void UCreateCube(GLMesh& mesh) {
 
     mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
+    mesh.vao.create("Primitive VAO"); // Create the Vertex Array
     glBindVertexArray(mesh.vao);
 
     // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.vbo);
+    mesh.vbo.create("Primitive VBO");
     glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    UBufferData(mesh.vbo, GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
     // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
     GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
@@ -1279,10 +3048,15 @@ void UCreateCube(GLMesh& mesh) {
     glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
     glEnableVertexAttribArray(2);
 
+    // Optional position-only stream for passes that never read normals or UVs
+    if (positionStream) {
+        UUploadPositionBuffer(mesh, verts, mesh.nVertices);
+        UCreatePositionVertexArray(mesh);
+    }
 }
 
 //Plane
-void UCreatePlane(GLMesh& mesh) {
+void UCreatePlane(GLMesh& mesh, bool positionStream) {
 
     // Point Coordinates and Texture Coordinates
     GLfloat verts[] = {
@@ -1310,12 +3084,12 @@ void UCreatePlane(GLMesh& mesh) {
 
     mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
+    mesh.vao.create("Primitive VAO"); // Create the Vertex Array
     glBindVertexArray(mesh.vao);
 
-    glGenBuffers(1, &mesh.vbo);
+    mesh.vbo.create("Primitive VBO");
     glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    UBufferData(mesh.vbo, GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
     // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
     GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
@@ -1329,56 +3103,21 @@ void UCreatePlane(GLMesh& mesh) {
 
     glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
     glEnableVertexAttribArray(2);
+
+    // Optional position-only stream for passes that never read normals or UVs
+    if (positionStream) {
+        UUploadPositionBuffer(mesh, verts, mesh.nVertices);
+        UCreatePositionVertexArray(mesh);
+    }
 }
 
-//Cylinder
+//Cylinder (synchronous path; the scene normally goes through gMeshLoader)
 void UCreateCylinder(GLMesh& mesh, GLfloat tRad, GLfloat bRad, GLfloat h, GLint slices, GLint stacks) {
 
-    GLfloat tRadius = tRad;
-    GLfloat bRadius = bRad;
-    GLfloat height = h;
-
-    GLint numSlices = slices;
-    GLint numStacks = stacks;
-
-
-    Cylinder cylinder(tRadius, bRadius, height, numSlices, numStacks);        // baseRadius, topRadius, height, slices, stacks
-
-    //cylinder.printSelf(); //Use for Debug and triangle count
-
-    mesh.nVertices = cylinder.getIVertSize() / sizeof(cylinder.getIVerts()) * (3 + 3 + 2);
-
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
-
-    glGenBuffers(1, &mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
-    glBufferData(GL_ARRAY_BUFFER, cylinder.getIVertSize(), cylinder.getIVerts(), GL_STATIC_DRAW);
-
-    // Buffer Object for Indices
-    //mesh.nIndices = sizeof(indices) / sizeof(indices[0]);
-    mesh.nIndices = cylinder.getIndexSize();
-
-    //Index data buffer
-    glGenBuffers(1, &mesh.ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo); // Activate Buffer (1)
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, cylinder.getIndexSize(), cylinder.getIndices(), GL_STATIC_DRAW); // Send index data to GPU
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, cylinder.getIStride(), 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, cylinder.getIStride(), (void*)(sizeof(float) * 3));
-    glEnableVertexAttribArray(1);
-
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, cylinder.getIStride(), (void*)(sizeof(float) * (3 + 3)));
-    glEnableVertexAttribArray(2);
-
-}
+    MeshData data;
+    UBuildCylinderData(data, tRad, bRad, h, slices, stacks);   // baseRadius, topRadius, height, slices, stacks
 
-// Mesh destruction
-void UDestroyMesh(GLMesh& mesh) {
-    glDeleteVertexArrays(1, &mesh.vao); // Delete Vertex Array
-    glDeleteBuffers(1, &mesh.vbo); // Delete Buffers
+    UUploadMeshData(mesh, data);
 }
 
 // END
\ No newline at end of file
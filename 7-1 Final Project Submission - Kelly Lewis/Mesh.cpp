@@ -0,0 +1,113 @@
+
+//Mesh Functions - CPU geometry generation and GL upload helpers
+
+#include "Mesh.h"
+#include "Cylinder.h"
+
+// Build an interleaved cylinder on the CPU
+void UBuildCylinderData(MeshData& data, GLfloat tRad, GLfloat bRad, GLfloat h, GLint slices, GLint stacks) {
+
+    Cylinder cylinder(tRad, bRad, h, slices, stacks);        // baseRadius, topRadius, height, slices, stacks
+
+    data.verts.assign(cylinder.getIVerts(), cylinder.getIVerts() + cylinder.getIVertCount() * MESH_FLOATS_PER_VERTEX);
+    data.indices.assign(cylinder.getIndices(), cylinder.getIndices() + cylinder.getIndexCount());
+    data.nVertices = cylinder.getIVertCount();
+}
+
+// Upload geometry into buffers only. Buffers are bound to GL_COPY_WRITE_BUFFER so no VAO is needed,
+// which lets the loader thread upload on its shared context.
+void UUploadMeshBuffers(GLMesh& mesh, const MeshData& data) {
+
+    UDestroyMesh(mesh);
+    mesh.nVertices = data.nVertices;
+    mesh.nIndices = (GLuint)data.indices.size();
+
+    mesh.vbo.create("Mesh VBO");
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mesh.vbo);
+    UBufferData(mesh.vbo, GL_COPY_WRITE_BUFFER, data.verts.size() * sizeof(GLfloat), data.verts.data(), GL_STATIC_DRAW); // Sends vertex data to the GPU
+
+    if (!data.indices.empty()) {
+        mesh.ibo.create("Mesh IBO");
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mesh.ibo);
+        UBufferData(mesh.ibo, GL_COPY_WRITE_BUFFER, data.indices.size() * sizeof(GLuint), data.indices.data(), GL_STATIC_DRAW); // Send index data to GPU
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (data.positionStream)
+        UUploadPositionBuffer(mesh, data.verts.data(), data.nVertices);
+}
+
+// Upload geometry and configure the vertex array on the current context
+void UUploadMeshData(GLMesh& mesh, const MeshData& data) {
+    UUploadMeshBuffers(mesh, data);
+    UCreateMeshVertexArray(mesh);
+}
+
+// Configure position (0), normal (1) and texture coordinate (2) attributes
+void UCreateMeshVertexArray(GLMesh& mesh) {
+
+    mesh.vao.create("Mesh VAO");
+    glBindVertexArray(mesh.vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+    if (mesh.ibo != 0)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo); // Index buffer is part of the VAO state
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, MESH_STRIDE, 0);
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, MESH_STRIDE, (void*)(sizeof(float) * 3));
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, MESH_STRIDE, (void*)(sizeof(float) * (3 + 3)));
+    glEnableVertexAttribArray(2);
+
+    glBindVertexArray(0);
+
+    if (mesh.posVbo != 0)
+        UCreatePositionVertexArray(mesh);
+}
+
+// De-interleave positions so position-only passes fetch 12 bytes per vertex instead of 32
+void UUploadPositionBuffer(GLMesh& mesh, const GLfloat* interleaved, GLuint nVertices) {
+
+    std::vector<GLfloat> positions(nVertices * 3);
+    for (GLuint i = 0; i < nVertices; ++i) {
+        positions[i * 3 + 0] = interleaved[i * MESH_FLOATS_PER_VERTEX + 0];
+        positions[i * 3 + 1] = interleaved[i * MESH_FLOATS_PER_VERTEX + 1];
+        positions[i * 3 + 2] = interleaved[i * MESH_FLOATS_PER_VERTEX + 2];
+    }
+
+    mesh.posVbo.create("Position Stream VBO");
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mesh.posVbo);
+    UBufferData(mesh.posVbo, GL_COPY_WRITE_BUFFER, positions.size() * sizeof(GLfloat), positions.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void UCreatePositionVertexArray(GLMesh& mesh) {
+
+    mesh.posVao.create("Position Stream VAO");
+    glBindVertexArray(mesh.posVao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.posVbo);
+    if (mesh.ibo != 0)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3, 0); // Tightly packed positions
+    glEnableVertexAttribArray(0);
+
+    glBindVertexArray(0);
+}
+
+// Mesh destruction: every buffer and vertex array, including index and position streams
+void UDestroyMesh(GLMesh& mesh) {
+    mesh.vao.reset();    // Delete Vertex Array
+    mesh.vbo.reset();    // Delete Buffers
+    mesh.ibo.reset();    // Delete Index Buffer
+    mesh.posVao.reset(); // Delete Position-only Vertex Array
+    mesh.posVbo.reset(); // Delete Position Stream
+    mesh.nVertices = 0;
+    mesh.nIndices = 0;
+}
+
+// END
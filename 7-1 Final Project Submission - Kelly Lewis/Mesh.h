@@ -0,0 +1,71 @@
+#pragma once
+
+//Mesh Header - GL mesh handles and CPU-side geometry shared by the scene and the mesh loader
+
+#ifndef GEOMETRY_MESH_H
+#define GEOMETRY_MESH_H
+
+#include <vector>
+
+#include <GL/glew.h>        // GLEW library
+
+#include "GpuResources.h"
+#include "SlotMap.h"
+
+// Struct to store GL data relative to a given mesh
+// GL objects are owned handles, so a mesh can be moved but not copied
+struct GLMesh {
+    GpuVertexArray vao; // vertex array object
+    GpuBuffer vbo;      // vertex buffer object
+    GpuBuffer ibo;      // Index buffer object
+    GLuint nVertices = 0;   // Vertices of the mesh
+    GLuint nIndices = 0;    // Indices of the mesh, 0 for non-indexed meshes
+    GpuBuffer posVbo;   // Optional tightly packed position stream (12 bytes per vertex)
+    GpuVertexArray posVao; // Position-only vertex array for depth and lamp passes
+};
+
+// Meshes are owned by a slot map and referenced by generational handle
+typedef SlotHandle MeshHandle;
+typedef SlotMap<GLMesh> MeshPool;
+
+// CPU-side geometry, interleaved as position (3), normal (3), texture coordinate (2)
+struct MeshData {
+    std::vector<GLfloat> verts;     // interleaved vertex data
+    std::vector<GLuint> indices;    // empty for non-indexed meshes
+    GLuint nVertices = 0;
+    bool positionStream = false;    // also upload a separate position-only stream
+};
+
+// Floats per interleaved vertex and the matching stride (32 bytes)
+const GLuint MESH_FLOATS_PER_VERTEX = 3 + 3 + 2;
+const GLint MESH_STRIDE = sizeof(GLfloat) * MESH_FLOATS_PER_VERTEX;
+
+// Build cylinder geometry on the CPU (safe to call from any thread, no GL calls)
+void UBuildCylinderData(MeshData& data, GLfloat tRad, GLfloat bRad, GLfloat h, GLint slices, GLint stacks);
+
+// Upload CPU geometry into vertex/index buffers on the calling thread's context (no VAO)
+void UUploadMeshBuffers(GLMesh& mesh, const MeshData& data);
+
+// Upload CPU geometry and build the VAO on the calling thread's context
+void UUploadMeshData(GLMesh& mesh, const MeshData& data);
+
+// Build the VAO for buffers that were already uploaded (VAOs are not shared between contexts)
+// Also builds the position-only VAO when the mesh carries a position stream.
+void UCreateMeshVertexArray(GLMesh& mesh);
+
+// Copy the positions out of interleaved vertex data into their own tightly packed buffer
+void UUploadPositionBuffer(GLMesh& mesh, const GLfloat* interleaved, GLuint nVertices);
+
+// Position-only VAO: attribute 0 from posVbo plus the mesh's index buffer
+void UCreatePositionVertexArray(GLMesh& mesh);
+
+// VAO to use for passes that only read position; falls back to the full VAO
+inline GLuint UPositionVertexArray(const GLMesh& mesh) {
+    return mesh.posVao != 0 ? mesh.posVao.get() : mesh.vao.get();
+}
+
+// Release every GL object held by the mesh
+void UDestroyMesh(GLMesh& mesh);
+
+#endif
+//END
@@ -0,0 +1,339 @@
+
+//Mesh Cache - writes generated meshes once, later launches map them with no parsing or copies
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>         // Output log and error
+#include <sstream>
+
+#include "MeshCache.h"
+
+using namespace std; // standard namespace
+
+namespace {
+
+    uint64_t UAlignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // Vertex format of the interleaved blob MESH_STRIDE describes: position (0), normal (1), texture coordinate (2).
+    // Unused attribute slots stay zero.
+    void UDescribeVertexFormat(uint32_t& attributeCount, MeshFileAttribute (&attributes)[MESH_FILE_MAX_ATTRIBUTES]) {
+        memset(attributes, 0, sizeof(attributes));
+        attributeCount = 3;
+        attributes[0].location = 0; attributes[0].components = 3; attributes[0].offset = 0;
+        attributes[1].location = 1; attributes[1].components = 3; attributes[1].offset = sizeof(GLfloat) * 3;
+        attributes[2].location = 2; attributes[2].components = 2; attributes[2].offset = sizeof(GLfloat) * 6;
+    }
+
+    void UMakeDirectory(const string& directory) {
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+
+    // Replace target with source in one step: readers see the old file or the new one, never neither
+    bool UReplaceFile(const string& source, const string& target) {
+#ifdef _WIN32
+        return MoveFileExA(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        return rename(source.c_str(), target.c_str()) == 0;
+#endif
+    }
+}
+
+// MappedFile ---------------------------------------------------------------------------------------------
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : bytes(nullptr), length(0), file(INVALID_HANDLE_VALUE), mapping(nullptr)
+{
+}
+
+bool MappedFile::open(const string& path)
+{
+    close();
+
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        close();
+        return false;
+    }
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == nullptr) {
+        close();
+        return false;
+    }
+
+    bytes = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (bytes == nullptr) {
+        close();
+        return false;
+    }
+
+    length = (size_t)fileSize.QuadPart;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (bytes)
+        UnmapViewOfFile(bytes);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+
+    bytes = nullptr;
+    length = 0;
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() : bytes(nullptr), length(0), file(-1)
+{
+}
+
+bool MappedFile::open(const string& path)
+{
+    close();
+
+    file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0) {
+        close();
+        return false;
+    }
+
+    void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (view == MAP_FAILED) {
+        close();
+        return false;
+    }
+
+    bytes = (const unsigned char*)view;
+    length = (size_t)info.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (bytes)
+        munmap((void*)bytes, length);
+    if (file >= 0)
+        ::close(file);
+
+    bytes = nullptr;
+    length = 0;
+    file = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+// MeshCache ----------------------------------------------------------------------------------------------
+
+MeshCache::MeshCache(const string& directory) : directory(directory)
+{
+}
+
+uint64_t MeshCache::hashBytes(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t MeshCache::cylinderKey(GLfloat tRad, GLfloat bRad, GLfloat h, GLint slices, GLint stacks)
+{
+    const char kind[] = "cylinder";
+    uint64_t key = hashBytes(kind, sizeof(kind));
+    key = hashBytes(&MESH_FILE_VERSION, sizeof(MESH_FILE_VERSION), key);
+    key = hashBytes(&tRad, sizeof(tRad), key);
+    key = hashBytes(&bRad, sizeof(bRad), key);
+    key = hashBytes(&h, sizeof(h), key);
+    key = hashBytes(&slices, sizeof(slices), key);
+    key = hashBytes(&stacks, sizeof(stacks), key);
+    return key;
+}
+
+string MeshCache::pathFor(uint64_t key) const
+{
+    ostringstream path;
+    path << directory << "/" << hex << key << ".cgvm";
+    return path.str();
+}
+
+// Returns the header if the mapped file is a complete, matching mesh file whose payload hashes to its content hash
+const MeshFileHeader* MeshCache::validate(const MappedFile& file, uint64_t key) const
+{
+    if (file.size() < sizeof(MeshFileHeader))
+        return nullptr;
+
+    const MeshFileHeader* header = (const MeshFileHeader*)file.data();
+    if (memcmp(header->magic, "CGVM", 4) != 0 || header->version != MESH_FILE_VERSION ||
+        header->headerSize != sizeof(MeshFileHeader) || header->keyHash != key ||
+        header->stride != (uint32_t)MESH_STRIDE)
+        return nullptr;
+
+    // Same stride is not enough, a reordered or resized attribute would upload stale vertices
+    uint32_t attributeCount;
+    MeshFileAttribute attributes[MESH_FILE_MAX_ATTRIBUTES];
+    UDescribeVertexFormat(attributeCount, attributes);
+    if (header->attributeCount != attributeCount || memcmp(header->attributes, attributes, sizeof(attributes)) != 0) {
+        cout << "WARNING: Mesh cache entry " << pathFor(key) << " has a different vertex format, regenerating" << endl;
+        return nullptr;
+    }
+
+    if (header->vertexOffset + header->vertexBytes > file.size() || header->indexOffset + header->indexBytes > file.size() ||
+        header->vertexBytes != (uint64_t)header->vertexCount * header->stride ||
+        header->indexBytes != (uint64_t)header->indexCount * sizeof(GLuint))
+        return nullptr;
+
+    // Every load, in every build: a damaged payload would otherwise go straight into a GL buffer
+    uint64_t hash = hashBytes(file.data() + header->vertexOffset, (size_t)header->vertexBytes);
+    hash = hashBytes(file.data() + header->indexOffset, (size_t)header->indexBytes, hash);
+    if (hash != header->contentHash) {
+        cout << "WARNING: Mesh cache entry " << pathFor(key) << " is corrupt, regenerating" << endl;
+        return nullptr;
+    }
+
+    return header;
+}
+
+bool MeshCache::upload(uint64_t key, GLMesh& mesh, bool positionStream)
+{
+    MappedFile file;
+    if (!file.open(pathFor(key)))
+        return false;
+
+    const MeshFileHeader* header = validate(file, key);
+    if (header == nullptr)
+        return false;
+
+    const unsigned char* vertices = file.data() + header->vertexOffset;
+    const unsigned char* indices = file.data() + header->indexOffset;
+
+    UDestroyMesh(mesh);
+    mesh.nVertices = header->vertexCount;
+    mesh.nIndices = header->indexCount;
+
+    // Immutable storage sourced directly from the mapped pages
+    mesh.vbo.create("Cached Mesh VBO");
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mesh.vbo);
+    UBufferStorage(mesh.vbo, GL_COPY_WRITE_BUFFER, (GLsizeiptr)header->vertexBytes, vertices, 0);
+
+    if (header->indexCount > 0) {
+        mesh.ibo.create("Cached Mesh IBO");
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mesh.ibo);
+        UBufferStorage(mesh.ibo, GL_COPY_WRITE_BUFFER, (GLsizeiptr)header->indexBytes, indices, 0);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (positionStream)
+        UUploadPositionBuffer(mesh, (const GLfloat*)vertices, mesh.nVertices);
+
+    return true;
+}
+
+bool MeshCache::read(uint64_t key, MeshData& data)
+{
+    MappedFile file;
+    if (!file.open(pathFor(key)))
+        return false;
+
+    const MeshFileHeader* header = validate(file, key);
+    if (header == nullptr)
+        return false;
+
+    const GLfloat* vertices = (const GLfloat*)(file.data() + header->vertexOffset);
+    const GLuint* indices = (const GLuint*)(file.data() + header->indexOffset);
+
+    data.verts.assign(vertices, vertices + header->vertexCount * MESH_FLOATS_PER_VERTEX);
+    data.indices.assign(indices, indices + header->indexCount);
+    data.nVertices = header->vertexCount;
+    return true;
+}
+
+bool MeshCache::write(uint64_t key, const MeshData& data)
+{
+    UMakeDirectory(directory);
+
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "CGVM", 4);
+    header.version = MESH_FILE_VERSION;
+    header.headerSize = sizeof(MeshFileHeader);
+
+    UDescribeVertexFormat(header.attributeCount, header.attributes);
+    header.stride = MESH_STRIDE;
+
+    header.vertexCount = data.nVertices;
+    header.indexCount = (uint32_t)data.indices.size();
+    header.vertexBytes = (uint64_t)data.verts.size() * sizeof(GLfloat);
+    header.indexBytes = (uint64_t)data.indices.size() * sizeof(GLuint);
+    header.vertexOffset = UAlignUp(sizeof(MeshFileHeader), MESH_FILE_ALIGNMENT);
+    header.indexOffset = UAlignUp(header.vertexOffset + header.vertexBytes, MESH_FILE_ALIGNMENT);
+    header.keyHash = key;
+    header.contentHash = hashBytes(data.verts.data(), (size_t)header.vertexBytes);
+    header.contentHash = hashBytes(data.indices.data(), (size_t)header.indexBytes, header.contentHash);
+
+    // Write to a temporary name and rename over the entry, so a crash never leaves a half-written or missing entry behind
+    string path = pathFor(key);
+    string tempPath = path + ".tmp";
+    {
+        ofstream out(tempPath, ios::binary | ios::trunc);
+        if (!out)
+            return false;
+
+        const char padding[MESH_FILE_ALIGNMENT] = {};
+        out.write((const char*)&header, sizeof(header));
+        out.write(padding, (streamsize)(header.vertexOffset - sizeof(header)));
+        out.write((const char*)data.verts.data(), (streamsize)header.vertexBytes);
+        out.write(padding, (streamsize)(header.indexOffset - header.vertexOffset - header.vertexBytes));
+        out.write((const char*)data.indices.data(), (streamsize)header.indexBytes);
+        if (!out)
+            return false;
+    }
+
+    if (!UReplaceFile(tempPath, path)) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// END
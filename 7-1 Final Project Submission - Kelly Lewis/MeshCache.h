@@ -0,0 +1,100 @@
+#pragma once
+
+//Mesh Cache Header - binary on-disk mesh container, memory mapped straight into immutable GL buffers
+
+#ifndef GEOMETRY_MESH_CACHE_H
+#define GEOMETRY_MESH_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <GL/glew.h>        // GLEW library
+
+#include "Mesh.h"
+
+// File layout: MeshFileHeader, then the vertex blob and the index blob, each aligned to MESH_FILE_ALIGNMENT
+const uint32_t MESH_FILE_VERSION = 1;
+const uint32_t MESH_FILE_ALIGNMENT = 64;
+const uint32_t MESH_FILE_MAX_ATTRIBUTES = 4;
+
+// One float vertex attribute inside the interleaved vertex blob
+struct MeshFileAttribute {
+    uint32_t location;      // shader attribute location
+    uint32_t components;    // number of GL_FLOAT components
+    uint32_t offset;        // byte offset inside a vertex
+};
+
+struct MeshFileHeader {
+    char magic[4];          // "CGVM"
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t attributeCount;
+    MeshFileAttribute attributes[MESH_FILE_MAX_ATTRIBUTES];
+    uint32_t stride;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t reserved;
+    uint64_t vertexOffset;
+    uint64_t vertexBytes;
+    uint64_t indexOffset;
+    uint64_t indexBytes;
+    uint64_t keyHash;       // hash of the generator parameters the file was built from
+    uint64_t contentHash;   // FNV-1a over the vertex and index blobs
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const unsigned char* bytes;
+    size_t length;
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int file;
+#endif
+};
+
+class MeshCache {
+public:
+    explicit MeshCache(const std::string& directory = "cache");
+
+    // Key for a generated cylinder; changes whenever a parameter or the file version changes
+    static uint64_t cylinderKey(GLfloat tRad, GLfloat bRad, GLfloat h, GLint slices, GLint stacks);
+
+    // FNV-1a 64-bit
+    static uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+    // Map the cached file and hand the mapped blobs straight to glBufferStorage (needs a current context).
+    // Header, sizes and content hash are checked first; any mismatch returns false so the caller regenerates.
+    bool upload(uint64_t key, GLMesh& mesh, bool positionStream);
+
+    // Copy the cached file into CPU geometry (for uploads done later on another context)
+    bool read(uint64_t key, MeshData& data);
+
+    // Write generated geometry to the cache
+    bool write(uint64_t key, const MeshData& data);
+
+private:
+    std::string pathFor(uint64_t key) const;
+    const MeshFileHeader* validate(const MappedFile& file, uint64_t key) const;
+
+    std::string directory;
+};
+
+#endif
+//END
@@ -0,0 +1,203 @@
+
+//Mesh Loader - background geometry generation and upload, published to the render thread through fences
+
+#include <iostream>         // Output log and error
+#include <utility>
+
+#include "MeshLoader.h"
+
+using namespace std; // standard namespace
+
+// Without a shared context the render thread uploads; cap the bytes per frame so streaming never hitches
+const size_t RENDER_THREAD_UPLOAD_BUDGET = 4 * 1024 * 1024;
+
+MeshLoader::MeshLoader() : context(nullptr), running(false), pending(0)
+{
+}
+
+MeshLoader::~MeshLoader()
+{
+    stop();
+}
+
+void MeshLoader::start(GLFWwindow* mainWindow)
+{
+    if (running)
+        return;
+
+    // GLFW windows must be created on the main thread; the worker only makes the context current.
+    // Without a window (headless) there is nothing to share with, the worker only generates.
+    if (mainWindow != nullptr) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        context = glfwCreateWindow(1, 1, "Mesh Loader", NULL, mainWindow);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+        if (context == nullptr)
+            cout << "WARNING: Mesh loader has no shared context, uploads will happen on the render thread" << endl;
+
+        glfwMakeContextCurrent(mainWindow); // Creating a window can change the current context
+    }
+
+    running = true;
+    worker = thread(&MeshLoader::run, this);
+}
+
+void MeshLoader::stop()
+{
+    if (!running)
+        return;
+
+    {
+        lock_guard<mutex> guard(lock);
+        running = false;
+        requests.clear();
+    }
+    wake.notify_all();
+    worker.join();
+
+    // Release anything the scene never picked up (buffers are freed by their handles)
+    for (Upload& upload : ready) {
+        if (upload.fence)
+            glDeleteSync(upload.fence);
+    }
+    ready.clear();
+    pending = 0;
+
+    if (context) {
+        glfwDestroyWindow(context);
+        context = nullptr;
+    }
+}
+
+void MeshLoader::requestCylinder(MeshHandle target, GLfloat tRad, GLfloat bRad, GLfloat h, GLint slices, GLint stacks, bool positionStream)
+{
+    Request request = { target, tRad, bRad, h, slices, stacks, positionStream };
+
+    {
+        lock_guard<mutex> guard(lock);
+        requests.push_back(request);
+    }
+    ++pending;
+    wake.notify_one();
+}
+
+GLuint MeshLoader::publishReady(MeshPool& meshes)
+{
+    GLuint published = 0;
+    size_t budget = RENDER_THREAD_UPLOAD_BUDGET;
+
+    while (true) {
+        Upload upload;
+        bool waitFailed = false;
+        {
+            lock_guard<mutex> guard(lock);
+            if (ready.empty())
+                break;
+
+            Upload& front = ready.front();
+            if (front.fence) {
+                // Non-blocking poll: leave it for the next frame if the GPU has not finished the copy
+                GLenum status = glClientWaitSync(front.fence, 0, 0);
+                if (status == GL_TIMEOUT_EXPIRED)
+                    break;
+                glDeleteSync(front.fence);
+                front.fence = 0;
+
+                // Only a signalled fence proves the worker's uploads landed
+                waitFailed = status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED;
+            }
+            else {
+                size_t bytes = front.data.verts.size() * sizeof(GLfloat) + front.data.indices.size() * sizeof(GLuint);
+                if (published > 0 && bytes > budget)
+                    break;
+                budget -= bytes < budget ? bytes : budget;
+            }
+
+            upload = move(front);
+            ready.pop_front();
+        }
+
+        --pending;
+
+        GLMesh* target = meshes.get(upload.request.target);
+        if (target == nullptr)
+            continue; // Mesh was unloaded before it finished; its buffers are freed with the upload
+
+        // The worker's buffers can not be trusted, build the mesh again and upload it from this thread
+        if (waitFailed) {
+            cout << "ERROR::MESH_LOADER::WAIT_FAILED upload fence could not be waited on, uploading the mesh again on the render thread" << endl;
+            const Request& request = upload.request;
+            upload.mesh = GLMesh(); // Releases the worker's buffers
+            UBuildCylinderData(upload.data, request.tRad, request.bRad, request.h, request.slices, request.stacks);
+            upload.data.positionStream = request.positionStream;
+        }
+
+        if (upload.data.verts.empty()) {
+            *target = move(upload.mesh);
+            UCreateMeshVertexArray(*target);
+        }
+        else {
+            UUploadMeshData(*target, upload.data);
+        }
+
+        ++published;
+    }
+
+    return published;
+}
+
+void MeshLoader::run()
+{
+    if (context)
+        glfwMakeContextCurrent(context);
+
+    while (true) {
+        Request request;
+        {
+            unique_lock<mutex> guard(lock);
+            wake.wait(guard, [this] { return !running || !requests.empty(); });
+            if (!running)
+                break;
+            request = requests.front();
+            requests.pop_front();
+        }
+
+        Upload upload;
+        upload.request = request;
+        upload.mesh = GLMesh();
+        upload.fence = 0;
+
+        // Cache hits skip generation entirely; misses generate once and write the cache for next launch
+        uint64_t key = MeshCache::cylinderKey(request.tRad, request.bRad, request.h, request.slices, request.stacks);
+
+        if (context) {
+            if (!cache.upload(key, upload.mesh, request.positionStream)) {
+                MeshData data;
+                UBuildCylinderData(data, request.tRad, request.bRad, request.h, request.slices, request.stacks);
+                data.positionStream = request.positionStream;
+                cache.write(key, data);
+                UUploadMeshBuffers(upload.mesh, data);
+            }
+            upload.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            if (upload.fence)
+                glFlush(); // Make the fence visible to the main context
+            else
+                glFinish(); // No fence to poll, so the uploads must be complete before the mesh is handed over
+        }
+        else {
+            if (!cache.read(key, upload.data)) {
+                UBuildCylinderData(upload.data, request.tRad, request.bRad, request.h, request.slices, request.stacks);
+                cache.write(key, upload.data);
+            }
+            upload.data.positionStream = request.positionStream;
+        }
+
+        lock_guard<mutex> guard(lock);
+        ready.push_back(move(upload));
+    }
+
+    if (context)
+        glfwMakeContextCurrent(nullptr);
+}
+
+// END
@@ -0,0 +1,72 @@
+#pragma once
+
+//Mesh Loader Header - builds and uploads geometry on a background thread with a shared GL context
+
+#ifndef GEOMETRY_MESH_LOADER_H
+#define GEOMETRY_MESH_LOADER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <GL/glew.h>        // GLEW library
+#include <GLFW/glfw3.h>     // GLFW library
+
+#include "Mesh.h"
+#include "MeshCache.h"
+
+class MeshLoader {
+public:
+    MeshLoader();
+    ~MeshLoader();
+
+    // Start the worker. Must be called on the main thread after the window exists.
+    // Falls back to CPU-only generation (upload on the render thread) if no shared context can be made,
+    // or when mainWindow is null.
+    void start(GLFWwindow* mainWindow);
+    void stop();
+
+    // Queue a cylinder for generation; the target mesh is filled in by publishReady
+    void requestCylinder(MeshHandle target, GLfloat tRad, GLfloat bRad, GLfloat h, GLint slices, GLint stacks, bool positionStream = false);
+
+    // Render thread, once per frame: hand finished meshes whose fences have signalled to the scene.
+    // A fence that fails to wait is logged and its mesh uploaded again from the render thread.
+    // Headless preloading calls it from the main thread, before the render thread takes the context.
+    // Uploads whose target was removed from the pool in the meantime are discarded.
+    GLuint publishReady(MeshPool& meshes);
+
+    GLuint pendingCount() const { return pending; }
+    bool hasSharedContext() const { return context != nullptr; }
+
+private:
+    struct Request {
+        MeshHandle target;
+        GLfloat tRad, bRad, h;
+        GLint slices, stacks;
+        bool positionStream;
+    };
+
+    struct Upload {
+        Request request;    // target mesh and parameters, rebuilt from if the fence can not be waited on
+        GLMesh mesh;        // buffers uploaded by the worker (vao is created on the render thread)
+        GLsync fence;       // signalled once the worker's uploads are complete
+        MeshData data;      // CPU geometry, only kept when there is no shared context
+    };
+
+    void run();
+
+    MeshCache cache;        // generated meshes are written once and mapped on later launches
+    GLFWwindow* context;    // hidden window owning the shared context
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<Request> requests;
+    std::deque<Upload> ready;
+    std::atomic<bool> running;
+    std::atomic<GLuint> pending;
+};
+
+#endif
+//END
@@ -0,0 +1,347 @@
+
+//Occlusion Culling - near clipping, SSE polygon rasterization into the depth buffer and box queries
+
+#include <emmintrin.h>      // SSE2, baseline on every x64 target
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+
+#include "OcclusionCulling.h"
+
+using namespace std; // standard namespace
+
+namespace {
+
+    const int TILES_X = OCCLUSION_WIDTH / OCCLUSION_TILE;
+    const int TILES_Y = OCCLUSION_HEIGHT / OCCLUSION_TILE;
+
+    static_assert(OCCLUSION_WIDTH % 4 == 0, "Rows are written 4 pixels at a time");
+    static_assert(OCCLUSION_WIDTH % OCCLUSION_TILE == 0 && OCCLUSION_HEIGHT % OCCLUSION_TILE == 0, "Tiles must cover the buffer exactly");
+
+    // Most corners a polygon can have: 4 input corners plus one from the near plane
+    const int MAX_CLIPPED_CORNERS = 5;
+
+    // First and last pixel of a span, clamped in float before converting so far off-screen points cannot overflow.
+    // A span entirely off one side comes out empty (first > last).
+    int UFirstPixel(float coordinate, int size) {
+        return coordinate <= 0.0f ? 0 : coordinate >= (float)size ? size : (int)coordinate;
+    }
+
+    int ULastPixel(float coordinate, int size) {
+        return coordinate < 0.0f ? -1 : coordinate >= (float)size ? size - 1 : (int)coordinate;
+    }
+
+    // Sutherland-Hodgman against the GL near plane (z >= -w). Returns the corner count of the result.
+    int UClipNear(const glm::vec4* in, int count, glm::vec4* out) {
+        int written = 0;
+        for (int i = 0; i < count; ++i) {
+            const glm::vec4& a = in[i];
+            const glm::vec4& b = in[(i + 1) % count];
+            float da = a.z + a.w;
+            float db = b.z + b.w;
+
+            if (da >= 0.0f)
+                out[written++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                float t = da / (da - db);
+                out[written++] = a + (b - a) * t;
+            }
+        }
+        return written;
+    }
+}
+
+OcclusionCuller::OcclusionCuller() : viewProjection(1.0f)
+{
+    depthBuffer.assign(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f);
+    tileMax.assign(TILES_X * TILES_Y, 1.0f);
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+    stop();
+}
+
+void OcclusionCuller::start(unsigned workerCount)
+{
+    // The calling thread always takes band 0, so there is never more than one band per tile row
+    bandWorkers.start(workerCount, TILES_Y - 1);
+}
+
+void OcclusionCuller::stop()
+{
+    bandWorkers.stop();
+}
+
+void OcclusionCuller::clearOccluders()
+{
+    occluderCorners.clear();
+    occluderCounts.clear();
+}
+
+void OcclusionCuller::addOccluder(const glm::vec3* corners, int count)
+{
+    if (count < 3 || count > 4)
+        return;
+
+    occluderCorners.insert(occluderCorners.end(), corners, corners + count);
+    occluderCounts.push_back(count);
+}
+
+void OcclusionCuller::render(const glm::mat4& matrix)
+{
+    auto start = chrono::high_resolution_clock::now();
+
+    lastStats = frameStats;
+    frameStats = OcclusionStats();
+    viewProjection = matrix;
+
+    // Transform, clip and set up every polygon once; the bands only read the results
+    polygons.clear();
+    size_t first = 0;
+    for (int count : occluderCounts) {
+        glm::vec4 clip[4];
+        for (int i = 0; i < count; ++i)
+            clip[i] = viewProjection * glm::vec4(occluderCorners[first + i], 1.0f);
+        first += count;
+
+        glm::vec4 clipped[MAX_CLIPPED_CORNERS];
+        int clippedCount = UClipNear(clip, count, clipped);
+        if (clippedCount >= 3)
+            setupPolygon(clipped, clippedCount);
+    }
+    frameStats.occluders = (uint32_t)polygons.size();
+
+    // Band 0 here, the rest on the workers
+    bandWorkers.run([this](unsigned band) { rasterizeBand(band); });
+
+    chrono::duration<double, micro> elapsed = chrono::high_resolution_clock::now() - start;
+    frameStats.rasterMicroseconds = elapsed.count();
+}
+
+void OcclusionCuller::setupPolygon(const glm::vec4* clip, int count)
+{
+    // Pixel coordinates with y up (matches glViewport), depth in [0, 1]
+    glm::vec3 screen[MAX_CLIPPED_CORNERS];
+    for (int i = 0; i < count; ++i) {
+        float inverseW = 1.0f / clip[i].w;
+        screen[i] = glm::vec3((clip[i].x * inverseW * 0.5f + 0.5f) * OCCLUSION_WIDTH,
+            (clip[i].y * inverseW * 0.5f + 0.5f) * OCCLUSION_HEIGHT,
+            clip[i].z * inverseW * 0.5f + 0.5f);
+    }
+
+    // Signed area gives the winding; both windings are kept so either side of a polygon occludes
+    float area = 0.0f;
+    for (int i = 0; i < count; ++i) {
+        const glm::vec3& a = screen[i];
+        const glm::vec3& b = screen[(i + 1) % count];
+        area += a.x * b.y - b.x * a.y;
+    }
+    if (fabs(area) < 1e-6f)
+        return; // Edge on
+
+    ScreenPolygon polygon;
+    polygon.edgeCount = count;
+
+    const float winding = area > 0.0f ? 1.0f : -1.0f;
+    for (int i = 0; i < count; ++i) {
+        const glm::vec3& a = screen[i];
+        const glm::vec3& b = screen[(i + 1) % count];
+        float A = (a.y - b.y) * winding;
+        float B = (b.x - a.x) * winding;
+        float C = -(A * a.x + B * a.y);
+
+        // Move the edge inward by half a pixel's extent along its normal, so only fully covered pixels pass
+        polygon.edgeA[i] = A;
+        polygon.edgeB[i] = B;
+        polygon.edgeC[i] = C - 0.5f * (fabs(A) + fabs(B));
+    }
+
+    // Depth plane through the fan triangle with the largest area, the best conditioned one
+    float bestDeterminant = 0.0f;
+    int best = 1;
+    for (int i = 1; i + 1 < count; ++i) {
+        float determinant = (screen[i].x - screen[0].x) * (screen[i + 1].y - screen[0].y) -
+            (screen[i + 1].x - screen[0].x) * (screen[i].y - screen[0].y);
+        if (fabs(determinant) > fabs(bestDeterminant)) {
+            bestDeterminant = determinant;
+            best = i;
+        }
+    }
+
+    const glm::vec3& p0 = screen[0];
+    const glm::vec3& p1 = screen[best];
+    const glm::vec3& p2 = screen[best + 1];
+    float dzdx = ((p1.z - p0.z) * (p2.y - p0.y) - (p2.z - p0.z) * (p1.y - p0.y)) / bestDeterminant;
+    float dzdy = ((p1.x - p0.x) * (p2.z - p0.z) - (p2.x - p0.x) * (p1.z - p0.z)) / bestDeterminant;
+
+    // Evaluated at pixel centers; add half a pixel of slope to get the farthest depth inside the pixel
+    polygon.depthX = dzdx;
+    polygon.depthY = dzdy;
+    polygon.depthZ = p0.z - dzdx * p0.x - dzdy * p0.y + 0.5f * (fabs(dzdx) + fabs(dzdy));
+
+    float minX = screen[0].x, maxX = screen[0].x, minY = screen[0].y, maxY = screen[0].y;
+    for (int i = 1; i < count; ++i) {
+        minX = min(minX, screen[i].x);
+        maxX = max(maxX, screen[i].x);
+        minY = min(minY, screen[i].y);
+        maxY = max(maxY, screen[i].y);
+    }
+
+    polygon.minX = UFirstPixel(minX, OCCLUSION_WIDTH);
+    polygon.minY = UFirstPixel(minY, OCCLUSION_HEIGHT);
+    polygon.maxX = ULastPixel(maxX, OCCLUSION_WIDTH);
+    polygon.maxY = ULastPixel(maxY, OCCLUSION_HEIGHT);
+    if (polygon.minX > polygon.maxX || polygon.minY > polygon.maxY)
+        return; // Off screen
+
+    polygons.push_back(polygon);
+}
+
+void OcclusionCuller::rasterizeBand(unsigned band)
+{
+    const unsigned bands = bandWorkers.bandCount();
+    const int firstTileRow = (int)(band * TILES_Y / bands);
+    const int lastTileRow = (int)((band + 1) * TILES_Y / bands);
+    const int firstRow = firstTileRow * OCCLUSION_TILE;
+    const int lastRow = lastTileRow * OCCLUSION_TILE;   // exclusive
+
+    fill(depthBuffer.begin() + firstRow * OCCLUSION_WIDTH, depthBuffer.begin() + lastRow * OCCLUSION_WIDTH, 1.0f);
+
+    const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (const ScreenPolygon& polygon : polygons) {
+        int y0 = max(polygon.minY, firstRow);
+        int y1 = min(polygon.maxY, lastRow - 1);
+        if (y0 > y1)
+            continue;
+
+        __m128 edgeA[6];
+        for (int e = 0; e < polygon.edgeCount; ++e)
+            edgeA[e] = _mm_set1_ps(polygon.edgeA[e]);
+        const __m128 depthX = _mm_set1_ps(polygon.depthX);
+        const int x0 = polygon.minX & ~3;
+
+        for (int y = y0; y <= y1; ++y) {
+            const float centerY = y + 0.5f;
+
+            // Row constants: everything but the x term
+            __m128 edgeRow[6];
+            for (int e = 0; e < polygon.edgeCount; ++e)
+                edgeRow[e] = _mm_set1_ps(polygon.edgeB[e] * centerY + polygon.edgeC[e]);
+            const __m128 depthRow = _mm_set1_ps(polygon.depthY * centerY + polygon.depthZ);
+
+            float* row = &depthBuffer[y * OCCLUSION_WIDTH];
+            for (int x = x0; x <= polygon.maxX; x += 4) {
+                __m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+
+                __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], centerX), edgeRow[0]), zero);
+                for (int e = 1; e < polygon.edgeCount; ++e)
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[e], centerX), edgeRow[e]), zero));
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+
+                // Keep the nearer depth where covered (SSE2 has no blend, select with and / andnot)
+                __m128 current = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_min_ps(current, _mm_add_ps(_mm_mul_ps(depthX, centerX), depthRow));
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+            }
+        }
+    }
+
+    // Farthest depth per tile
+    for (int tileY = firstTileRow; tileY < lastTileRow; ++tileY) {
+        for (int tileX = 0; tileX < TILES_X; ++tileX) {
+            __m128 farthest = zero;
+            for (int y = 0; y < OCCLUSION_TILE; ++y) {
+                const float* row = &depthBuffer[(tileY * OCCLUSION_TILE + y) * OCCLUSION_WIDTH + tileX * OCCLUSION_TILE];
+                for (int x = 0; x < OCCLUSION_TILE; x += 4)
+                    farthest = _mm_max_ps(farthest, _mm_loadu_ps(row + x));
+            }
+
+            float lanes[4];
+            _mm_storeu_ps(lanes, farthest);
+            tileMax[tileY * TILES_X + tileX] = max(max(lanes[0], lanes[1]), max(lanes[2], lanes[3]));
+        }
+    }
+}
+
+bool OcclusionCuller::visible(const Bounds& box) const
+{
+    // Project the corners; a box reaching the near plane is always visible
+    float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+    float nearest = 1.0f;
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec3 offset((corner & 1) ? box.extents.x : -box.extents.x,
+            (corner & 2) ? box.extents.y : -box.extents.y,
+            (corner & 4) ? box.extents.z : -box.extents.z);
+        glm::vec4 clip = viewProjection * glm::vec4(box.center + offset, 1.0f);
+        if (clip.w <= 1e-6f || clip.z < -clip.w)
+            return true;
+
+        float inverseW = 1.0f / clip.w;
+        float x = (clip.x * inverseW * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+        float y = (clip.y * inverseW * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+        minX = min(minX, x);
+        maxX = max(maxX, x);
+        minY = min(minY, y);
+        maxY = max(maxY, y);
+        nearest = min(nearest, clip.z * inverseW * 0.5f + 0.5f);
+    }
+
+    // Every pixel the projected box touches
+    int x0 = UFirstPixel(minX, OCCLUSION_WIDTH);
+    int y0 = UFirstPixel(minY, OCCLUSION_HEIGHT);
+    int x1 = ULastPixel(maxX, OCCLUSION_WIDTH);
+    int y1 = ULastPixel(maxY, OCCLUSION_HEIGHT);
+    if (x0 > x1 || y0 > y1)
+        return false; // Entirely off screen
+
+    for (int tileY = y0 / OCCLUSION_TILE; tileY <= y1 / OCCLUSION_TILE; ++tileY) {
+        for (int tileX = x0 / OCCLUSION_TILE; tileX <= x1 / OCCLUSION_TILE; ++tileX) {
+            if (nearest > tileMax[tileY * TILES_X + tileX])
+                continue; // The whole tile is covered by something nearer
+
+            int rowStart = max(y0, tileY * OCCLUSION_TILE);
+            int rowEnd = min(y1, tileY * OCCLUSION_TILE + OCCLUSION_TILE - 1);
+            int columnStart = max(x0, tileX * OCCLUSION_TILE);
+            int columnEnd = min(x1, tileX * OCCLUSION_TILE + OCCLUSION_TILE - 1);
+            for (int y = rowStart; y <= rowEnd; ++y) {
+                const float* row = &depthBuffer[y * OCCLUSION_WIDTH];
+                for (int x = columnStart; x <= columnEnd; ++x) {
+                    if (nearest <= row[x])
+                        return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+void OcclusionCuller::filter(const BoundsTable& bounds, vector<uint32_t>& indices)
+{
+    size_t kept = 0;
+    for (uint32_t index : indices) {
+        Bounds box = { glm::vec3(bounds.centerX[index], bounds.centerY[index], bounds.centerZ[index]),
+            glm::vec3(bounds.extentX[index], bounds.extentY[index], bounds.extentZ[index]) };
+
+        ++frameStats.tested;
+        if (visible(box))
+            indices[kept++] = index;
+        else
+            ++frameStats.occluded;
+    }
+    indices.resize(kept);
+}
+
+void OcclusionCuller::printStats(ostream& out) const
+{
+    out << "===== Occlusion Culling =====\n"
+        << "Occluders: " << lastStats.occluders << ", tested: " << lastStats.tested << ", occluded: " << lastStats.occluded
+        << ", raster: " << fixed << setprecision(1) << lastStats.rasterMicroseconds << " us on " << bandWorkers.bandCount() << " threads" << endl;
+}
+
+// END
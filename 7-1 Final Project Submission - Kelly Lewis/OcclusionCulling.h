@@ -0,0 +1,89 @@
+#pragma once
+
+//Occlusion Culling Header - occluders rasterized on the CPU into a small depth buffer, boxes tested against it
+
+#ifndef OCCLUSION_CULLING_H
+#define OCCLUSION_CULLING_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "BandWorkers.h"
+#include "FrustumCulling.h"
+
+// Depth buffer dimensions. Width is a multiple of 4 (one SSE register), both are multiples of the tile size.
+const int OCCLUSION_WIDTH = 256;
+const int OCCLUSION_HEIGHT = 192;
+const int OCCLUSION_TILE = 8;
+
+// Last frame's work
+struct OcclusionStats {
+    uint32_t occluders = 0;     // polygons rasterized after near clipping
+    uint32_t tested = 0;
+    uint32_t occluded = 0;
+    double rasterMicroseconds = 0.0;
+};
+
+// Conservative software occlusion. Occluder polygons only claim pixels they cover completely, at the farthest
+// depth they reach inside the pixel, so a box is never rejected while any part of it could be seen.
+// The screen is split into bands of tile rows; each band is cleared, rasterized and reduced by its own thread.
+class OcclusionCuller {
+public:
+    OcclusionCuller();
+    ~OcclusionCuller();
+
+    // Start worker threads (0 picks one per spare core, at most 3). Without workers render() runs on the caller.
+    void start(unsigned workerCount = 0);
+    void stop();
+
+    // Static occluders in world space: convex, planar polygons of 3 to 4 corners. Both sides are rasterized.
+    void clearOccluders();
+    void addOccluder(const glm::vec3* corners, int count);
+
+    // Rasterize every occluder as seen through viewProjection. Nothing is read back from the GPU.
+    void render(const glm::mat4& viewProjection);
+
+    // True if any part of the box may be in front of the occluders drawn by the last render()
+    bool visible(const Bounds& box) const;
+
+    // Remove occluded entries from a list of indices into bounds
+    void filter(const BoundsTable& bounds, std::vector<uint32_t>& indices);
+
+    // Depth at a pixel in [0, 1], 1 where no occluder was drawn
+    float depth(int x, int y) const { return depthBuffer[y * OCCLUSION_WIDTH + x]; }
+
+    const OcclusionStats& stats() const { return lastStats; }
+    void printStats(std::ostream& out) const;
+
+private:
+    // Occluder after projection: inward edge equations and a depth plane in pixel coordinates
+    struct ScreenPolygon {
+        int edgeCount;
+        float edgeA[6], edgeB[6], edgeC[6];     // inside when A * x + B * y + C >= 0 at the pixel center
+        float depthX, depthY, depthZ;           // farthest depth in the pixel = depthX * x + depthY * y + depthZ
+        int minX, minY, maxX, maxY;
+    };
+
+    void setupPolygon(const glm::vec4* clip, int count);
+    void rasterizeBand(unsigned band);
+
+    std::vector<glm::vec3> occluderCorners;
+    std::vector<int> occluderCounts;
+
+    glm::mat4 viewProjection;
+    std::vector<ScreenPolygon> polygons;
+    std::vector<float> depthBuffer;
+    std::vector<float> tileMax;     // farthest depth in each tile, rejects whole tiles at once
+
+    BandWorkers bandWorkers;
+
+    OcclusionStats frameStats;
+    OcclusionStats lastStats;
+};
+
+#endif
+//END
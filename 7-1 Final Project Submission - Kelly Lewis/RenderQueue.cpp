@@ -0,0 +1,290 @@
+
+//Render Queue - LSD radix sort on 64-bit state keys, replay with redundant state elided
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+
+#include "RenderQueue.h"
+#include "GLStateCache.h"
+
+using namespace std; // standard namespace
+
+namespace {
+    const int PASS_BITS = 4;
+    const int PROGRAM_BITS = 8;
+    const int TEXTURE_BITS = 12;
+    const int VERTEX_ARRAY_BITS = 16;
+    const int DEPTH_BITS = 24;
+
+    static_assert(PASS_BITS + PROGRAM_BITS + TEXTURE_BITS + VERTEX_ARRAY_BITS + DEPTH_BITS == 64, "Sort key must use all 64 bits");
+
+    uint64_t UField(uint64_t value, int bits, int shift) {
+        return (value & ((1ull << bits) - 1)) << shift;
+    }
+}
+
+bool UParseOpaqueOrder(const char* name, OpaqueOrder& order)
+{
+    if (strcmp(name, "sorted") == 0)
+        order = OpaqueOrder::StateSorted;
+    else if (strcmp(name, "front-to-back") == 0)
+        order = OpaqueOrder::FrontToBack;
+    else if (strcmp(name, "prepass") == 0)
+        order = OpaqueOrder::DepthPrepass;
+    else
+        return false;
+    return true;
+}
+
+void RenderQueue::begin(GLfloat farPlane, GLuint pixels)
+{
+    this->farPlane = farPlane;
+    this->pixels = pixels;
+    items.clear();
+    keys.clear();
+}
+
+void RenderQueue::submit(const DrawItem& item)
+{
+    items.push_back(item);
+    keys.push_back(makeKey(item, farPlane, opaqueOrder == OpaqueOrder::FrontToBack && item.pass == RenderPass::Opaque));
+}
+
+void RenderQueue::setDepthProgram(GLuint program, GLint modelLocation)
+{
+    depthProgram = program;
+    depthModelLocation = modelLocation;
+}
+
+uint64_t RenderQueue::makeKey(const DrawItem& item, GLfloat farPlane, bool frontToBack)
+{
+    const uint64_t depthMax = (1ull << DEPTH_BITS) - 1;
+    GLfloat normalized = farPlane > 0.0f ? item.depth / farPlane : 0.0f;
+    normalized = min(max(normalized, 0.0f), 1.0f);
+    uint64_t depth = (uint64_t)(normalized * depthMax);
+
+    int shift = 0;
+    uint64_t key = 0;
+    if (!frontToBack) {
+        key |= UField(depth, DEPTH_BITS, shift);
+        shift += DEPTH_BITS;
+    }
+    key |= UField(item.vertexArray, VERTEX_ARRAY_BITS, shift);
+    shift += VERTEX_ARRAY_BITS;
+    key |= UField(item.texture, TEXTURE_BITS, shift);
+    shift += TEXTURE_BITS;
+    key |= UField(item.program, PROGRAM_BITS, shift);
+    shift += PROGRAM_BITS;
+    if (frontToBack) {
+        key |= UField(depth, DEPTH_BITS, shift);
+        shift += DEPTH_BITS;
+    }
+    key |= UField((uint64_t)item.pass, PASS_BITS, shift);
+    return key;
+}
+
+// Eight stable counting passes, one per key byte. Bytes that are equal across every key are skipped,
+// which is most of them in a small scene.
+void RenderQueue::sortKeys()
+{
+    const size_t n = keys.size();
+    order.resize(n);
+    scratch.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        order[i] = (uint32_t)i;
+
+    for (int byte = 0; byte < 8; ++byte) {
+        const int shift = byte * 8;
+
+        size_t counts[256] = {};
+        for (size_t i = 0; i < n; ++i)
+            ++counts[(keys[i] >> shift) & 0xFF];
+
+        // Every key has the same byte here, the pass would not move anything
+        if (n == 0 || counts[(keys[0] >> shift) & 0xFF] == n)
+            continue;
+
+        size_t offset = 0;
+        for (int bucket = 0; bucket < 256; ++bucket) {
+            size_t count = counts[bucket];
+            counts[bucket] = offset;
+            offset += count;
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t index = order[i];
+            scratch[counts[(keys[index] >> shift) & 0xFF]++] = index;
+        }
+        order.swap(scratch);
+    }
+}
+
+void RenderQueue::flush()
+{
+    flushOpaque();
+    flushRemaining();
+}
+
+void RenderQueue::flushOpaque()
+{
+    sortKeys();
+
+    flushStats = RenderQueueStats();
+    flushStats.items = (GLuint)items.size();
+    flushStats.pixels = pixels;
+    readSamples(flushStats);
+
+    // Opaque items sort ahead of every other pass
+    opaqueEnd = 0;
+    while (opaqueEnd < order.size() && items[order[opaqueEnd]].pass == RenderPass::Opaque)
+        ++opaqueEnd;
+
+    bool depthPrepass = opaqueOrder == OpaqueOrder::DepthPrepass && depthProgram != 0 && opaqueEnd > 0;
+    if (depthPrepass) {
+        prepass(0, opaqueEnd, flushStats);
+
+        // Only the nearest surface at each pixel passes now
+        UGLState().depthFunc(GL_EQUAL);
+        UGLState().depthMask(GL_FALSE);
+    }
+
+    UGLState().activeTexture(GL_TEXTURE0);
+
+    GLuint query = sampleQueries[frameIndex & 1];
+    if (query == 0) {
+        glGenQueries(1, &query);
+        sampleQueries[frameIndex & 1] = query;
+    }
+    glBeginQuery(GL_SAMPLES_PASSED, query);
+    replay(0, opaqueEnd, flushStats);
+    glEndQuery(GL_SAMPLES_PASSED);
+    sampleQueryIssued[frameIndex & 1] = true;
+    ++frameIndex;
+
+    UGLState().depthFunc(GL_LESS);
+    UGLState().depthMask(GL_TRUE);
+}
+
+void RenderQueue::flushRemaining()
+{
+    replay(opaqueEnd, order.size(), flushStats);
+
+    lastStats = flushStats;
+}
+
+void RenderQueue::replay(size_t begin, size_t end, RenderQueueStats& stats)
+{
+    GLStateCache& state = UGLState();
+
+    for (size_t i = begin; i < end; ++i) {
+        const DrawItem& item = items[order[i]];
+
+        if (state.useProgram(item.program))
+            ++stats.programBinds;
+        else
+            ++stats.elidedBinds;
+
+        if (item.texture != 0) {
+            if (state.bindTexture(GL_TEXTURE_2D, item.texture))
+                ++stats.textureBinds;
+            else
+                ++stats.elidedBinds;
+        }
+
+        if (state.bindVertexArray(item.vertexArray))
+            ++stats.vertexArrayBinds;
+        else
+            ++stats.elidedBinds;
+
+        if (item.modelLocation >= 0)
+            glUniformMatrix4fv(item.modelLocation, 1, GL_FALSE, &item.model[0][0]);
+
+        if (item.indexed)
+            glDrawElements(item.mode, item.count, GL_UNSIGNED_INT, (void*)0);
+        else
+            glDrawArrays(item.mode, 0, item.count);
+        ++stats.drawCalls;
+    }
+}
+
+// Depth only, no color writes. Textures do not matter here, so only vertex array changes are bound.
+void RenderQueue::prepass(size_t begin, size_t end, RenderQueueStats& stats)
+{
+    GLStateCache& state = UGLState();
+
+    state.colorMask(GL_FALSE);
+    state.depthFunc(GL_LESS);
+    state.depthMask(GL_TRUE);
+    if (state.useProgram(depthProgram))
+        ++stats.programBinds;
+
+    for (size_t i = begin; i < end; ++i) {
+        const DrawItem& item = items[order[i]];
+        GLuint vertexArray = item.positionVertexArray != 0 ? item.positionVertexArray : item.vertexArray;
+
+        if (state.bindVertexArray(vertexArray))
+            ++stats.vertexArrayBinds;
+        else
+            ++stats.elidedBinds;
+
+        if (depthModelLocation >= 0)
+            glUniformMatrix4fv(depthModelLocation, 1, GL_FALSE, &item.model[0][0]);
+
+        if (item.indexed)
+            glDrawElements(item.mode, item.count, GL_UNSIGNED_INT, (void*)0);
+        else
+            glDrawArrays(item.mode, 0, item.count);
+        ++stats.prepassDrawCalls;
+    }
+
+    state.colorMask(GL_TRUE);
+}
+
+// Last frame's query, if the GPU has finished it. Never waits; a late result is simply skipped.
+void RenderQueue::readSamples(RenderQueueStats& stats)
+{
+    unsigned previous = (frameIndex + 1) & 1;
+    if (sampleQueryIssued[previous]) {
+        GLint available = 0;
+        glGetQueryObjectiv(sampleQueries[previous], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            glGetQueryObjectui64v(sampleQueries[previous], GL_QUERY_RESULT, &lastSamples);
+            sampleQueryIssued[previous] = false;
+        }
+    }
+    stats.shadedSamples = lastSamples;
+}
+
+void RenderQueue::reset()
+{
+    for (GLuint& query : sampleQueries) {
+        if (query != 0)
+            glDeleteQueries(1, &query);
+        query = 0;
+    }
+    sampleQueryIssued[0] = sampleQueryIssued[1] = false;
+    frameIndex = 0;
+    lastSamples = 0;
+    lastStats = RenderQueueStats();
+}
+
+void RenderQueue::printStats(ostream& out) const
+{
+    out << "===== Render Queue =====\n"
+        << "Items: " << lastStats.items << ", draw calls: " << lastStats.drawCalls << "\n"
+        << "State changes: " << lastStats.stateChanges()
+        << " (programs " << lastStats.programBinds
+        << ", textures " << lastStats.textureBinds
+        << ", vertex arrays " << lastStats.vertexArrayBinds << ")\n"
+        << "Elided binds: " << lastStats.elidedBinds << "\n"
+        << "Opaque order: " << (opaqueOrder == OpaqueOrder::FrontToBack ? "front to back"
+            : opaqueOrder == OpaqueOrder::DepthPrepass ? "depth prepass" : "state sorted")
+        << ", prepass draw calls: " << lastStats.prepassDrawCalls << "\n"
+        << "Shaded opaque fragments: " << lastStats.shadedSamples;
+    if (lastStats.pixels > 0)
+        out << " (" << fixed << setprecision(2) << (double)lastStats.shadedSamples / lastStats.pixels << " per pixel)";
+    out << endl;
+}
+
+// END
@@ -0,0 +1,127 @@
+#pragma once
+
+//Render Queue Header - draw items sorted by packed state key and replayed with redundant binds skipped
+
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include <GL/glew.h>        // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+// Passes run in this order, each one fully before the next
+enum class RenderPass : uint8_t {
+    Opaque = 0,
+    Lamp = 1
+};
+
+// How opaque draws are ordered, and whether their depth is laid down first
+enum class OpaqueOrder : uint8_t {
+    StateSorted = 0,    // grouped by program, texture and mesh; depth only orders draws within a group
+    FrontToBack = 1,    // nearest first so early-Z rejects hidden fragments, at the cost of more binds
+    DepthPrepass = 2    // depth-only pass, then shading with GL_EQUAL so each pixel is shaded once
+};
+
+bool UParseOpaqueOrder(const char* name, OpaqueOrder& order);   // "sorted", "front-to-back" or "prepass"
+
+// One draw call and the state it needs
+struct DrawItem {
+    RenderPass pass;
+    GLuint program;
+    GLuint texture;         // GL_TEXTURE_2D on unit 0, 0 for none
+    GLuint vertexArray;
+    GLuint positionVertexArray; // position-only stream for the depth prepass, 0 to use vertexArray
+    GLenum mode;            // primitive type
+    GLsizei count;          // vertices for glDrawArrays, indices for glDrawElements
+    bool indexed;           // GL_UNSIGNED_INT indices from the vertex array's element buffer
+    GLint modelLocation;    // model matrix uniform in program, -1 for none
+    glm::mat4 model;
+    GLfloat depth;          // view space distance, nearer items draw first within a state group
+};
+
+// State changes made while replaying a frame
+struct RenderQueueStats {
+    GLuint items = 0;
+    GLuint drawCalls = 0;
+    GLuint programBinds = 0;
+    GLuint textureBinds = 0;
+    GLuint vertexArrayBinds = 0;
+    GLuint elidedBinds = 0;     // binds skipped because the state was already current
+    GLuint prepassDrawCalls = 0;
+    GLuint64 shadedSamples = 0; // opaque fragments that passed the depth test in the shading pass (previous frame)
+    GLuint pixels = 0;          // viewport area, shadedSamples / pixels is the overdraw
+
+    GLuint stateChanges() const { return programBinds + textureBinds + vertexArrayBinds; }
+};
+
+// Sort key, most significant first:
+//  pass (4) | program (8) | texture (12) | vertex array (16) | depth (24)
+// Front-to-back opaque draws move depth up instead:
+//  pass (4) | depth (24) | program (8) | texture (12) | vertex array (16)
+// GL names are truncated to their field. A collision only weakens grouping, replay still compares real state.
+class RenderQueue {
+public:
+    // Depth is normalized against farPlane before it is quantized into the key.
+    // pixels is the viewport area, only used to report overdraw.
+    void begin(GLfloat farPlane, GLuint pixels = 0);
+    void submit(const DrawItem& item);
+
+    // Sort, then issue every item through UGLState(), which skips binds that are already current. Leaves depth
+    // state as GL_LESS with writes on; program, texture and vertex array stay bound.
+    void flush();
+
+    // flush() in two halves, for work that has to run between the opaque pass and the rest (deferred lighting).
+    // Depth state is GL_LESS with writes on after either half.
+    void flushOpaque();
+    void flushRemaining();
+
+    void setOpaqueOrder(OpaqueOrder order) { opaqueOrder = order; }
+    OpaqueOrder getOpaqueOrder() const { return opaqueOrder; }
+
+    // Program for the depth prepass. It reads position at location 0, takes the model at modelLocation and must
+    // compute an invariant gl_Position exactly as the shading programs do. Without one the prepass is skipped.
+    void setDepthProgram(GLuint program, GLint modelLocation);
+
+    const RenderQueueStats& stats() const { return lastStats; }
+    void printStats(std::ostream& out) const;
+
+    // Release the fragment count queries
+    void reset();
+
+    static uint64_t makeKey(const DrawItem& item, GLfloat farPlane, bool frontToBack = false);
+
+private:
+    void sortKeys();
+    void replay(size_t begin, size_t end, RenderQueueStats& stats);
+    void prepass(size_t begin, size_t end, RenderQueueStats& stats);
+    void readSamples(RenderQueueStats& stats);
+
+    OpaqueOrder opaqueOrder = OpaqueOrder::StateSorted;
+    GLuint depthProgram = 0;
+    GLint depthModelLocation = -1;
+
+    // GL_SAMPLES_PASSED around the opaque shading pass. Two queries alternate so a result is only read once
+    // the GPU has had a frame to produce it.
+    GLuint sampleQueries[2] = { 0, 0 };
+    bool sampleQueryIssued[2] = { false, false };
+    unsigned frameIndex = 0;
+    GLuint64 lastSamples = 0;
+
+    GLfloat farPlane = 100.0f;
+    GLuint pixels = 0;
+    size_t opaqueEnd = 0;               // order index past the last opaque item, set by flushOpaque()
+    RenderQueueStats flushStats;        // counts of the flush in progress
+    std::vector<DrawItem> items;
+    std::vector<uint64_t> keys;         // key per item
+    std::vector<uint32_t> order;        // item indices, sorted by key
+    std::vector<uint32_t> scratch;      // radix sort ping-pong buffer
+    RenderQueueStats lastStats;
+};
+
+#endif
+//END
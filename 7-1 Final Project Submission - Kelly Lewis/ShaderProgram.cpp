@@ -0,0 +1,87 @@
+
+//Shader Program - reflection of active uniforms after link
+
+#include <iostream>         // Output log and error
+#include <vector>
+
+#include "ShaderProgram.h"
+
+using namespace std; // standard namespace
+
+void ShaderProgram::reflect()
+{
+    uniforms.clear();
+
+    GLint count = 0;
+    glGetProgramInterfaceiv(id, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+
+    const GLenum properties[] = { GL_NAME_LENGTH, GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE, GL_BLOCK_INDEX };
+    const GLsizei propertyCount = sizeof(properties) / sizeof(properties[0]);
+
+    vector<char> name;
+    for (GLint i = 0; i < count; ++i) {
+        GLint values[propertyCount];
+        glGetProgramResourceiv(id, GL_UNIFORM, i, propertyCount, properties, propertyCount, NULL, values);
+
+        // Members of uniform blocks have no location of their own
+        if (values[4] != -1)
+            continue;
+
+        name.resize(values[0]);
+        glGetProgramResourceName(id, GL_UNIFORM, i, values[0], NULL, name.data());
+
+        string key(name.data());
+        if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0)
+            key.resize(key.size() - 3); // Arrays are reported as "name[0]"
+
+        UniformInfo info = { values[2], (GLenum)values[1], values[3] };
+        uniforms[key] = info;
+    }
+}
+
+Uniform<GLint> ShaderProgram::sampler(const char* name) const
+{
+    Uniform<GLint> handle;
+    const UniformInfo* info = find(name);
+    if (info != nullptr)
+        handle.location = info->location;
+    return handle;
+}
+
+bool ShaderProgram::bindUniformBlock(const char* name, GLuint binding) const
+{
+    GLuint blockIndex = glGetUniformBlockIndex(id, name);
+    if (blockIndex == GL_INVALID_INDEX)
+        return false;
+
+    glUniformBlockBinding(id, blockIndex, binding);
+    return true;
+}
+
+bool ShaderProgram::bindStorageBlock(const char* name, GLuint binding) const
+{
+    GLuint blockIndex = glGetProgramResourceIndex(id, GL_SHADER_STORAGE_BLOCK, name);
+    if (blockIndex == GL_INVALID_INDEX)
+        return false;
+
+    glShaderStorageBlockBinding(id, blockIndex, binding);
+    return true;
+}
+
+const ShaderProgram::UniformInfo* ShaderProgram::find(const char* name) const
+{
+    auto found = uniforms.find(name);
+    return found != uniforms.end() ? &found->second : nullptr;
+}
+
+bool ShaderProgram::checkType(const char* name, GLenum actual, GLenum expected) const
+{
+    if (actual == expected)
+        return true;
+
+    cout << "ERROR::SHADER::UNIFORM::TYPE_MISMATCH '" << name << "' (GL type 0x" << hex << actual
+        << ", expected 0x" << expected << ")" << dec << endl;
+    return false;
+}
+
+// END
@@ -0,0 +1,99 @@
+#pragma once
+
+//Shader Program Header - linked program with uniforms reflected once at link time
+
+#ifndef SHADER_PROGRAM_H
+#define SHADER_PROGRAM_H
+
+#include <string>
+#include <unordered_map>
+
+#include <GL/glew.h>        // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GpuResources.h"
+
+// GL type enum for each C++ type a uniform can be set from
+template <class T> struct UniformType;
+template <> struct UniformType<GLint>     { static const GLenum value = GL_INT; };
+template <> struct UniformType<GLuint>    { static const GLenum value = GL_UNSIGNED_INT; };
+template <> struct UniformType<GLfloat>   { static const GLenum value = GL_FLOAT; };
+template <> struct UniformType<glm::vec2> { static const GLenum value = GL_FLOAT_VEC2; };
+template <> struct UniformType<glm::vec3> { static const GLenum value = GL_FLOAT_VEC3; };
+template <> struct UniformType<glm::vec4> { static const GLenum value = GL_FLOAT_VEC4; };
+template <> struct UniformType<glm::mat4> { static const GLenum value = GL_FLOAT_MAT4; };
+
+// Cached, typed uniform location. Setting an inactive uniform (location -1) is a no-op.
+// Like glUniform*, set() writes to the currently bound program.
+template <class T>
+struct Uniform {
+    GLint location = -1;
+
+    bool active() const { return location >= 0; }
+    void set(const T& value) const;
+};
+
+template <> inline void Uniform<GLint>::set(const GLint& value) const { glUniform1i(location, value); }
+template <> inline void Uniform<GLuint>::set(const GLuint& value) const { glUniform1ui(location, value); }
+template <> inline void Uniform<GLfloat>::set(const GLfloat& value) const { glUniform1f(location, value); }
+template <> inline void Uniform<glm::vec2>::set(const glm::vec2& value) const { glUniform2fv(location, 1, glm::value_ptr(value)); }
+template <> inline void Uniform<glm::vec3>::set(const glm::vec3& value) const { glUniform3fv(location, 1, glm::value_ptr(value)); }
+template <> inline void Uniform<glm::vec4>::set(const glm::vec4& value) const { glUniform4fv(location, 1, glm::value_ptr(value)); }
+template <> inline void Uniform<glm::mat4>::set(const glm::mat4& value) const { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+
+class ShaderProgram {
+public:
+    GpuProgram id;
+
+    // Query every active uniform once (glGetProgramInterfaceiv / glGetProgramResourceiv). Call after linking.
+    void reflect();
+
+    // Look up a reflected uniform by name. Intended for load time only, never per frame.
+    // Returns an inactive handle if the uniform was optimized out or its type does not match T.
+    template <class T>
+    Uniform<T> uniform(const char* name) const
+    {
+        Uniform<T> handle;
+        const UniformInfo* info = find(name);
+        if (info != nullptr && checkType(name, info->type, UniformType<T>::value))
+            handle.location = info->location;
+        return handle;
+    }
+
+    // Sampler and other GL_INT-backed uniforms (sampler types reflect as GL_SAMPLER_*)
+    Uniform<GLint> sampler(const char* name) const;
+
+    // Points a uniform block at a buffer binding point. Returns false if the program has no such block.
+    bool bindUniformBlock(const char* name, GLuint binding) const;
+
+    // Same for a shader storage block
+    bool bindStorageBlock(const char* name, GLuint binding) const;
+
+    size_t activeUniformCount() const { return uniforms.size(); }
+
+    void reset()
+    {
+        id.reset();
+        uniforms.clear();
+    }
+
+    operator GLuint() const { return id; }
+
+private:
+    struct UniformInfo {
+        GLint location;
+        GLenum type;
+        GLint arraySize;
+    };
+
+    const UniformInfo* find(const char* name) const;
+    bool checkType(const char* name, GLenum actual, GLenum expected) const;
+
+    std::unordered_map<std::string, UniformInfo> uniforms;
+};
+
+#endif
+//END
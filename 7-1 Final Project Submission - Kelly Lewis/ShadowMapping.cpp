@@ -0,0 +1,254 @@
+
+//Shadow Mapping - shadow camera fitting and the cached static / composited dynamic depth maps
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#include <glm/gtx/transform.hpp>
+
+#include "ShadowMapping.h"
+#include "GLStateCache.h"
+
+using namespace std; // standard namespace
+
+namespace {
+
+    // Scene corners beside or behind the lamp would need an unbounded frustum; the map stops at about 75 degrees
+    // off the lamp's axis, points further out are left unshadowed
+    const float MAX_SLOPE = 3.7f;
+    const float MIN_NEAR_PLANE = 0.1f;
+
+    void UBoxCorners(const Bounds& box, glm::vec3 corners[8]) {
+        for (int i = 0; i < 8; ++i) {
+            corners[i] = box.center + glm::vec3(i & 1 ? box.extents.x : -box.extents.x,
+                i & 2 ? box.extents.y : -box.extents.y,
+                i & 4 ? box.extents.z : -box.extents.z);
+        }
+    }
+
+    // Any up vector that is not parallel to the view direction
+    glm::mat4 ULightView(const glm::vec3& eye, const glm::vec3& target) {
+        glm::vec3 forward = glm::normalize(target - eye);
+        glm::vec3 up = fabs(forward.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        return glm::lookAt(eye, target, up);
+    }
+}
+
+const char* UShadowProjectionName(ShadowProjection projection)
+{
+    switch (projection) {
+    case ShadowProjection::Off:          return "off";
+    case ShadowProjection::Perspective:  return "perspective";
+    case ShadowProjection::Orthographic: return "orthographic";
+    }
+    return "unknown";
+}
+
+bool UParseShadowProjection(const char* name, ShadowProjection& projection)
+{
+    if (strcmp(name, "off") == 0)
+        projection = ShadowProjection::Off;
+    else if (strcmp(name, "perspective") == 0)
+        projection = ShadowProjection::Perspective;
+    else if (strcmp(name, "ortho") == 0)
+        projection = ShadowProjection::Orthographic;
+    else
+        return false;
+    return true;
+}
+
+glm::mat4 UFitShadowCamera(ShadowProjection projection, const glm::vec3& lightPosition, const Bounds& scene)
+{
+    glm::vec3 corners[8];
+    UBoxCorners(scene, corners);
+
+    glm::vec3 target = scene.center;
+    if (glm::length(target - lightPosition) < 1e-4f)
+        target = lightPosition - glm::vec3(0.0f, 1.0f, 0.0f); // Lamp at the centre, look down
+
+    if (projection == ShadowProjection::Orthographic) {
+        // Eye backed off to the box's bounding sphere, so every corner is in front of it
+        glm::vec3 direction = glm::normalize(target - lightPosition);
+        float radius = glm::length(scene.extents);
+        glm::mat4 view = ULightView(target - direction * radius, target);
+
+        glm::vec3 low(numeric_limits<float>::max());
+        glm::vec3 high(-numeric_limits<float>::max());
+        for (const glm::vec3& corner : corners) {
+            glm::vec3 p = glm::vec3(view * glm::vec4(corner, 1.0f));
+            low = glm::min(low, p);
+            high = glm::max(high, p);
+        }
+        return glm::ortho(low.x, high.x, low.y, high.y, max(-high.z, 0.0f), -low.z) * view;
+    }
+
+    // Perspective: off-centre frustum through the corners' extreme slopes, near and far at their depth range
+    glm::mat4 view = ULightView(lightPosition, target);
+    float left = MAX_SLOPE, right = -MAX_SLOPE, bottom = MAX_SLOPE, top = -MAX_SLOPE;
+    float nearest = numeric_limits<float>::max();
+    float farthest = 0.0f;
+    for (const glm::vec3& corner : corners) {
+        glm::vec3 p = glm::vec3(view * glm::vec4(corner, 1.0f));
+        float depth = -p.z;
+        float safeDepth = max(depth, 1e-3f);
+        float slopeX = glm::clamp(p.x / safeDepth, -MAX_SLOPE, MAX_SLOPE);
+        float slopeY = glm::clamp(p.y / safeDepth, -MAX_SLOPE, MAX_SLOPE);
+        left = min(left, slopeX);
+        right = max(right, slopeX);
+        bottom = min(bottom, slopeY);
+        top = max(top, slopeY);
+        nearest = min(nearest, depth);
+        farthest = max(farthest, depth);
+    }
+
+    float nearPlane = max(nearest, MIN_NEAR_PLANE);
+    float farPlane = max(farthest, nearPlane * 2.0f);
+    return glm::frustum(left * nearPlane, right * nearPlane, bottom * nearPlane, top * nearPlane, nearPlane, farPlane) * view;
+}
+
+glm::mat4 UShadowTextureMatrix(const glm::mat4& lightViewProjection)
+{
+    return glm::translate(glm::vec3(0.5f)) * glm::scale(glm::vec3(0.5f)) * lightViewProjection;
+}
+
+void ShadowMap::create(int size)
+{
+    reset();
+    mapSize = size;
+    createTarget(staticDepth, staticFramebuffer, "Shadow map (static casters)", false);
+    createTarget(depth, framebuffer, "Shadow map", true);
+    staticValid = false;
+}
+
+void ShadowMap::createTarget(GpuTexture& texture, GLuint& target, const char* label, bool compare)
+{
+    texture.create(label);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, mapSize, mapSize);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    const GLfloat border[] = { 1.0f, 1.0f, 1.0f, 1.0f }; // Outside the map nothing is in front
+    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+    if (compare) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    texture.setSize((size_t)mapSize * mapSize * 4);
+
+    glGenFramebuffers(1, &target);
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        cout << "ERROR::SHADOW_MAP::INCOMPLETE " << label << endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ShadowMap::reset()
+{
+    if (staticFramebuffer != 0) {
+        glDeleteFramebuffers(1, &staticFramebuffer);
+        staticFramebuffer = 0;
+    }
+    if (framebuffer != 0) {
+        glDeleteFramebuffers(1, &framebuffer);
+        framebuffer = 0;
+    }
+    staticDepth.reset();
+    depth.reset();
+    mapSize = 0;
+    staticValid = false;
+}
+
+bool ShadowMap::begin(const glm::mat4& lightViewProjection, bool dynamicCastersMoved)
+{
+    if (lightViewProjection != cachedViewProjection) {
+        cachedViewProjection = lightViewProjection;
+        staticValid = false;
+    }
+
+    if (staticValid && !dynamicCastersMoved) {
+        ++totals.cachedFrames;
+        return false;
+    }
+    return true;
+}
+
+void ShadowMap::beginPass(GLuint target)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+
+    GLStateCache& state = UGLState();
+    state.viewport(0, 0, mapSize, mapSize);
+    state.enable(GL_DEPTH_TEST);
+    state.depthFunc(GL_LESS);
+    state.depthMask(GL_TRUE);
+    state.enable(GL_DEPTH_CLAMP);
+    state.enable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+    draws = 0;
+}
+
+void ShadowMap::beginStatic()
+{
+    beginPass(staticFramebuffer);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    inStaticPass = true;
+    ++totals.staticRedraws;
+}
+
+void ShadowMap::beginDynamic()
+{
+    if (inStaticPass) {
+        totals.staticDraws = draws;
+        inStaticPass = false;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+    glBlitFramebuffer(0, 0, mapSize, mapSize, 0, 0, mapSize, mapSize, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    beginPass(framebuffer);
+    ++totals.dynamicRedraws;
+}
+
+void ShadowMap::end()
+{
+    totals.dynamicDraws = draws;
+    staticValid = true;
+
+    GLStateCache& state = UGLState();
+    state.disable(GL_DEPTH_CLAMP);
+    state.disable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ShadowMap::bind()
+{
+    GLStateCache& state = UGLState();
+    state.activeTexture(GL_TEXTURE0 + SHADOW_MAP_UNIT);
+    state.bindTexture(GL_TEXTURE_2D, depth);
+    state.activeTexture(GL_TEXTURE0);
+}
+
+void ShadowMap::printStats(ostream& out) const
+{
+    uint64_t frames = totals.dynamicRedraws + totals.cachedFrames; // Every redraw ends with the composite
+    out << "===== Shadow Map =====\n"
+        << "Size: " << mapSize << "x" << mapSize << ", static redraws: " << totals.staticRedraws
+        << " (" << totals.staticDraws << " draws), dynamic composites: " << totals.dynamicRedraws
+        << " (" << totals.dynamicDraws << " draws)\n"
+        << "Frames reusing the map: " << totals.cachedFrames;
+    if (frames > 0)
+        out << " (" << totals.cachedFrames * 100 / frames << "%)";
+    out << endl;
+}
+
+// END
@@ -0,0 +1,123 @@
+#pragma once
+
+//Shadow Mapping Header - key light shadow map, cached for static casters and redrawn only when something moved
+
+#ifndef SHADOW_MAPPING_H
+#define SHADOW_MAPPING_H
+
+#include <cstdint>
+#include <ostream>
+
+#include <GL/glew.h>        // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "FrustumCulling.h"
+#include "GpuResources.h"
+
+// How the key light's shadow camera projects the scene
+enum class ShadowProjection {
+    Off,            // no shadow map, the key light reaches everything
+    Perspective,    // point light: frustum from the lamp, fitted around the scene box
+    Orthographic    // the lamp treated as a directional light aimed at the scene centre
+};
+
+const char* UShadowProjectionName(ShadowProjection projection);
+bool UParseShadowProjection(const char* name, ShadowProjection& projection);   // "off", "perspective" or "ortho"
+
+// Light view-projection whose frustum just encloses the scene box as seen from the lamp. Only changes when the
+// lamp or the box does, so an unchanged matrix means the cached map is still valid.
+glm::mat4 UFitShadowCamera(ShadowProjection projection, const glm::vec3& lightPosition, const Bounds& scene);
+
+// Light view-projection followed by the [-1, 1] to [0, 1] remap, for FrameData::shadowMatrix
+glm::mat4 UShadowTextureMatrix(const glm::mat4& lightViewProjection);
+
+// Texture unit the lit shaders sample the shadow map from (0 is the material, 1-3 the G-buffer)
+const GLuint SHADOW_MAP_UNIT = 4;
+const int SHADOW_MAP_SIZE = 2048;
+const float SHADOW_NORMAL_OFFSET = 0.02f;  // world units a receiver is pushed along its normal before the lookup
+
+// GLSL lookup, pasted after FRAME_DATA_BLOCK. Returns how much of the light reaches the point: 1 for every light
+// but the shadowed one, and for points outside the shadow camera. Hardware 2x2 PCF through the compare sampler.
+#define SHADOW_BLOCK \
+    "uniform sampler2DShadow uShadowMap;\n" \
+    "float lightShadow(uint lightIndex, vec3 worldPos, vec3 norm) {\n" \
+    "    if (shadowParams.x == 0.0 || lightIndex != uint(shadowParams.z))\n" \
+    "        return 1.0;\n" \
+    "    vec4 shadowPos = shadowMatrix * vec4(worldPos + norm * shadowParams.y, 1.0);\n" \
+    "    if (shadowPos.w <= 0.0)\n" \
+    "        return 1.0;\n" \
+    "    vec3 coord = shadowPos.xyz / shadowPos.w;\n" \
+    "    if (coord.z >= 1.0)\n" \
+    "        return 1.0;\n" \
+    "    return textureLod(uShadowMap, coord, 0.0);\n" \
+    "}\n"
+
+// Counted since start-up
+struct ShadowMapStats {
+    uint64_t staticRedraws = 0;     // frames that drew the static casters again
+    uint64_t dynamicRedraws = 0;    // frames that composited the dynamic casters over the cache
+    uint64_t cachedFrames = 0;      // frames that drew nothing
+    uint32_t staticDraws = 0;       // draw calls of the last static redraw
+    uint32_t dynamicDraws = 0;      // draw calls of the last dynamic redraw
+};
+
+// Two depth maps: the static casters, kept until the light camera changes or a static caster does, and the map
+// the shaders sample, which is the static map with the dynamic casters drawn over it. A frame where neither the
+// lamp nor any caster moved does no shadow work at all.
+class ShadowMap {
+public:
+    ~ShadowMap() { reset(); }
+
+    void create(int size);
+    void reset();
+
+    // A static caster moved, or appeared: draw them all again on the next update
+    void invalidateStatic() { staticValid = false; }
+
+    // Decide this frame's work. Returns false when the sampled map is current and nothing needs drawing.
+    bool begin(const glm::mat4& lightViewProjection, bool dynamicCastersMoved);
+
+    // After begin() returned true: whether the static casters need drawing first
+    bool redrawStatic() const { return !staticValid; }
+
+    // Clear the static map and draw into it. Depth clamp pancakes casters in front of the near plane, the
+    // polygon offset keeps lit surfaces from shadowing themselves.
+    void beginStatic();
+
+    // Copy the static map into the sampled one and draw over it
+    void beginDynamic();
+
+    // Back to the default framebuffer with the usual raster state. Callers restore the viewport.
+    void end();
+
+    // Bind the sampled map on SHADOW_MAP_UNIT
+    void bind();
+
+    void countDraw() { ++draws; }
+
+    int size() const { return mapSize; }
+    const ShadowMapStats& stats() const { return totals; }
+    void printStats(std::ostream& out) const;
+
+private:
+    void createTarget(GpuTexture& texture, GLuint& target, const char* label, bool compare);
+    void beginPass(GLuint target);
+
+    GpuTexture staticDepth;
+    GpuTexture depth;
+    GLuint staticFramebuffer = 0;
+    GLuint framebuffer = 0;
+    int mapSize = 0;
+
+    glm::mat4 cachedViewProjection = glm::mat4(0.0f);
+    bool staticValid = false;
+    bool inStaticPass = false;
+    uint32_t draws = 0;
+
+    ShadowMapStats totals;
+};
+
+#endif
+//END
@@ -0,0 +1,140 @@
+#pragma once
+
+//Slot Map Header - generational handles over densely packed storage
+
+#ifndef SLOT_MAP_H
+#define SLOT_MAP_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Handle into a SlotMap. A handle stays valid until its element is removed; after that the
+// slot's generation no longer matches and lookups fail instead of returning another element.
+struct SlotHandle {
+    uint32_t index = 0;
+    uint32_t generation = 0;    // 0 is never issued, so a default handle is always invalid
+
+    bool operator==(const SlotHandle& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const SlotHandle& other) const { return !(*this == other); }
+};
+
+// O(1) insert, remove and lookup. Elements live contiguously in insertion/swap order so
+// iteration is a linear walk; removal moves the last element into the hole.
+template <class T>
+class SlotMap {
+public:
+    typedef typename std::vector<T>::iterator iterator;
+    typedef typename std::vector<T>::const_iterator const_iterator;
+
+    void reserve(size_t count)
+    {
+        dense.reserve(count);
+        denseToSlot.reserve(count);
+        slots.reserve(count);
+    }
+
+    SlotHandle insert(T&& value)
+    {
+        uint32_t slotIndex;
+        if (freeHead != NO_SLOT) {
+            slotIndex = freeHead;
+            freeHead = slots[slotIndex].denseIndex; // free slots chain through denseIndex
+        }
+        else {
+            slotIndex = (uint32_t)slots.size();
+            Slot slot = { 0, 1 };
+            slots.push_back(slot);
+        }
+
+        slots[slotIndex].denseIndex = (uint32_t)dense.size();
+        dense.push_back(std::move(value));
+        denseToSlot.push_back(slotIndex);
+
+        SlotHandle handle;
+        handle.index = slotIndex;
+        handle.generation = slots[slotIndex].generation;
+        return handle;
+    }
+
+    bool remove(SlotHandle handle)
+    {
+        if (!contains(handle))
+            return false;
+
+        Slot& slot = slots[handle.index];
+        uint32_t hole = slot.denseIndex;
+        uint32_t last = (uint32_t)dense.size() - 1;
+
+        if (hole != last) {
+            dense[hole] = std::move(dense[last]);
+            denseToSlot[hole] = denseToSlot[last];
+            slots[denseToSlot[hole]].denseIndex = hole;
+        }
+        dense.pop_back();
+        denseToSlot.pop_back();
+
+        // Retire the handle and push the slot onto the free list
+        if (++slot.generation == 0)
+            slot.generation = 1;
+        slot.denseIndex = freeHead;
+        freeHead = handle.index;
+        return true;
+    }
+
+    bool contains(SlotHandle handle) const
+    {
+        return handle.index < slots.size() && handle.generation != 0 &&
+            slots[handle.index].generation == handle.generation;
+    }
+
+    T* get(SlotHandle handle) { return contains(handle) ? &dense[slots[handle.index].denseIndex] : nullptr; }
+    const T* get(SlotHandle handle) const { return contains(handle) ? &dense[slots[handle.index].denseIndex] : nullptr; }
+
+    T& operator[](SlotHandle handle) { assert(contains(handle)); return dense[slots[handle.index].denseIndex]; }
+    const T& operator[](SlotHandle handle) const { assert(contains(handle)); return dense[slots[handle.index].denseIndex]; }
+
+    // Handle of the element at a dense position, for loops that need to remove while iterating
+    SlotHandle handleAt(size_t denseIndex) const
+    {
+        SlotHandle handle;
+        handle.index = denseToSlot[denseIndex];
+        handle.generation = slots[handle.index].generation;
+        return handle;
+    }
+
+    void clear()
+    {
+        while (!dense.empty())
+            remove(handleAt(dense.size() - 1));
+    }
+
+    size_t size() const { return dense.size(); }
+    bool empty() const { return dense.empty(); }
+
+    T* data() { return dense.data(); }
+    const T* data() const { return dense.data(); }
+
+    iterator begin() { return dense.begin(); }
+    iterator end() { return dense.end(); }
+    const_iterator begin() const { return dense.begin(); }
+    const_iterator end() const { return dense.end(); }
+
+private:
+    struct Slot {
+        uint32_t denseIndex;    // position in dense, or next free slot while unused
+        uint32_t generation;
+    };
+
+    static const uint32_t NO_SLOT = 0xFFFFFFFFu;
+
+    std::vector<T> dense;
+    std::vector<uint32_t> denseToSlot;
+    std::vector<Slot> slots;
+    uint32_t freeHead = NO_SLOT;
+};
+
+#endif
+//END
@@ -0,0 +1,108 @@
+#pragma once
+
+//SPSC Ring Header - fixed slots handed from one producer thread to one consumer thread
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+// Single producer, single consumer ring of N slots that are filled and read in place, so slot contents (and the
+// capacity of any vectors in them) are reused every lap. The handoff is two atomic counters; the mutex and
+// condition variable are only touched when a side has to sleep because the ring is full or empty.
+template <class T, size_t N>
+class SpscRing {
+public:
+    // Producer: the next free slot, waiting while every slot is published or being read. nullptr once closed.
+    T* beginWrite()
+    {
+        size_t write = tail.load();
+        if (!wait([this, write] { return write - head.load() < N; }))
+            return nullptr;
+        return &slots[write % N];
+    }
+
+    // Producer: publish the slot returned by beginWrite()
+    void endWrite()
+    {
+        tail.store(tail.load() + 1);
+        wakeSleepers();
+    }
+
+    // Consumer: the oldest published slot, waiting while there is none. nullptr once closed and drained.
+    T* beginRead()
+    {
+        size_t read = head.load();
+        if (!wait([this, read] { return tail.load() != read; }))
+            return nullptr;
+        return &slots[read % N];
+    }
+
+    // Consumer: hand the slot returned by beginRead() back to the producer
+    void endRead()
+    {
+        head.store(head.load() + 1);
+        wakeSleepers();
+    }
+
+    // Wake both sides for good. Slots already published can still be read.
+    void close()
+    {
+        closed.store(true);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+        }
+        changed.notify_all();
+    }
+
+    // Reopen an empty ring after close()
+    void reopen()
+    {
+        head.store(0);
+        tail.store(0);
+        closed.store(false);
+    }
+
+private:
+    // Fast path is a single load. Otherwise register as a sleeper before re-checking under the lock, so a
+    // counter update either sees the sleeper and notifies, or happened early enough for the re-check to see it.
+    template <class Ready>
+    bool wait(Ready ready)
+    {
+        if (ready())
+            return true;
+        if (closed.load())
+            return false;
+
+        std::unique_lock<std::mutex> guard(lock);
+        sleepers.fetch_add(1);
+        changed.wait(guard, [this, &ready] { return ready() || closed.load(); });
+        sleepers.fetch_sub(1);
+        return ready();
+    }
+
+    void wakeSleepers()
+    {
+        if (sleepers.load() == 0)
+            return;
+        {
+            std::lock_guard<std::mutex> guard(lock); // a sleeper between its re-check and wait() holds this
+        }
+        changed.notify_all();
+    }
+
+    T slots[N];
+    std::atomic<size_t> head{ 0 };     // next slot to read, only the consumer advances it
+    std::atomic<size_t> tail{ 0 };     // next slot to write, only the producer advances it
+    std::atomic<bool> closed{ false };
+    std::atomic<int> sleepers{ 0 };
+
+    std::mutex lock;
+    std::condition_variable changed;
+};
+
+#endif
+//END
@@ -0,0 +1,175 @@
+
+//Static Batch - CPU baking of world transforms and merged uploads per material
+
+#include <iostream>         // Output log and error
+#include <unordered_map>
+#include <utility>
+
+#include "StaticBatch.h"
+
+using namespace std; // standard namespace
+
+void UBakeMeshData(const MeshData& source, const glm::mat4& model, MeshData& into)
+{
+    const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model))); // Same as the vertex shader
+    const GLuint baseVertex = into.nVertices;
+
+    into.verts.reserve(into.verts.size() + source.nVertices * MESH_FLOATS_PER_VERTEX);
+    for (GLuint v = 0; v < source.nVertices; ++v) {
+        const GLfloat* vertex = &source.verts[v * MESH_FLOATS_PER_VERTEX];
+        glm::vec3 position = glm::vec3(model * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f));
+        glm::vec3 normal = normalMatrix * glm::vec3(vertex[3], vertex[4], vertex[5]);
+
+        float length = glm::length(normal);
+        if (length > 0.0f)
+            normal = normal * (1.0f / length);
+
+        const GLfloat baked[MESH_FLOATS_PER_VERTEX] = {
+            position.x, position.y, position.z,
+            normal.x, normal.y, normal.z,
+            vertex[6], vertex[7]
+        };
+        into.verts.insert(into.verts.end(), baked, baked + MESH_FLOATS_PER_VERTEX);
+    }
+
+    if (source.indices.empty()) {
+        for (GLuint v = 0; v < source.nVertices; ++v)
+            into.indices.push_back(baseVertex + v);
+    }
+    else {
+        for (GLuint index : source.indices)
+            into.indices.push_back(baseVertex + index);
+    }
+
+    into.nVertices += source.nVertices;
+}
+
+bool UReadMeshData(const GLMesh& mesh, MeshData& data)
+{
+    if (mesh.vbo == 0 || mesh.nVertices == 0)
+        return false;
+
+    data.nVertices = mesh.nVertices;
+    data.verts.resize((size_t)mesh.nVertices * MESH_FLOATS_PER_VERTEX);
+    glBindBuffer(GL_COPY_READ_BUFFER, mesh.vbo);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)data.verts.size() * sizeof(GLfloat), data.verts.data());
+
+    data.indices.resize(mesh.nIndices);
+    if (mesh.nIndices > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, mesh.ibo);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)data.indices.size() * sizeof(GLuint), data.indices.data());
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return true;
+}
+
+void StaticBatcher::clear()
+{
+    members.clear();
+}
+
+void StaticBatcher::add(uint32_t node, MeshHandle mesh, GLuint material)
+{
+    Member member = { node, mesh, material };
+    members.push_back(member);
+}
+
+void StaticBatcher::build(const MeshPool& meshes, const std::vector<glm::mat4>& models)
+{
+    for (Batch& batch : batches)
+        UDestroyMesh(batch.mesh);
+    batches.clear();
+    nodeBatch.clear();
+    buildStats = StaticBatchStats();
+
+    // Merge in declaration order, one MeshData per material
+    unordered_map<GLuint, size_t> batchIndex;
+    vector<MeshData> merged;
+    MeshData source;
+    for (const Member& member : members) {
+        const GLMesh* mesh = meshes.get(member.mesh);
+        if (mesh == nullptr || !UReadMeshData(*mesh, source))
+            continue; // Not published yet
+
+        auto found = batchIndex.find(member.material);
+        if (found == batchIndex.end()) {
+            found = batchIndex.emplace(member.material, batches.size()).first;
+            batches.push_back(Batch());
+            batches.back().material = member.material;
+            merged.push_back(MeshData());
+        }
+
+        UBakeMeshData(source, models[member.node], merged[found->second]);
+        batches[found->second].nodes.push_back(member.node);
+        batches[found->second].nodeIndexCounts.push_back(source.indices.empty() ? source.nVertices : (GLuint)source.indices.size());
+
+        if (member.node >= nodeBatch.size())
+            nodeBatch.resize(member.node + 1, -1);
+        nodeBatch[member.node] = (int)found->second;
+        ++buildStats.objects;
+    }
+
+    for (size_t i = 0; i < batches.size(); ++i) {
+        merged[i].positionStream = true; // Depth prepass and shadow pass read positions only
+        UUploadMeshData(batches[i].mesh, merged[i]);
+        buildStats.vertices += merged[i].nVertices;
+        batches[i].indices = move(merged[i].indices);
+    }
+    buildStats.batches = (GLuint)batches.size();
+}
+
+bool StaticBatcher::release(uint32_t node)
+{
+    int index = batchOf(node);
+    if (index < 0)
+        return false;
+
+    // Members were baked one after another, so the node's indices are one run
+    Batch& batch = batches[index];
+    size_t member = 0;
+    GLuint first = 0;
+    while (batch.nodes[member] != node)
+        first += batch.nodeIndexCounts[member++];
+    GLuint count = batch.nodeIndexCounts[member];
+
+    batch.indices.erase(batch.indices.begin() + first, batch.indices.begin() + first + count);
+    batch.nodes.erase(batch.nodes.begin() + member);
+    batch.nodeIndexCounts.erase(batch.nodeIndexCounts.begin() + member);
+    nodeBatch[node] = -1;
+
+    // Only the front of the index buffer is rewritten; the draw count shrinks to match
+    batch.mesh.nIndices = (GLuint)batch.indices.size();
+    if (!batch.indices.empty()) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, batch.mesh.ibo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, (GLsizeiptr)batch.indices.size() * sizeof(GLuint), batch.indices.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    --buildStats.objects;
+    ++buildStats.released;
+    if (batch.nodes.empty())
+        --buildStats.batches;
+    return true;
+}
+
+void StaticBatcher::printStats(ostream& out) const
+{
+    out << "===== Static Batches =====\n"
+        << "Static objects: " << buildStats.objects << " draws before, " << buildStats.batches << " after ("
+        << buildStats.vertices << " baked vertices)";
+    if (buildStats.released > 0)
+        out << ", " << buildStats.released << " released to their own draws after moving";
+    out << endl;
+}
+
+void StaticBatcher::reset()
+{
+    for (Batch& batch : batches)
+        UDestroyMesh(batch.mesh);
+    batches.clear();
+    nodeBatch.clear();
+    members.clear();
+    buildStats = StaticBatchStats();
+}
+
+// END
@@ -0,0 +1,81 @@
+#pragma once
+
+//Static Batch Header - static objects pre-transformed into world space and merged per material at load time
+
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include <GL/glew.h>        // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+// Append source transformed by model to into. Positions get the full matrix, normals the inverse transpose of
+// its upper 3x3 (renormalized), so non-uniform scale does not tilt them. Non-indexed sources get sequential indices.
+void UBakeMeshData(const MeshData& source, const glm::mat4& model, MeshData& into);
+
+// Copy a published mesh's vertex and index buffers back to the CPU. Load time only, this stalls the pipeline.
+bool UReadMeshData(const GLMesh& mesh, MeshData& data);
+
+// Draws saved by batching
+struct StaticBatchStats {
+    GLuint objects = 0;     // static objects baked into batches
+    GLuint batches = 0;     // draws that replace them
+    GLuint vertices = 0;
+    GLuint released = 0;    // objects that started moving and went back to their own draws
+};
+
+// Static objects are grouped by material; each group becomes one mesh in world space, drawn with an identity
+// model matrix. Objects are identified by their transform node.
+class StaticBatcher {
+public:
+    struct Batch {
+        GLuint material;            // texture the whole batch is drawn with
+        GLMesh mesh;
+        std::vector<uint32_t> nodes;
+        std::vector<GLuint> nodeIndexCounts;    // indices each node contributes, in nodes order
+        std::vector<GLuint> indices;            // CPU copy of the index buffer, rewritten when a node is released
+    };
+
+    void clear();
+    void add(uint32_t node, MeshHandle mesh, GLuint material);
+
+    // Bake every object whose mesh is published, placed by models[node]. The others stay unbatched until the
+    // next build.
+    void build(const MeshPool& meshes, const std::vector<glm::mat4>& models);
+    bool built() const { return !batches.empty(); }
+
+    // Index of the batch that draws node, -1 if the node is drawn on its own
+    int batchOf(uint32_t node) const { return node < nodeBatch.size() ? nodeBatch[node] : -1; }
+
+    // A batched node became dynamic: drop its indices from its batch so it can be drawn on its own. Nothing is
+    // rebaked or read back; the node's vertices stay in the batch, unreferenced. Returns false if it was not batched.
+    bool release(uint32_t node);
+
+    const std::vector<Batch>& all() const { return batches; }
+    const StaticBatchStats& stats() const { return buildStats; }
+    void printStats(std::ostream& out) const;
+
+    void reset();
+
+private:
+    struct Member {
+        uint32_t node;
+        MeshHandle mesh;
+        GLuint material;
+    };
+
+    std::vector<Member> members;
+    std::vector<Batch> batches;
+    std::vector<int> nodeBatch;
+    StaticBatchStats buildStats;
+};
+
+#endif
+//END
@@ -0,0 +1,165 @@
+
+//Texture Array - resampling and upload of material layers
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>         // Output log and error
+
+#include "TextureArray.h"
+
+using namespace std; // standard namespace
+
+namespace {
+
+    // Resample `count` contiguous lines of pixels from srcLength to dstLength pixels each
+    void UResampleAxis(const float* src, int srcLength, float* dst, int dstLength, int count, int channels) {
+
+        const float scale = (float)srcLength / dstLength;
+        const float radius = max(scale, 1.0f);     // tent half-width in source texels
+
+        vector<float> weights;
+        for (int i = 0; i < dstLength; ++i) {
+            const float center = (i + 0.5f) * scale - 0.5f;
+            const int first = max(0, (int)floor(center - radius));
+            const int last = min(srcLength - 1, (int)ceil(center + radius));
+
+            weights.resize(last - first + 1);
+            float total = 0.0f;
+            for (int s = first; s <= last; ++s) {
+                float weight = max(0.0f, 1.0f - fabs(s - center) / radius);
+                weights[s - first] = weight;
+                total += weight;
+            }
+            if (total <= 0.0f) { // Only happens at the very edge, take the nearest texel
+                fill(weights.begin(), weights.end(), 0.0f);
+                weights[min(max((int)(center + 0.5f), first), last) - first] = 1.0f;
+                total = 1.0f;
+            }
+
+            for (int line = 0; line < count; ++line) {
+                const float* in = src + (size_t)line * srcLength * channels;
+                float* out = dst + (size_t)line * dstLength * channels;
+                for (int c = 0; c < channels; ++c) {
+                    float sum = 0.0f;
+                    for (int s = first; s <= last; ++s)
+                        sum += in[s * channels + c] * weights[s - first];
+                    out[i * channels + c] = sum / total;
+                }
+            }
+        }
+    }
+}
+
+void UResampleImage(const unsigned char* src, int srcWidth, int srcHeight, int channels,
+    unsigned char* dst, int dstWidth, int dstHeight)
+{
+    // Horizontal pass over rows, then vertical pass over the transposed result
+    vector<float> source((size_t)srcWidth * srcHeight * channels);
+    for (size_t i = 0; i < source.size(); ++i)
+        source[i] = src[i];
+
+    vector<float> wide((size_t)dstWidth * srcHeight * channels);
+    UResampleAxis(source.data(), srcWidth, wide.data(), dstWidth, srcHeight, channels);
+
+    // Transpose so columns become contiguous rows
+    vector<float> columns((size_t)dstWidth * srcHeight * channels);
+    for (int y = 0; y < srcHeight; ++y)
+        for (int x = 0; x < dstWidth; ++x)
+            for (int c = 0; c < channels; ++c)
+                columns[((size_t)x * srcHeight + y) * channels + c] = wide[((size_t)y * dstWidth + x) * channels + c];
+
+    vector<float> tall((size_t)dstWidth * dstHeight * channels);
+    UResampleAxis(columns.data(), srcHeight, tall.data(), dstHeight, dstWidth, channels);
+
+    for (int y = 0; y < dstHeight; ++y)
+        for (int x = 0; x < dstWidth; ++x)
+            for (int c = 0; c < channels; ++c) {
+                float value = tall[((size_t)x * dstHeight + y) * channels + c];
+                dst[((size_t)y * dstWidth + x) * channels + c] = (unsigned char)min(max(value + 0.5f, 0.0f), 255.0f);
+            }
+}
+
+bool TextureArray::create(int width, int height, GLuint layers, const char* label)
+{
+    reset();
+    if (width <= 0 || height <= 0 || layers == 0)
+        return false;
+
+    this->width = width;
+    this->height = height;
+    this->layers = layers;
+
+    const GLsizei levels = (GLsizei)floor(log2((double)max(width, height))) + 1;
+
+    texture.create(label);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, width, height, layers);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    texture.setSize((size_t)width * height * 4 * layers * 4 / 3); // Base levels plus mip chains
+    return true;
+}
+
+void TextureArray::reset()
+{
+    texture.reset();
+    width = 0;
+    height = 0;
+    layers = 0;
+    scratch.clear();
+    scratch.shrink_to_fit();
+}
+
+bool TextureArray::setLayer(GLuint layer, const unsigned char* pixels, int width, int height, int channels)
+{
+    if (layer >= layers || texture == 0)
+        return false;
+
+    if (channels != 3 && channels != 4) {
+        cout << "Not implemented to handle image with " << channels << " channels" << endl;
+        return false;
+    }
+
+    // Expand to RGBA first so the resampler and upload only deal with one layout
+    vector<unsigned char> rgba;
+    const unsigned char* source = pixels;
+    if (channels == 3) {
+        rgba.resize((size_t)width * height * 4);
+        for (size_t i = 0, n = (size_t)width * height; i < n; ++i) {
+            rgba[i * 4 + 0] = pixels[i * 3 + 0];
+            rgba[i * 4 + 1] = pixels[i * 3 + 1];
+            rgba[i * 4 + 2] = pixels[i * 3 + 2];
+            rgba[i * 4 + 3] = 255;
+        }
+        source = rgba.data();
+    }
+
+    if (width != this->width || height != this->height) {
+        scratch.resize((size_t)this->width * this->height * 4);
+        UResampleImage(source, width, height, 4, scratch.data(), this->width, this->height);
+        source = scratch.data();
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, this->width, this->height, 1, GL_RGBA, GL_UNSIGNED_BYTE, source);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return true;
+}
+
+void TextureArray::generateMipmaps()
+{
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    scratch.clear();
+    scratch.shrink_to_fit();
+}
+
+// END
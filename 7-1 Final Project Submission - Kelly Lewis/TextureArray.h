@@ -0,0 +1,44 @@
+#pragma once
+
+//Texture Array Header - material textures packed into one GL_TEXTURE_2D_ARRAY, resampled to a common size
+
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <vector>
+
+#include <GL/glew.h>        // GLEW library
+
+#include "GpuResources.h"
+
+// Resample 8-bit pixels to a new size with a separable tent filter. The filter widens when shrinking,
+// so each destination texel averages its whole footprint instead of skipping source texels.
+void UResampleImage(const unsigned char* src, int srcWidth, int srcHeight, int channels,
+    unsigned char* dst, int dstWidth, int dstHeight);
+
+// Fixed-size RGBA8 layers with a full mip chain. Layers are selected in the shader by index.
+class TextureArray {
+public:
+    // Allocates immutable storage for every layer and mip level
+    bool create(int width, int height, GLuint layers, const char* label);
+    void reset();
+
+    // Upload one layer from 3 or 4 channel pixels, resampling when the size differs from the array's
+    bool setLayer(GLuint layer, const unsigned char* pixels, int width, int height, int channels);
+
+    // Build the mip chain once every layer is in
+    void generateMipmaps();
+
+    GLuint layerCount() const { return layers; }
+    operator GLuint() const { return texture; }
+
+private:
+    GpuTexture texture;
+    int width = 0;
+    int height = 0;
+    GLuint layers = 0;
+    std::vector<unsigned char> scratch;     // resampled RGBA8 layer
+};
+
+#endif
+//END
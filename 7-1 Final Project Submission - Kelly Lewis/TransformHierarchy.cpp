@@ -0,0 +1,102 @@
+
+//Transform Hierarchy - dirty flag propagation and the forward update pass
+
+#include <algorithm>
+
+#include "TransformHierarchy.h"
+
+using namespace std; // standard namespace
+
+uint32_t TransformHierarchy::add(const glm::mat4& local, const glm::vec3& scale, uint32_t parent)
+{
+    const uint32_t node = (uint32_t)parents.size();
+    if (parent != TRANSFORM_NO_PARENT && parent >= node)
+        parent = TRANSFORM_NO_PARENT; // Parents must come first, anything else is treated as a root
+
+    parents.push_back(parent);
+    locals.push_back(local);
+    scales.push_back(scale);
+    worlds.push_back(glm::mat4(1.0f));
+    models.push_back(glm::mat4(1.0f));
+    dirty.push_back(0);
+
+    markDirty(node);
+    return node;
+}
+
+void TransformHierarchy::setLocal(uint32_t node, const glm::mat4& local)
+{
+    locals[node] = local;
+    markDirty(node);
+}
+
+void TransformHierarchy::setScale(uint32_t node, const glm::vec3& scale)
+{
+    scales[node] = scale;
+    markDirty(node);
+}
+
+void TransformHierarchy::setPosition(uint32_t node, const glm::vec3& position)
+{
+    glm::vec4& translation = locals[node][3];
+    if (translation.x == position.x && translation.y == position.y && translation.z == position.z)
+        return;
+
+    translation.x = position.x;
+    translation.y = position.y;
+    translation.z = position.z;
+    markDirty(node);
+}
+
+void TransformHierarchy::markDirty(uint32_t node)
+{
+    dirty[node] = 1;
+    firstDirty = min(firstDirty, node);
+}
+
+size_t TransformHierarchy::update()
+{
+    changed.clear();
+    if (firstDirty == TRANSFORM_NO_PARENT)
+        return 0;
+
+    // A node is recomputed if it was changed or its parent was recomputed earlier in this pass
+    const uint32_t count = (uint32_t)parents.size();
+    for (uint32_t node = firstDirty; node < count; ++node) {
+        const uint32_t parent = parents[node];
+        if (!dirty[node] && (parent == TRANSFORM_NO_PARENT || !dirty[parent]))
+            continue;
+
+        dirty[node] = 1; // Lets this node's children see it was recomputed
+        worlds[node] = parent == TRANSFORM_NO_PARENT ? locals[node] : worlds[parent] * locals[node];
+
+        // Scaling the basis columns is world * scale(s) without the full multiply
+        glm::mat4& model = models[node];
+        model = worlds[node];
+        model[0] *= scales[node].x;
+        model[1] *= scales[node].y;
+        model[2] *= scales[node].z;
+
+        changed.push_back(node);
+    }
+
+    for (uint32_t node : changed)
+        dirty[node] = 0;
+    firstDirty = TRANSFORM_NO_PARENT;
+
+    return changed.size();
+}
+
+void TransformHierarchy::clear()
+{
+    parents.clear();
+    locals.clear();
+    scales.clear();
+    worlds.clear();
+    models.clear();
+    dirty.clear();
+    changed.clear();
+    firstDirty = TRANSFORM_NO_PARENT;
+}
+
+// END
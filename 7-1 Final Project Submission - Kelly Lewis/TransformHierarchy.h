@@ -0,0 +1,62 @@
+#pragma once
+
+//Transform Hierarchy Header - parent / child transforms in flat arrays, recomputed only when something moves
+
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include <cstdint>
+#include <vector>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+const uint32_t TRANSFORM_NO_PARENT = 0xFFFFFFFFu;
+
+// Nodes live in parallel arrays indexed by node id, parents always before their children, so one forward pass
+// updates the whole tree. Each node has a rigid local transform that children inherit and a scale of its own
+// that they do not (a scaled parent would otherwise shear rotated children).
+//
+//     world[i] = world[parent] * local[i]
+//     model[i] = world[i] * scale(scale[i])
+class TransformHierarchy {
+public:
+    // Returns the new node's id. The parent must already exist.
+    uint32_t add(const glm::mat4& local, const glm::vec3& scale = glm::vec3(1.0f), uint32_t parent = TRANSFORM_NO_PARENT);
+
+    void setLocal(uint32_t node, const glm::mat4& local);
+    void setScale(uint32_t node, const glm::vec3& scale);
+
+    // Move a node without touching its rotation. Does nothing, not even mark the node dirty, if it is already there.
+    void setPosition(uint32_t node, const glm::vec3& position);
+
+    // Recompute dirty nodes and everything below them. Returns how many were recomputed; 0 costs no matrix math.
+    size_t update();
+
+    // Nodes recomputed by the last update, parents first
+    const std::vector<uint32_t>& updated() const { return changed; }
+
+    const glm::mat4& local(uint32_t node) const { return locals[node]; }
+    const glm::mat4& world(uint32_t node) const { return worlds[node]; }
+    const glm::mat4& model(uint32_t node) const { return models[node]; }
+    uint32_t parent(uint32_t node) const { return parents[node]; }
+    size_t size() const { return parents.size(); }
+
+    void clear();
+
+private:
+    void markDirty(uint32_t node);
+
+    std::vector<uint32_t> parents;
+    std::vector<glm::mat4> locals;
+    std::vector<glm::vec3> scales;
+    std::vector<glm::mat4> worlds;
+    std::vector<glm::mat4> models;
+    std::vector<uint8_t> dirty;
+
+    std::vector<uint32_t> changed;
+    uint32_t firstDirty = TRANSFORM_NO_PARENT;    // no node before this one needs recomputing
+};
+
+#endif
+//END